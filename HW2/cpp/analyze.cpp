@@ -0,0 +1,349 @@
+/*
+ * analyze.cpp
+ *
+ * Searches positions with CPlayer outside of a game, printing the result of
+ * every iteration.
+ *
+ *   analyze [options] position [moves...]
+ *   analyze [options] -f file
+ *
+ * A position is a PDN FEN like "B:W18,24,27,K10:B12,16,20", or "start" for
+ * the initial position, optionally followed by moves in PDN played from it.
+ * A file holds one position per line, empty lines and lines starting with
+ * '#' are skipped. The positions of a file are searched by several worker
+ * threads, each with its own player, and printed in the order of the file.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "cboard.h"
+#include "cpdn.h"
+#include "cplayer.h"
+#include "ctime.h"
+
+using namespace std;
+using namespace chk;
+
+// prints every iteration of the search as one line
+class CIterationPrinter: public CSearchListener
+{
+public:
+	CIterationPrinter(FILE *pOut, bool pFirst)
+		: mOut(pOut)
+		, mFirst(pFirst)
+	{
+	}
+
+	virtual void Iteration(int pDepth, eval_t pScore, const vector<CMove> &pPV,
+			int64_t pNodes, int64_t pTime)
+	{
+		if (pScore == -Infinity)
+			fprintf(mOut, "%3d %7s", pDepth, "forced");
+		else
+			fprintf(mOut, "%3d %7d", pDepth, pScore);
+		fprintf(mOut, " %12lld %8.3f s %8.0f knps ", (long long)pNodes, pTime / 1000000.0,
+				pTime > 0 ? pNodes * 1000.0 / pTime : 0.0);
+		for(vector<CMove>::const_iterator it = pPV.begin(); it != pPV.end(); ++it)
+			fprintf(mOut, " %s", PDNMove(*it, mFirst).c_str());
+		fprintf(mOut, "\n");
+		fflush(mOut);
+	}
+
+private:
+	FILE *mOut;
+	bool mFirst;
+};
+
+struct COptions
+{
+	COptions()
+		: mDepth(0)
+		, mTime(0)
+		, mJobs(1)
+		, mSettings("tt_file= book_file=")
+	{
+	}
+
+	int mDepth;         // plies, 0 for no limit
+	int64_t mTime;      // microseconds, 0 for no limit
+	int mJobs;
+	string mSettings;
+};
+
+// sets up the position given as a FEN or "start" followed by moves, seen by
+// the player to move
+static bool ParsePosition(const string &pPosition, CBoard &pBoard, bool &pFirst)
+{
+	istringstream lStream(pPosition);
+	string lToken;
+	if (!(lStream >> lToken))
+		return false;
+
+	if (lToken == "start") {
+		pBoard = CBoard(true, CELL_OWN);
+		pFirst = true;
+	} else if (!PDNSetup(lToken, pBoard, pFirst)) {
+		return false;
+	}
+
+	while(lStream >> lToken) {
+		CMove lMove;
+		if (!CPDNGame::FindMove(pBoard, CPDNSpan(lToken.data(), lToken.data() + lToken.size()), lMove, pFirst))
+			return false;
+		pBoard.DoMove(lMove);
+		// the player always searches for CELL_OWN
+		pBoard.Invert();
+		pFirst = !pFirst;
+	}
+	return true;
+}
+
+// searches one position, printing to pOut
+static bool Analyze(const string &pPosition, const COptions &pOptions, FILE *pOut)
+{
+	fprintf(pOut, "position %s\n", pPosition.c_str());
+
+	CBoard lBoard;
+	bool lFirst;
+	if (!ParsePosition(pPosition, lBoard, lFirst)) {
+		fprintf(pOut, "can't parse position\n\n");
+		return false;
+	}
+	vector<CMove> lMoves;
+	lBoard.FindPossibleMoves(lMoves);
+	if (lMoves.empty()) {
+		fprintf(pOut, "no moves\n\n");
+		return true;
+	}
+
+	CPlayer lPlayer;
+	if (!lPlayer.Config().Parse(pOptions.mSettings)) {
+		fprintf(pOut, "bad settings %s\n\n", pOptions.mSettings.c_str());
+		return false;
+	}
+	ostringstream lDepth;
+	lDepth << "max_depth=" << pOptions.mDepth;
+	lPlayer.Config().Set(lDepth.str());
+
+	CIterationPrinter lPrinter(pOut, lFirst);
+	lPlayer.SetListener(&lPrinter);
+
+	lPlayer.Initialize(lFirst, CTime::GetCurrent() + 1000000);
+	// the evaluation adds noise, which has to be the same every time for
+	// the results to be comparable
+	lPlayer.Seed(1);
+	const int64_t cNoLimit = 24 * 3600 * int64_t(1000000);
+	CTime lStart = CTime::GetCurrent();
+	CMove lBest = lPlayer.Play(lBoard, lStart + (pOptions.mTime > 0 ? pOptions.mTime : cNoLimit));
+	int64_t lTime = CTime::GetCurrent() - lStart;
+
+	fprintf(pOut, "best %s after %.3f s\n\n", PDNMove(lBest, lFirst).c_str(), lTime / 1000000.0);
+	return true;
+}
+
+// reads the positions of a file
+static bool ReadPositions(const char *pFile, vector<string> &pPositions)
+{
+	ifstream lFile(pFile);
+	if (!lFile)
+		return false;
+
+	string lLine;
+	while(getline(lFile, lLine)) {
+		string::size_type lStart = lLine.find_first_not_of(" \t\r");
+		if (lStart == string::npos || lLine[lStart] == '#')
+			continue;
+		string::size_type lEnd = lLine.find_last_not_of(" \t\r");
+		pPositions.push_back(lLine.substr(lStart, lEnd + 1 - lStart));
+	}
+	return true;
+}
+
+// copies what a worker wrote to stdout
+static void CopyOutput(FILE *pFile)
+{
+	rewind(pFile);
+	char lBuffer[4096];
+	size_t lRead;
+	while((lRead = fread(lBuffer, 1, sizeof(lBuffer), pFile)) > 0)
+		fwrite(lBuffer, 1, lRead, stdout);
+	fclose(pFile);
+	fflush(stdout);
+}
+
+// the positions of AnalyzeAll() and what the workers made of them
+struct CWork
+{
+	CWork(const vector<string> &pPositions, const COptions &pOptions)
+		: mPositions(pPositions)
+		, mOptions(pOptions)
+		, mOutputs(pPositions.size(), (FILE*)NULL)
+		, mDone(pPositions.size(), false)
+		, mNext(0)
+		, mFailed(0)
+	{
+		pthread_mutex_init(&mMutex, NULL);
+		pthread_cond_init(&mDoneCond, NULL);
+	}
+
+	~CWork()
+	{
+		pthread_cond_destroy(&mDoneCond);
+		pthread_mutex_destroy(&mMutex);
+	}
+
+	const vector<string> &mPositions;
+	const COptions &mOptions;
+	vector<FILE*> mOutputs;     // temporary file of each position
+	vector<bool> mDone;         // with mFailed, guarded by mMutex
+	size_t mNext;               // next position to search
+	int mFailed;
+	pthread_mutex_t mMutex;
+	pthread_cond_t mDoneCond;
+};
+
+// searches positions until there are none left
+static void *Worker(void *pWork)
+{
+	CWork &lWork = *(CWork *)pWork;
+	for(;;) {
+		size_t i = __sync_fetch_and_add(&lWork.mNext, 1);
+		if (i >= lWork.mPositions.size())
+			return NULL;
+		lWork.mOutputs[i] = tmpfile();
+		bool lOk = lWork.mOutputs[i] && Analyze(lWork.mPositions[i], lWork.mOptions, lWork.mOutputs[i]);
+		if (!lWork.mOutputs[i])
+			cerr << "can't create temporary file" << endl;
+
+		pthread_mutex_lock(&lWork.mMutex);
+		lWork.mDone[i] = true;
+		lWork.mFailed += !lOk;
+		pthread_cond_broadcast(&lWork.mDoneCond);
+		pthread_mutex_unlock(&lWork.mMutex);
+	}
+}
+
+// searches the positions with up to pOptions.mJobs worker threads, each
+// position being written to its own temporary file, and prints the files in
+// order
+static int AnalyzeAll(const vector<string> &pPositions, const COptions &pOptions)
+{
+	// the players talk about their searches on cout
+	cout.setstate(ios::badbit);
+
+	if (pOptions.mJobs <= 1) {
+		int lFailed = 0;
+		for(size_t i = 0; i < pPositions.size(); ++i)
+			lFailed += !Analyze(pPositions[i], pOptions, stdout);
+		cout.clear();
+		return lFailed ? -1 : 0;
+	}
+
+	CWork lWork(pPositions, pOptions);
+	CTime lStart = CTime::GetCurrent();
+	fflush(stdout);
+
+	vector<pthread_t> lThreads(min<size_t>(pOptions.mJobs, pPositions.size()));
+	for(size_t i = 0; i < lThreads.size(); ++i) {
+		if (pthread_create(&lThreads[i], NULL, Worker, &lWork) != 0) {
+			cerr << "can't create thread" << endl;
+			lThreads.resize(i);
+			break;
+		}
+	}
+	if (lThreads.empty())
+		Worker(&lWork);
+
+	for(size_t i = 0; i < pPositions.size(); ++i) {
+		pthread_mutex_lock(&lWork.mMutex);
+		while(!lWork.mDone[i])
+			pthread_cond_wait(&lWork.mDoneCond, &lWork.mMutex);
+		pthread_mutex_unlock(&lWork.mMutex);
+		if (lWork.mOutputs[i])
+			CopyOutput(lWork.mOutputs[i]);
+	}
+	for(size_t i = 0; i < lThreads.size(); ++i)
+		pthread_join(lThreads[i], NULL);
+
+	cout.clear();
+	cout << pPositions.size() << " positions in " << (CTime::GetCurrent() - lStart) / 1000000.0
+		 << " s with " << lThreads.size() << " threads, " << lWork.mFailed << " failed" << endl;
+	return lWork.mFailed ? -1 : 0;
+}
+
+static void Usage(const char *pName)
+{
+	cerr << "usage: " << pName << " [options] position [moves...]" << endl
+		 << "       " << pName << " [options] -f file" << endl
+		 << "options:" << endl
+		 << "  -d depth     last iteration searched, in plies" << endl
+		 << "  -t ms        time per position (default 1000 without -d)" << endl
+		 << "  -j jobs      positions of a file searched in parallel" << endl
+		 << "  -c settings  search settings, like \"lmr=0,tt_bits=22\"" << endl
+		 << "positions are PDN FENs like \"B:W18,24,K27:B12,16\" or \"start\"" << endl;
+}
+
+int main(int pArgC, char **pArgs)
+{
+	COptions lOptions;
+	const char *lFile = NULL;
+	int lOpt;
+	while((lOpt = getopt(pArgC, pArgs, "d:t:j:c:f:")) != -1) {
+		switch(lOpt) {
+		case 'd':
+			lOptions.mDepth = atoi(optarg);
+			break;
+		case 't':
+			lOptions.mTime = atoi(optarg) * int64_t(1000);
+			break;
+		case 'j':
+			lOptions.mJobs = atoi(optarg);
+			break;
+		case 'c':
+			lOptions.mSettings += string(" ") + optarg;
+			break;
+		case 'f':
+			lFile = optarg;
+			break;
+		default:
+			Usage(pArgs[0]);
+			return -1;
+		}
+	}
+	if (lOptions.mDepth <= 0 && lOptions.mTime <= 0)
+		lOptions.mTime = 1000000;
+
+	vector<string> lPositions;
+	if (lFile) {
+		if (optind != pArgC) {
+			Usage(pArgs[0]);
+			return -1;
+		}
+		if (!ReadPositions(lFile, lPositions)) {
+			cerr << "can't read " << lFile << endl;
+			return -1;
+		}
+	} else {
+		if (optind == pArgC) {
+			Usage(pArgs[0]);
+			return -1;
+		}
+		string lPosition;
+		for(int i = optind; i < pArgC; ++i)
+			lPosition += (i > optind ? " " : "") + string(pArgs[i]);
+		lPositions.push_back(lPosition);
+	}
+
+	return AnalyzeAll(lPositions, lOptions);
+}
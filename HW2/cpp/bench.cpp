@@ -0,0 +1,357 @@
+/*
+ * bench.cpp
+ *
+ * Micro benchmarks for the engine. Run without arguments to see the
+ * available benchmarks.
+ */
+
+#include "cboard.h"
+#include "cleafbatch.h"
+#include "clargememory.h"
+#include "cpdn.h"
+#include "cplayer.h"
+#include "ctime.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace chk;
+
+// counts the leaves of the move tree of the given depth
+static uint64_t Perft(const CBoard &pBoard, int pDepth)
+{
+	vector<CMove> lMoves;
+	pBoard.FindPossibleMoves(lMoves);
+	if (pDepth <= 1)
+		return lMoves.size();
+
+	uint64_t lLeaves = 0;
+	for(vector<CMove>::iterator it = lMoves.begin(); it != lMoves.end(); ++it) {
+		lLeaves += Perft(CBoard(pBoard, *it), pDepth - 1);
+	}
+	return lLeaves;
+}
+
+// move generation and DoMove speed, from the initial position
+static void BenchPerft(int pDepth)
+{
+	CBoard lBoard;
+	for(int d = 1; d <= pDepth; ++d) {
+		CTime lStart = CTime::GetCurrent();
+		uint64_t lLeaves = Perft(lBoard, d);
+		double lSeconds = (CTime::GetCurrent() - lStart) / 1000000.0;
+		cout << "perft " << d << ": " << lLeaves << " leaves in " << lSeconds << " s";
+		if (lSeconds > 0)
+			cout << " (" << lLeaves / lSeconds / 1000000.0 << " M leaves/s)";
+		cout << endl;
+	}
+}
+
+// evaluates the children of every node at depth pDepth-1, one by one or
+// batched. Returns the number of leaves, and adds their scores to pSum
+static uint64_t EvaluateLeaves(const CBoard &pBoard, int pDepth, bool pBatch, int64_t &pSum)
+{
+	vector<CMove> lMoves;
+	pBoard.FindPossibleMoves(lMoves);
+	if (lMoves.empty())
+		return 0;
+
+	if (pDepth <= 1) {
+		if (pBatch && lMoves.size() <= (size_t)CLeafBatch::cMaxBoards) {
+			CLeafBatch lBatch;
+			eval_t lScores[CLeafBatch::cMaxBoards];
+			for(vector<CMove>::iterator it = lMoves.begin(); it != lMoves.end(); ++it)
+				lBatch.Add(CBoard(pBoard, *it));
+			lBatch.Evaluate(lScores);
+			for(int i = 0; i < lBatch.Size(); ++i)
+				pSum += lScores[i];
+		} else {
+			// the moves of the children only matter if there are none, which
+			// is handled by the search before evaluating
+			for(vector<CMove>::iterator it = lMoves.begin(); it != lMoves.end(); ++it)
+				pSum += CBoard(pBoard, *it).Evaluate(lMoves);
+		}
+		return lMoves.size();
+	}
+
+	uint64_t lLeaves = 0;
+	for(vector<CMove>::iterator it = lMoves.begin(); it != lMoves.end(); ++it) {
+		lLeaves += EvaluateLeaves(CBoard(pBoard, *it), pDepth - 1, pBatch, pSum);
+	}
+	return lLeaves;
+}
+
+// static evaluation speed, one position at a time against batched
+static void BenchLeaves(int pDepth)
+{
+#ifdef __AVX2__
+	cout << "batched evaluation uses AVX2" << endl;
+#else
+	cout << "batched evaluation uses scalar popcounts" << endl;
+#endif
+	CBoard lBoard;
+	for(int b = 0; b < 2; ++b) {
+		int64_t lSum = 0;
+		CTime lStart = CTime::GetCurrent();
+		uint64_t lLeaves = EvaluateLeaves(lBoard, pDepth, b == 1, lSum);
+		double lSeconds = (CTime::GetCurrent() - lStart) / 1000000.0;
+		cout << (b == 1 ? "batched:  " : "per node: ") << lLeaves << " leaves in " << lSeconds << " s";
+		if (lSeconds > 0)
+			cout << " (" << lLeaves / lSeconds / 1000000.0 << " M leaves/s)";
+		cout << ", checksum " << lSum << endl;
+	}
+}
+
+// latency of random probes of a table of pMB megabytes, on huge pages and
+// on normal pages. Every probe depends on the previous one, so that they
+// can't overlap
+static void BenchProbes(int pMB)
+{
+	const int cProbes = 10000000;
+	size_t lBytes = size_t(pMB) << 20;
+	for(int h = 1; h >= 0; --h) {
+		CLargeMemory lMemory;
+		if (!lMemory.Allocate(lBytes, h == 1)) {
+			cout << "can't allocate " << pMB << " MB" << endl;
+			return;
+		}
+		CTime lStart = CTime::GetCurrent();
+		lMemory.Prefault();
+		double lFault = (CTime::GetCurrent() - lStart) / 1000.0;
+
+		const uint64_t *lTable = (const uint64_t *)lMemory.Data();
+		uint64_t lMask = lBytes / sizeof(uint64_t) - 1;
+		uint64_t lKey = 1;
+		lStart = CTime::GetCurrent();
+		for(int i = 0; i < cProbes; ++i) {
+			lKey ^= lKey << 13;
+			lKey ^= lKey >> 7;
+			lKey ^= lKey << 17;
+			lKey += lTable[lKey & lMask];
+		}
+		double lSeconds = (CTime::GetCurrent() - lStart) / 1000000.0;
+		cout << (h == 1 ? "huge pages:   " : "normal pages: ") << lMemory.PageSize() / 1024 << " KB pages, "
+			 << lFault << " ms to map, " << lSeconds * 1e9 / cProbes << " ns per probe"
+			 << ", checksum " << lKey << endl;
+	}
+}
+
+// a few positions of the opening and middle game, as PDN moves
+static const char *cOpeningMoves[] = { "", "11-15", "11-15 23-19 8-11 22-17", "9-13 22-18 10-15 18x11 8x15",
+		"11-15 22-17 15-19 24x15 10x19 23x16 12x19" };
+static const int cOpenings = sizeof(cOpeningMoves) / sizeof(cOpeningMoves[0]);
+
+// plays the moves of an opening from the initial position, returns true if
+// the first player is to move, whose pieces are then CELL_OWN
+static bool PlayOpening(const char *pMoves, CBoard &pBoard)
+{
+	bool lFirst = true;
+	istringstream lMoves(pMoves);
+	string lMove;
+	while(lMoves >> lMove) {
+		CMove lFound;
+		if (!CPDNGame::FindMove(pBoard, CPDNSpan(lMove.data(), lMove.data() + lMove.size()), lFound, lFirst))
+			break;
+		pBoard.DoMove(lFound);
+		pBoard.Invert();
+		lFirst = !lFirst;
+	}
+	return lFirst;
+}
+
+// remembers the nodes and time of every iteration of a search
+class CIterationLog: public CSearchListener
+{
+public:
+	virtual void Iteration(int pDepth, eval_t, const vector<CMove> &,
+			int64_t pNodes, int64_t pTime)
+	{
+		if ((int)mNodes.size() < pDepth) {
+			mNodes.resize(pDepth, 0);
+			mTime.resize(pDepth, 0);
+		}
+		mNodes[pDepth - 1] = pNodes;
+		mTime[pDepth - 1] = pTime;
+	}
+
+	vector<int64_t> mNodes;
+	vector<int64_t> mTime;
+};
+
+// nodes and time to reach each depth with the full window driver and with
+// MTD(f), summed over a few positions of the opening and middle game
+static void BenchSearch(int pDepth)
+{
+	vector<int64_t> lNodes[2], lTime[2];
+	for(int d = 0; d < 2; ++d) {
+		lNodes[d].assign(pDepth, 0);
+		lTime[d].assign(pDepth, 0);
+	}
+
+	// the players talk about their searches on cout
+	cout.setstate(ios::badbit);
+	for(int p = 0; p < cOpenings; ++p) {
+		CBoard lBoard;
+		bool lFirst = PlayOpening(cOpeningMoves[p], lBoard);
+
+		for(int d = 0; d < 2; ++d) {
+			CPlayer lPlayer;
+			ostringstream lSettings;
+			lSettings << "tt_file= egdb_file= book_file= mtdf=" << d << " max_depth=" << pDepth;
+			lPlayer.Config().Parse(lSettings.str());
+			CIterationLog lLog;
+			lPlayer.SetListener(&lLog);
+			lPlayer.Initialize(lFirst, CTime::GetCurrent() + 1000000);
+			lPlayer.Seed(1);
+			lPlayer.Play(lBoard, CTime::GetCurrent() + 24 * 3600 * int64_t(1000000));
+			for(size_t i = 0; i < lLog.mNodes.size(); ++i) {
+				lNodes[d][i] += lLog.mNodes[i];
+				lTime[d][i] += lLog.mTime[i];
+			}
+		}
+	}
+	cout.clear();
+
+	cout << "depth   alpha-beta nodes       time   MTD(f) nodes       time" << endl;
+	for(int i = 0; i < pDepth; ++i) {
+		cout.width(5);
+		cout << i + 1;
+		for(int d = 0; d < 2; ++d) {
+			cout << "  ";
+			cout.width(17);
+			cout << lNodes[d][i] << "  ";
+			cout.width(7);
+			cout << lTime[d][i] / 1000.0 << " ms";
+		}
+		cout << endl;
+	}
+}
+
+// adds up the nodes and time of the last iteration of every search
+class CSearchTotals: public CSearchListener
+{
+public:
+	CSearchTotals()
+		: mNodes(0)
+		, mTime(0)
+		, mLastNodes(0)
+		, mLastTime(0)
+	{
+	}
+
+	virtual void Iteration(int, eval_t, const vector<CMove> &,
+			int64_t pNodes, int64_t pTime)
+	{
+		mLastNodes = pNodes;
+		mLastTime = pTime;
+	}
+
+	// to be called after every search
+	void Add()
+	{
+		mNodes += mLastNodes;
+		mTime += mLastTime;
+		mLastNodes = mLastTime = 0;
+	}
+
+	int64_t mNodes;
+	int64_t mTime;
+
+private:
+	int64_t mLastNodes;
+	int64_t mLastTime;
+};
+
+// games of Monte Carlo tree search against alpha-beta from the openings of
+// BenchSearch(), each opening played twice with the colours swapped
+static void BenchMatch(int pMilliseconds, int pThreads)
+{
+	const int cMaxPlies = 300;
+	int lResults[3] = { 0, 0, 0 };     // wins, draws and losses of Monte Carlo
+	CSearchTotals lTotals[2];
+
+	cout.setstate(ios::badbit);
+	for(int g = 0; g < 2 * cOpenings; ++g) {
+		CBoard lBoard;
+		bool lFirst = PlayOpening(cOpeningMoves[g / 2], lBoard);
+		// player 0 searches with Monte Carlo and has the first colour in
+		// even games
+		bool lMonteCarloFirst = (g % 2 == 0);
+		CPlayer lPlayers[2];
+		for(int i = 0; i < 2; ++i) {
+			ostringstream lSettings;
+			lSettings << "tt_file= egdb_file= book_file=";
+			if (i == 0)
+				lSettings << " mcts=1 mcts_threads=" << pThreads;
+			lPlayers[i].Config().Parse(lSettings.str());
+			lPlayers[i].SetListener(&lTotals[i]);
+			lPlayers[i].Initialize(lMonteCarloFirst == (i == 0), CTime::GetCurrent() + 1000000);
+			lPlayers[i].Seed(g + 1);
+		}
+
+		int lResult = 1;
+		for(int lPly = 0; lPly < cMaxPlies; ++lPly) {
+			int lToMove = lFirst == lMonteCarloFirst ? 0 : 1;
+			vector<CMove> lMoves;
+			lBoard.FindPossibleMoves(lMoves);
+			if (lMoves.empty()) {
+				lResult = lToMove == 0 ? 2 : 0;
+				break;
+			}
+			int lDrawPlies = lPlayers[0].Config().mDrawPlies;
+			if (lDrawPlies > 0 && lBoard.ReversiblePlies() >= lDrawPlies)
+				break;
+			CMove lMove = lPlayers[lToMove].Play(lBoard, CTime::GetCurrent() + pMilliseconds * int64_t(1000));
+			lTotals[lToMove].Add();
+			lBoard.DoMove(lMove);
+			lBoard.Invert();
+			lFirst = !lFirst;
+		}
+		++lResults[lResult];
+		for(int i = 0; i < 2; ++i)
+			lPlayers[i].GameOver();
+	}
+	cout.clear();
+
+	cout << "Monte Carlo (" << pThreads << " thread(s)) against alpha-beta at " << pMilliseconds << " ms a move: "
+		 << lResults[0] << " wins, " << lResults[1] << " draws, " << lResults[2] << " losses" << endl;
+	const char *cNames[] = { "Monte Carlo playouts", "alpha-beta nodes" };
+	for(int i = 0; i < 2; ++i)
+		cout << cNames[i] << " per second: "
+			 << (lTotals[i].mTime > 0 ? lTotals[i].mNodes * 1000000 / lTotals[i].mTime : 0) << endl;
+}
+
+int main(int pArgC, char **pArgs)
+{
+	if (pArgC < 2) {
+		cerr << "usage: " << pArgs[0] << " benchmark [arguments]" << endl
+			 << "  perft [depth]      move generator and DoMove (default depth 10)" << endl
+			 << "  leaves [depth]     static evaluation of the leaves of that depth, one by one and batched (default 9)" << endl
+			 << "  search [depth]     nodes and time to each depth with alpha-beta and MTD(f) (default 11)" << endl
+			 << "  probes [MB]        random probes of a table on huge and normal pages, of a power of 2 MB (default 256)" << endl
+			 << "  match [ms] [n]     Monte Carlo tree search on n threads against alpha-beta from a few openings (default 100 ms, 1 thread)" << endl;
+		return -1;
+	}
+
+	if (strcmp(pArgs[1], "perft") == 0) {
+		BenchPerft(pArgC > 2 ? atoi(pArgs[2]) : 10);
+	} else if (strcmp(pArgs[1], "leaves") == 0) {
+		BenchLeaves(pArgC > 2 ? atoi(pArgs[2]) : 9);
+	} else if (strcmp(pArgs[1], "search") == 0) {
+		BenchSearch(pArgC > 2 ? atoi(pArgs[2]) : 11);
+	} else if (strcmp(pArgs[1], "probes") == 0) {
+		BenchProbes(pArgC > 2 ? atoi(pArgs[2]) : 256);
+	} else if (strcmp(pArgs[1], "match") == 0) {
+		BenchMatch(pArgC > 2 ? atoi(pArgs[2]) : 100, pArgC > 3 ? atoi(pArgs[3]) : 1);
+	} else {
+		cerr << "unknown benchmark " << pArgs[1] << endl;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * book.cpp
+ *
+ * Shows the opening book learned by the client (see COpeningBook), and
+ * searches deeper the positions of the book which were lost since their
+ * last search:
+ *
+ *   book show [book]
+ *   book deepen [-d depth] [-s settings] [book]
+ *
+ * The scores are written back with COpeningBook::Update(), so clients may
+ * go on playing and learning with the same file meanwhile.
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "copeningbook.h"
+#include "cplayer.h"
+#include "ctime.h"
+
+using namespace std;
+using namespace chk;
+
+// forced moves played before searching a position of the book
+static const int cMaxForced = 20;
+
+static void Usage(const char *pName)
+{
+	cerr << "usage: " << pName << " show [book]" << endl
+		 << "       " << pName << " deepen [-d depth] [-s settings] [book]" << endl
+		 << "  -d  plies searched (default 14)" << endl
+		 << "  -s  settings of the search, as for the client" << endl
+		 << "  the book is book.dat if not given" << endl;
+}
+
+// remembers the score of the last completed iteration
+class CLastScore: public CSearchListener
+{
+public:
+	CLastScore()
+		: mScore(0)
+		, mDepth(0)
+	{
+	}
+
+	virtual void Iteration(int pDepth, eval_t pScore, const vector<CMove> &,
+			int64_t, int64_t)
+	{
+		// the search of a single move has no score
+		if (pScore == -Infinity)
+			return;
+		mScore = pScore;
+		mDepth = pDepth;
+	}
+
+	eval_t mScore;
+	int mDepth;
+};
+
+static int Show(const string &pFile)
+{
+	COpeningBook lBook;
+	if (!lBook.Load(pFile)) {
+		cerr << "can't read " << pFile << endl;
+		return -1;
+	}
+	cout << "             key  games   won  lost  score depth  value" << endl;
+	for(size_t i = 0; i < lBook.Size(); ++i) {
+		const CBookEntry &lEntry = lBook.At(i);
+		cout << hex;
+		cout.width(16);
+		cout << lEntry.mKey << dec;
+		cout.width(7);
+		cout << lEntry.mGames;
+		cout.width(6);
+		cout << lEntry.mWins;
+		cout.width(6);
+		cout << lEntry.mLosses;
+		cout.width(7);
+		cout << lEntry.mScore;
+		cout.width(6);
+		cout << lEntry.mDepth;
+		cout.width(7);
+		cout << COpeningBook::Value(lEntry);
+		if (COpeningBook::ToDeepen(lEntry))
+			cout << "  to deepen";
+		cout << endl;
+	}
+	cout << lBook.Size() << " positions" << endl;
+	return 0;
+}
+
+static int Deepen(const string &pFile, int pDepth, const string &pSettings)
+{
+	COpeningBook lBook;
+	if (!lBook.Load(pFile)) {
+		cerr << "can't read " << pFile << endl;
+		return -1;
+	}
+
+	CPlayer lPlayer;
+	ostringstream lSettings;
+	lSettings << "tt_file= book_file= pns=0 max_depth=" << pDepth << " " << pSettings;
+	if (!lPlayer.Config().Parse(lSettings.str())) {
+		cerr << "bad settings " << pSettings << endl;
+		return -1;
+	}
+	CLastScore lLast;
+	lPlayer.SetListener(&lLast);
+	// the player talks about its searches on cout
+	cout.setstate(ios::badbit);
+	lPlayer.Initialize(true, CTime::GetCurrent() + 1000000);
+	cout.clear();
+
+	COpeningBook lChanges;
+	int lSearched = 0;
+	for(size_t i = 0; i < lBook.Size(); ++i) {
+		const CBookEntry &lEntry = lBook.At(i);
+		if (!COpeningBook::ToDeepen(lEntry))
+			continue;
+
+		// the search is for the player to move, the book for the one who
+		// moved. Forced moves are played first, since the search doesn't
+		// score a single move
+		CBoard lEntryBoard = COpeningBook::Board(lEntry);
+		CBoard lBoard = lEntryBoard;
+		int lSign = -1;
+		vector<CMove> lMoves;
+		for(int j = 0; j < cMaxForced; ++j) {
+			lBoard.FindPossibleMoves(lMoves);
+			if (lMoves.size() != 1)
+				break;
+			lBoard.DoMove(lMoves[0]);
+			lBoard.Invert();
+			lSign = -lSign;
+		}
+
+		eval_t lScore;
+		if (lMoves.empty()) {
+			lScore = -lSign * cWin;
+		} else if (lMoves.size() == 1) {
+			continue;
+		} else {
+			lLast = CLastScore();
+			cout.setstate(ios::badbit);
+			lPlayer.Play(lBoard, CTime::GetCurrent() + 24 * 3600 * int64_t(1000000));
+			cout.clear();
+			if (lLast.mDepth == 0)
+				continue;
+			lScore = lSign * lLast.mScore;
+		}
+		lChanges.AddScore(lEntryBoard, lScore, pDepth, lEntry.mLosses);
+		++lSearched;
+		cout << "position " << i << ": " << lEntry.mWins << " won, " << lEntry.mLosses << " lost, score "
+			 << lEntry.mScore << " at depth " << lEntry.mDepth << " -> " << lScore << " at depth " << pDepth << endl;
+	}
+
+	if (!COpeningBook::Update(pFile, lChanges)) {
+		cerr << "can't write " << pFile << endl;
+		return -1;
+	}
+	cout << "searched " << lSearched << " positions" << endl;
+	return 0;
+}
+
+int main(int pArgC, char **pArgs)
+{
+	if (pArgC < 2) {
+		Usage(pArgs[0]);
+		return -1;
+	}
+	string lCommand = pArgs[1];
+	int lDepth = 14;
+	string lSettings;
+
+	// the options follow the command
+	optind = 2;
+	int lOpt;
+	while((lOpt = getopt(pArgC, pArgs, "d:s:")) != -1) {
+		switch(lOpt) {
+		case 'd': lDepth = atoi(optarg); break;
+		case 's': lSettings += string(" ") + optarg; break;
+		default:
+			Usage(pArgs[0]);
+			return -1;
+		}
+	}
+	string lFile = optind < pArgC ? pArgs[optind] : "book.dat";
+
+	if (lCommand == "show")
+		return Show(lFile);
+	if (lCommand == "deepen" && lDepth > 0)
+		return Deepen(lFile, lDepth, lSettings);
+	Usage(pArgs[0]);
+	return -1;
+}
@@ -0,0 +1,37 @@
+#ifndef _CHECKERS_CATOMIC_H_
+#define _CHECKERS_CATOMIC_H_
+
+namespace chk {
+
+///stores \p pValue in \p pVar with release semantics
+
+///What the thread wrote before is seen by a thread reading \p pVar with
+///Published() and finding the value. Compilers without the __atomic
+///builtins (gcc before 4.7) get a full barrier before a volatile store.
+template<typename tType>
+inline void Publish(tType &pVar,tType pValue)
+{
+#ifdef __ATOMIC_RELEASE
+    __atomic_store_n(&pVar,pValue,__ATOMIC_RELEASE);
+#else
+    __sync_synchronize();
+    *(volatile tType*)&pVar=pValue;
+#endif
+}
+
+///reads \p pVar with acquire semantics, see Publish()
+template<typename tType>
+inline tType Published(const tType &pVar)
+{
+#ifdef __ATOMIC_ACQUIRE
+    return __atomic_load_n(&pVar,__ATOMIC_ACQUIRE);
+#else
+    tType lValue=*(const volatile tType*)&pVar;
+    __sync_synchronize();
+    return lValue;
+#endif
+}
+
+/*namespace chk*/ }
+
+#endif
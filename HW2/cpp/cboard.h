@@ -3,10 +3,15 @@
 
 #include "constants.h"
 #include "cmove.h"
+#include "evalweights.h"
+#include "crandom.h"
 #include <stdint.h>
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace chk {
 
@@ -19,9 +24,10 @@ public:
     
     ///if \p pInit is true, initializes the board to the starting position
     
-    ///Otherwise, leave uninitialized
+    ///Otherwise, the board is left empty
     explicit CBoard(bool pInit = true, ECell player = CELL_OWN):
-    		mPlayer(player)
+    		mPlayer(player),
+    		mReversiblePlies(0)
     {
         if(pInit)
         {
@@ -35,6 +41,11 @@ public:
                 mCell[i]=CELL_EMPTY;
             }
         }
+        else
+        {
+            memset(mCell,CELL_EMPTY,sizeof(mCell));
+        }
+        ComputeHash();
     }
 
     ///constructs a board which is the result of applying move \p pMove to board \p pRH
@@ -44,21 +55,33 @@ public:
     ///
     /// \sa DoMove()
     CBoard(const CBoard &pRH,const CMove &pMove):
-    	mPlayer(pRH.mPlayer)
+    	mPlayer(pRH.mPlayer),
+    	mHash(pRH.mHash),
+    	mReversiblePlies(pRH.mReversiblePlies)
     {
         memcpy(mCell,pRH.mCell,sizeof(mCell));
         
         DoMove(pMove);
     }
 
-    ECell Player()
+    ///returns true if both boards hold the same position with the same player to move
+
+    ///The number of reversible plies played before is not compared
+    bool operator==(const CBoard &pRH) const
+    {
+        return mPlayer==pRH.mPlayer&&memcmp(mCell,pRH.mCell,sizeof(mCell))==0;
+    }
+
+    ECell Player() const
     {
     	return mPlayer;
     }
 
     void SetPlayer(ECell player)
     {
-    	mPlayer = player;
+    	if(mPlayer != player) {
+    		TogglePlayer();
+    	}
     }
 
     void TogglePlayer()
@@ -68,6 +91,57 @@ public:
     	} else {
     		mPlayer = CELL_OWN;
     	}
+    	mHash ^= HashKeys()[cHashPlayerKey];
+    }
+
+    ///transforms the board from "seen by one player" to "seen by the other"
+
+    ///Like CMove::Invert(), the cells are mirrored through the centre of the
+    ///board, and the pieces and the player to move change sides.
+    void Invert()
+    {
+        for(int i=0;i<cSquares/2;i++)
+        {
+            uint8_t lPiece=InvertPiece(mCell[i]);
+            mCell[i]=InvertPiece(mCell[cSquares-1-i]);
+            mCell[cSquares-1-i]=lPiece;
+        }
+        mPlayer=(mPlayer==CELL_OWN)?CELL_OTHER:CELL_OWN;
+        ComputeHash();
+    }
+
+    ///returns a 64 bit hash of the position, including the player to move
+
+    ///It is updated incrementally by DoMove()
+    uint64_t Hash() const
+    {
+        return mHash;
+    }
+
+    ///returns the hash the board would have after Invert(), without inverting it
+    uint64_t InvertedHash() const
+    {
+        const uint64_t lPlayerKey=HashKeys()[cHashPlayerKey];
+        uint64_t lPieces=(mPlayer==CELL_OTHER)?mHash^lPlayerKey:mHash;
+        return MirrorKey(lPieces)^((mPlayer==CELL_OWN)?lPlayerKey:0);
+    }
+
+    ///returns the same key for a position and its colour-flipped mirror
+
+    ///It is the hash of the position seen by the player to move, i.e.
+    ///Hash() if CELL_OWN is to move and InvertedHash() otherwise. Results
+    ///stored under it have to be seen by the player to move as well.
+    uint64_t CanonicalHash() const
+    {
+        return (mPlayer==CELL_OWN)?mHash:InvertedHash();
+    }
+
+    ///returns the number of plies since the last jump or move of a man
+
+    ///Only positions reached in that many plies can repeat this one.
+    int ReversiblePlies() const
+    {
+        return mReversiblePlies;
     }
 
     ///returns the content of a cell in the board.
@@ -109,7 +183,14 @@ public:
     {
         return At(pPos);
     }
-    
+
+    ///puts \p pPiece on cell \p pPos, to set up a position
+    void Set(int pPos,uint8_t pPiece)
+    {
+        assert(pPos<cSquares);
+        Put(pPos,pPiece);
+    }
+
     ///returns the content of a cell in the board.
 
     ///Rows are numbered (0 to 7) from the lower row in the board, 
@@ -130,6 +211,34 @@ public:
         return mCell[pR*4+(pC>>1)];
     }
 
+    ///returns a mask with bit i set if cell i contains exactly \p pPiece
+
+    ///For example Pieces(CELL_OWN) are our men and Pieces(CELL_OWN|CELL_KING)
+    ///our kings.
+    uint32_t Pieces(uint8_t pPiece) const
+    {
+#ifdef __AVX2__
+        __m256i lCells=_mm256_loadu_si256((const __m256i*)mCell);
+        return _mm256_movemask_epi8(_mm256_cmpeq_epi8(lCells,_mm256_set1_epi8(pPiece)));
+#else
+        //eight cells at a time: the high bit of each byte is set where the
+        //cell differs from pPiece, then the inverted high bits are gathered
+        //into one byte by the multiplication (cells are little endian)
+        const uint64_t cLow=0x7F7F7F7F7F7F7F7FULL;
+        uint64_t lPiece=0x0101010101010101ULL*pPiece;
+        uint32_t lMask=0;
+        for(int i=0;i<cSquares;i+=8)
+        {
+            uint64_t lCells;
+            memcpy(&lCells,mCell+i,sizeof(lCells));
+            uint64_t lDiff=lCells^lPiece;
+            uint64_t lEqual=~(((lDiff&cLow)+cLow)|lDiff)&~cLow;
+            lMask|=uint32_t(((lEqual>>7)*0x0102040810204080ULL)>>56)<<i;
+        }
+        return lMask;
+#endif
+    }
+
 private:    
     ///private version of above function (allows modifying cells)
     uint8_t &PrivAt(int pR,int pC) const
@@ -174,62 +283,69 @@ public:
 private:
     ///tries to make a jump from a certain position of the board
     
+    ///Both the player making the move and the kind of piece are template
+    ///parameters, so that the directions a piece can capture in are known
+    ///at compile time.
+    ///
+    /// \tparam tPlayer the \ref ECell code (CELL_OWN or CELL_OTHER) of the
+    /// player making the move
+    /// \tparam tKing true if the moving piece is a king
     /// \param pMoves a vector where the valid moves will be inserted
-    /// \param pOther the \ref ECell code corresponding to the player
-    /// who is not making the move
     /// \param pR the row of the cell we are moving from
     /// \param pC the col
-    /// \param pKing true if the moving piece is a king
     /// \param pBuffer a buffer where the list of jump positions is 
     /// inserted (for multiple jumps)
     /// \param pDepth the number of multiple jumps before this attempt
-    bool TryJump(std::vector<CMove> &pMoves,int pOther,int pR,int pC,
-                 bool pKing,uint8_t *pBuffer,int pDepth=0) const
+    template<int tPlayer,bool tKing>
+    bool TryJump(std::vector<CMove> &pMoves,int pR,int pC,
+                 uint8_t *pBuffer,int pDepth=0) const
     {
+        const int lOther=tPlayer^(CELL_OWN|CELL_OTHER);
+
         pBuffer[pDepth]=RowColToCell(pR,pC);
         bool lFound=false;
 
         //try capturing forward
-        if(pOther==CELL_OTHER||pKing)
+        if(tPlayer==CELL_OWN||tKing)
         {
             //try capturing right
-            if((At(pR+1,pC-1)&pOther)&&At(pR+2,pC-2)==CELL_EMPTY)
+            if((At(pR+1,pC-1)&lOther)&&At(pR+2,pC-2)==CELL_EMPTY)
             {
                 lFound=true;
                 uint8_t lOldValue=At(pR+1,pC-1);
                 PrivAt(pR+1,pC-1)=CELL_EMPTY;
-                TryJump(pMoves,pOther,pR+2,pC-2,pKing,pBuffer,pDepth+1);
+                TryJump<tPlayer,tKing>(pMoves,pR+2,pC-2,pBuffer,pDepth+1);
                 PrivAt(pR+1,pC-1)=lOldValue;
             }
             //try capturing left
-            if((At(pR+1,pC+1)&pOther)&&At(pR+2,pC+2)==CELL_EMPTY)
+            if((At(pR+1,pC+1)&lOther)&&At(pR+2,pC+2)==CELL_EMPTY)
             {
                 lFound=true;
                 uint8_t lOldValue=At(pR+1,pC+1);
                 PrivAt(pR+1,pC+1)=CELL_EMPTY;
-                TryJump(pMoves,pOther,pR+2,pC+2,pKing,pBuffer,pDepth+1);
+                TryJump<tPlayer,tKing>(pMoves,pR+2,pC+2,pBuffer,pDepth+1);
                 PrivAt(pR+1,pC+1)=lOldValue;
             }
         }
         //try capturing backwards
-        if(pOther==CELL_OWN||pKing)
+        if(tPlayer==CELL_OTHER||tKing)
         {
             //try capturing right
-            if((At(pR-1,pC-1)&pOther)&&At(pR-2,pC-2)==CELL_EMPTY)
+            if((At(pR-1,pC-1)&lOther)&&At(pR-2,pC-2)==CELL_EMPTY)
             {
                 lFound=true;
                 uint8_t lOldValue=At(pR-1,pC-1);
                 PrivAt(pR-1,pC-1)=CELL_EMPTY;
-                TryJump(pMoves,pOther,pR-2,pC-2,pKing,pBuffer,pDepth+1);
+                TryJump<tPlayer,tKing>(pMoves,pR-2,pC-2,pBuffer,pDepth+1);
                 PrivAt(pR-1,pC-1)=lOldValue;
             }
             //try capturing left
-            if((At(pR-1,pC+1)&pOther)&&At(pR-2,pC+2)==CELL_EMPTY)
+            if((At(pR-1,pC+1)&lOther)&&At(pR-2,pC+2)==CELL_EMPTY)
             {
                 lFound=true;
                 uint8_t lOldValue=At(pR-1,pC+1);
                 PrivAt(pR-1,pC+1)=CELL_EMPTY;
-                TryJump(pMoves,pOther,pR-2,pC+2,pKing,pBuffer,pDepth+1);
+                TryJump<tPlayer,tKing>(pMoves,pR-2,pC+2,pBuffer,pDepth+1);
                 PrivAt(pR-1,pC+1)=lOldValue;
             }
         }
@@ -244,17 +360,17 @@ private:
 
     ///tries to make a move from a certain position
     
+    /// \tparam tPlayer the \ref ECell code of the player making the move
+    /// \tparam tKing true if the piece is a king
     /// \param pMoves vector where the valid moves will be inserted
     /// \param pCell the cell where the move is tried from
-    /// \param pOther the \ref ECell code corresponding to the player
-    /// who is not making the move
-    /// \param pKing true if the piece is a king
-    void TryMove(std::vector<CMove> &pMoves,int pCell,int pOther,bool pKing) const
+    template<int tPlayer,bool tKing>
+    void TryMove(std::vector<CMove> &pMoves,int pCell) const
     {
         int lR=CellToRow(pCell);
         int lC=CellToCol(pCell);
         //try moving forward
-        if(pOther==CELL_OTHER||pKing)
+        if(tPlayer==CELL_OWN||tKing)
         {
             //try moving right
             if(At(lR+1,lC-1)==CELL_EMPTY)
@@ -264,7 +380,7 @@ private:
                 pMoves.push_back(CMove(pCell,RowColToCell(lR+1,lC+1)));
         }
         //try moving backwards
-        if(pOther==CELL_OWN||pKing)
+        if(tPlayer==CELL_OTHER||tKing)
         {
             //try moving right
             if(At(lR-1,lC-1)==CELL_EMPTY)
@@ -275,18 +391,12 @@ private:
         }
     }
 
-public:
-    /// returns a list of all valid moves for \p pWho
-    
-    /// \param pMoves a vector where the list of moves will be appended
-    /// \param pWho the \ref ECell code (CELL_OWN or CELL_OTHER) of the
-    /// player making the move
-    void FindPossibleMoves(std::vector<CMove> &pMoves) const
+    ///move generator for player \p tPlayer (see FindPossibleMoves())
+    template<int tPlayer>
+    void FindMoves(std::vector<CMove> &pMoves) const
     {
         pMoves.clear();
 
-        int lOther=mPlayer^(CELL_OWN|CELL_OTHER);
-    
         bool lFound=false;
         int lPieces[cPlayerPieces];
         uint8_t lMoveBuffer[cPlayerPieces];
@@ -294,12 +404,13 @@ public:
         for(int i=0;i<cSquares;i++)
         {
             //if it belongs to the player making the move
-            if(At(i)&mPlayer)
+            if(At(i)&tPlayer)
             {
-                bool lIsKing=At(i)&CELL_KING;
+                bool lJumps=(At(i)&CELL_KING)?
+                    TryJump<tPlayer,true>(pMoves,CellToRow(i),CellToCol(i),lMoveBuffer):
+                    TryJump<tPlayer,false>(pMoves,CellToRow(i),CellToCol(i),lMoveBuffer);
 
-                if(TryJump(pMoves,lOther,CellToRow(i),CellToCol(i),lIsKing,
-                                     lMoveBuffer))
+                if(lJumps)
                 {
                     lFound=true;
                 }
@@ -315,12 +426,58 @@ public:
             for(int k=0;k<lNumPieces;k++)
             {
                 int lCell=lPieces[k];
-                bool lIsKing=At(lCell)&CELL_KING;
-                TryMove(pMoves,lCell,lOther,lIsKing);
+                if(At(lCell)&CELL_KING)
+                    TryMove<tPlayer,true>(pMoves,lCell);
+                else
+                    TryMove<tPlayer,false>(pMoves,lCell);
             }
         }        
     }
+
+public:
+    /// returns a list of all valid moves for the player to move
+    
+    /// \param pMoves a vector where the list of moves will be stored
+    void FindPossibleMoves(std::vector<CMove> &pMoves) const
+    {
+        if(mPlayer==CELL_OWN)
+            FindMoves<CELL_OWN>(pMoves);
+        else
+            FindMoves<CELL_OTHER>(pMoves);
+    }
     
+    ///returns true if \p pMove turns a man into a king
+
+    ///\p pMove must be a valid move in this position
+    bool IsPromotion(const CMove &pMove) const
+    {
+        uint8_t lPiece=At(pMove[0]);
+        if(lPiece&CELL_KING)
+            return false;
+
+        int lDR=CellToRow(pMove[pMove.Length()-1]);
+        return (lDR==7&&(lPiece&CELL_OWN))||(lDR==0&&(lPiece&CELL_OTHER));
+    }
+
+    ///returns true if \p pMove takes a man next to the crowning row, with
+    ///a free square in front of it
+
+    ///\p pMove must be a valid move in this position
+    bool IsRunaway(const CMove &pMove) const
+    {
+        uint8_t lPiece=At(pMove[0]);
+        if(lPiece&CELL_KING)
+            return false;
+
+        int lDst=pMove[pMove.Length()-1];
+        int lR=CellToRow(lDst);
+        int lC=CellToCol(lDst);
+        if(lPiece&CELL_OWN)
+            return lR==6&&(At(7,lC-1)==CELL_EMPTY||At(7,lC+1)==CELL_EMPTY);
+        else
+            return lR==1&&(At(0,lC-1)==CELL_EMPTY||At(0,lC+1)==CELL_EMPTY);
+    }
+
     ///transforms the board by performing a move
 
     ///it doesn't check that the move is valid, so you should only use
@@ -329,9 +486,23 @@ public:
     /// \param pMove the move to perform
     void DoMove(const CMove &pMove)
     {
+        if(mPlayer==CELL_OWN)
+            DoMove<CELL_OWN>(pMove);
+        else
+            DoMove<CELL_OTHER>(pMove);
+    }
+
+private:
+    ///version of DoMove() for player \p tPlayer, which knows its crowning row
+    template<int tPlayer>
+    void DoMove(const CMove &pMove)
+    {
+        const int lCrowningRow=(tPlayer==CELL_OWN)?7:0;
+
         if(pMove.IsJump())
         {
         	TogglePlayer();
+        	mReversiblePlies=0;
 
             int lSR=CellToRow(pMove[0]);
             int lSC=CellToCol(pMove[0]);
@@ -341,27 +512,27 @@ public:
                 int lDR=CellToRow(pMove[i]);
                 int lDC=CellToCol(pMove[i]);
                 
-                mCell[pMove[i]]=mCell[pMove[i-1]];
-                mCell[pMove[i-1]]=CELL_EMPTY;
+                uint8_t lPiece=mCell[pMove[i-1]];
+                Put(pMove[i-1],CELL_EMPTY);
 
-                if((lDR==7&&(mCell[pMove[i]]&CELL_OWN))||
-                   (lDR==0&&(mCell[pMove[i]]&CELL_OTHER)))
-                    mCell[pMove[i]]|=CELL_KING;
+                if(lDR==lCrowningRow)
+                    lPiece|=CELL_KING;
+                Put(pMove[i],lPiece);
         
                 ///now we have to remove the other one
                 if(lDR>lSR)
                 {
                     if(lDC>lSC)
-                        mCell[RowColToCell(lDR-1,lDC-1)]=CELL_EMPTY;
+                        Put(RowColToCell(lDR-1,lDC-1),CELL_EMPTY);
                     else
-                        mCell[RowColToCell(lDR-1,lDC+1)]=CELL_EMPTY;
+                        Put(RowColToCell(lDR-1,lDC+1),CELL_EMPTY);
                 }
                 else
                 {
                     if(lDC>lSC)
-                        mCell[RowColToCell(lDR+1,lDC-1)]=CELL_EMPTY;
+                        Put(RowColToCell(lDR+1,lDC-1),CELL_EMPTY);
                     else
-                        mCell[RowColToCell(lDR+1,lDC+1)]=CELL_EMPTY;
+                        Put(RowColToCell(lDR+1,lDC+1),CELL_EMPTY);
                 }
                 
                 lSR=lDR;
@@ -373,15 +544,97 @@ public:
         	TogglePlayer();
 
             int lDR=CellToRow(pMove[1]);
-            mCell[pMove[1]]=mCell[pMove[0]];
-            mCell[pMove[0]]=CELL_EMPTY;
+            uint8_t lPiece=mCell[pMove[0]];
+            Put(pMove[0],CELL_EMPTY);
 
-            if((lDR==7&&(mCell[pMove[1]]&CELL_OWN))||
-               (lDR==0&&(mCell[pMove[1]]&CELL_OTHER)))
-                mCell[pMove[1]]|=CELL_KING;
+            if(lPiece&CELL_KING)
+                mReversiblePlies++;
+            else
+                mReversiblePlies=0;
+
+            if(lDR==lCrowningRow)
+                lPiece|=CELL_KING;
+            Put(pMove[1],lPiece);
         }
     }
 
+private:
+    static const int cHashPlayerKey=cSquares*4;	///< index of the key for CELL_OTHER to move
+
+    ///returns the random keys the hash is made of: one per square and kind
+    ///of piece, and one more for the player to move
+    static const uint64_t *HashKeys()
+    {
+        //initialized once, safely with threads
+        static const CHashKeys sKeys;
+        return sKeys.mKeys;
+    }
+
+    struct CHashKeys
+    {
+        CHashKeys()
+        {
+            //fixed seed, so that hashes are reproducible. The key of a piece
+            //on the mirrored cell with the other colour is MirrorKey() of its
+            //key (see InvertedHash())
+            CRandom lRandom;
+            for(int i=0;i<=cHashPlayerKey;i++)
+            {
+                uint64_t lKey=lRandom.Next();
+                if(i<cHashPlayerKey/2)
+                {
+                    mKeys[i]=lKey;
+                    mKeys[(cSquares-1-i/4)*4+((i%4)^1)]=MirrorKey(lKey);
+                }
+                else if(i==cHashPlayerKey)
+                {
+                    mKeys[i]=lKey;
+                }
+            }
+        }
+
+        uint64_t mKeys[cHashPlayerKey+1];
+    };
+
+    ///swaps the halves of a key, which is its own inverse and distributes over xor
+    static uint64_t MirrorKey(uint64_t pKey)
+    {
+        return (pKey<<32)|(pKey>>32);
+    }
+
+    ///returns the key of piece \p pPiece on square \p pPos (0 for an empty square)
+    static uint64_t PieceKey(int pPos,uint8_t pPiece)
+    {
+        if(!(pPiece&(CELL_OWN|CELL_OTHER)))
+            return 0;
+        int lKind=((pPiece&CELL_OTHER)?1:0)|((pPiece&CELL_KING)?2:0);
+        return HashKeys()[pPos*4+lKind];
+    }
+
+    ///returns the same piece belonging to the other player
+    static uint8_t InvertPiece(uint8_t pPiece)
+    {
+        if(pPiece&(CELL_OWN|CELL_OTHER))
+            pPiece^=CELL_OWN|CELL_OTHER;
+        return pPiece;
+    }
+
+    ///changes the contents of a cell, updating the hash
+    void Put(int pPos,uint8_t pPiece)
+    {
+        mHash^=PieceKey(pPos,mCell[pPos])^PieceKey(pPos,pPiece);
+        mCell[pPos]=pPiece;
+    }
+
+    void ComputeHash()
+    {
+        mHash=(mPlayer==CELL_OTHER)?HashKeys()[cHashPlayerKey]:0;
+        for(int i=0;i<cSquares;i++)
+            mHash^=PieceKey(i,mCell[i]);
+    }
+
+public:
+
     ///prints the board
     
     ///Useful for debug purposes. Don't call it in the final version.
@@ -463,15 +716,22 @@ public:
     	return pMoves.empty();
     }
 
-    eval_t Evaluate(const std::vector<CMove> &pMoves) const
+    ///returns the value of the position for CELL_OWN
+
+    ///Lost positions are worth -cWin, won ones cWin. The search takes
+    ///care of the distance to the end of the game.
+    ///
+    ///\param pRandom source of the noise added to break ties between equal
+    ///positions, NULL for none
+    eval_t Evaluate(const std::vector<CMove> &pMoves,CRandom *pRandom=NULL) const
     {
     	// TODO: Idea. In endgame put bonus on being aggressive by bonusing jump moves
     	if(pMoves.empty())
     	{
     		if(mPlayer == CELL_OWN){
-    			return 0.0;
+    			return -cWin;
     		} else {
-    			return 1.0;
+    			return cWin;
     		}
     	}
     	else
@@ -488,7 +748,7 @@ public:
     					{
     						own += KING_SIDE;
     					}
-    					if (c % 8 == 4 || c % 8 == 3) // piece is in left or right row
+    					if (i % 8 == 4 || i % 8 == 3) // piece is in left or right row
     					{
     						own += KING_SIDE;
     					}
@@ -503,7 +763,7 @@ public:
     					{
     						other += KING_SIDE;
     					}
-    					if (c % 8 == 4 || c % 8 == 3) // piece is in left or right row
+    					if (i % 8 == 4 || i % 8 == 3) // piece is in left or right row
     					{
     						other += KING_SIDE;
     					}
@@ -513,26 +773,38 @@ public:
     				}
     			}
     		}
+    		return MaterialScore(own, other, pRandom ? pRandom->Next() : 0);
+    	}
+    }
+
+    ///turns the material values of both sides into the score returned by
+    ///Evaluate(), with noise taken from \p pNoise
+    static eval_t MaterialScore(int own, int other, uint64_t pNoise)
+    {
 #ifdef LINEAR_EVAL
-    		return own - other + rand()%20 - 10;
+    	return own - other + int(pNoise%20) - 10;
 #else
-    		return float(own + (rand()%50)) / (own + other);
+    	// share of the material owned, scaled to [-cEvalScale,cEvalScale]
+    	return cEvalScale * (own - other + int(pNoise%50)) / (own + other);
 #endif
-    	}
     }
     
 private:
-    static const int PAWN_SCORE = 1000;
-    static const int KING_SCORE = 2000;
-    static const int KING_SIDE = -100;
-    static const int PAWN_POS = 5;
+    // see evalweights.h
+    static const int PAWN_SCORE = EVAL_PAWN_SCORE;
+    static const int KING_SCORE = EVAL_KING_SCORE;
+    static const int KING_SIDE = EVAL_KING_SIDE;
+    static const int PAWN_POS = EVAL_PAWN_POS;
+    static const int cEvalScale = 5000;
 
 private:   
     //this is a bit ugly, but is useful for the implementation of 
-    //FindPossibleMoves. It won't affect in single-threaded programs
-    //and you're not allowed to use threads anyway
+    //FindPossibleMoves. It means that a board can't be used by several
+    //threads at once, even if it is const
     mutable uint8_t mCell[cSquares];
     mutable ECell mPlayer;
+    uint64_t mHash;
+    int mReversiblePlies;
 };
 
 /*namespace chk*/ }
@@ -1,6 +1,7 @@
 #include "cclient.h"
 
 #include <sstream>
+#include <fstream>
 
 namespace chk {
 
@@ -48,6 +49,18 @@ bool CClient::ReadMove(CTime &pTime,CMove &pMove,bool pBlock)
     return true;
 }
 
+void CClient::WriteRecord(int pResult)
+{
+    const std::string &lFile=mPlayer.Config().mGameRecordFile;
+    if(lFile.empty())
+        return;
+
+    std::ofstream lOut(lFile.c_str(),std::ios::app);
+    mRecord.Write(lOut,pResult);
+    if(!lOut)
+        std::cerr << "can't write the game to " << lFile << std::endl;
+}
+
 void CClient::Run(const std::string &pHost,const std::string &pPort,
                   const std::string &pKey)
 {
@@ -74,6 +87,7 @@ void CClient::Run(const std::string &pHost,const std::string &pPort,
     mBoard.SetPlayer(lFirst ? CELL_OWN : CELL_OTHER);
 
     mPlayer.Initialize(lFirst,lTime);
+    mRecord.Begin(lFirst);
 
     mSocket.WriteLine("INIT");
     
@@ -113,6 +127,9 @@ void CClient::Run(const std::string &pHost,const std::string &pPort,
                     break;
                 }
             }
+            int lResult=lMove.Length()?lMove[0]:0;
+            WriteRecord(lResult);
+            mPlayer.GameOver(lResult);
             return;
         }
 
@@ -121,6 +138,8 @@ void CClient::Run(const std::string &pHost,const std::string &pPort,
 #endif
 
         mBoard.DoMove(lMove);
+        if(lMove.IsNormal()||lMove.IsJump())
+            mRecord.Add(lMove);
 
         lMove=mPlayer.Play(mBoard,lTime);
         
@@ -131,9 +150,15 @@ void CClient::Run(const std::string &pHost,const std::string &pPort,
 #endif
 
         if(lMove.IsEOG())
+        {
+            //we have no moves left
+            WriteRecord(2);
+            mPlayer.GameOver(2);
             return;
+        }
         
         mBoard.DoMove(lMove);
+        mRecord.Add(lMove);
     }
 }
 
@@ -3,6 +3,7 @@
 
 #include "cplayer.h"
 #include "csocket.h"
+#include "cpdn.h"
 #include <vector>
 #include <stdint.h>
 #include <stdexcept>
@@ -24,6 +25,8 @@ private:
     void ReadInit(CTime &pTime,bool &pFirst);
     bool ReadMove(CTime &pTime,CMove &pMove,bool pBlock);
     void WriteMove(const CMove &pMove);
+    ///appends the game to the game record file, see CPDNWriter::Write()
+    void WriteRecord(int pResult);
 
 public:
     ///runs the client
@@ -39,6 +42,7 @@ private:
     CPlayer &mPlayer;
     CBoard mBoard;
     CSocket mSocket;
+    CPDNWriter mRecord;
     
     bool mStandalone;
 };
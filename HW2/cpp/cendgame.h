@@ -0,0 +1,621 @@
+#ifndef _CHECKERS_CENDGAME_H_
+#define _CHECKERS_CENDGAME_H_
+
+#include "constants.h"
+#include "cboard.h"
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace chk {
+
+///value of a position in the endgame database, for the player to move
+enum EEndgameValue
+{
+    ENDGAME_NOT_CACHED=-1,  ///< not looked up because it isn't in memory (see CEndgameCache)
+    ENDGAME_UNKNOWN=0,      ///< not in the database, or not solved yet
+    ENDGAME_WIN=1,
+    ENDGAME_LOSS=2,
+    ENDGAME_DRAW=3
+};
+
+///the pieces of a position, seen by the player to move
+struct CEndgameMaterial
+{
+    CEndgameMaterial(int pOwnMen=0,int pOwnKings=0,int pOtherMen=0,int pOtherKings=0)
+        :   mOwnMen(pOwnMen)
+        ,   mOwnKings(pOwnKings)
+        ,   mOtherMen(pOtherMen)
+        ,   mOtherKings(pOtherKings)
+    {
+    }
+
+    int Pieces() const      {   return mOwnMen+mOwnKings+mOtherMen+mOtherKings; }
+    int Men() const         {   return mOwnMen+mOtherMen;   }
+
+    ///the material with the players exchanged
+    CEndgameMaterial Mirror() const
+    {
+        return CEndgameMaterial(mOtherMen,mOtherKings,mOwnMen,mOwnKings);
+    }
+
+    ///a small number identifying the material, below cMaxKey
+    int Key() const
+    {
+        return ((mOwnMen*cCounts+mOwnKings)*cCounts+mOtherMen)*cCounts+mOtherKings;
+    }
+
+    static const int cCounts=CBoard::cPlayerPieces+1;
+    static const int cMaxKey=cCounts*cCounts*cCounts*cCounts;
+
+    int mOwnMen;
+    int mOwnKings;
+    int mOtherMen;
+    int mOtherKings;
+};
+
+///numbers the positions with some material and CELL_OWN to move
+
+///The index is made of four combinatorial numbers: the own men on cells
+///0-27, the other men on cells 4-31, and the kings of each player on the
+///cells left free by the pieces placed before them. Men of both players
+///may be placed on the same cell, those indices are not positions and are
+///skipped (see Position()).
+class CEndgameIndex
+{
+public:
+    explicit CEndgameIndex(const CEndgameMaterial &pMaterial=CEndgameMaterial())
+        :   mMaterial(pMaterial)
+    {
+        const int cMenCells=CBoard::cSquares-4;
+        int lFree=CBoard::cSquares-pMaterial.Men();
+        mSizes[0]=Binomial(cMenCells,pMaterial.mOwnMen);
+        mSizes[1]=Binomial(cMenCells,pMaterial.mOtherMen);
+        mSizes[2]=Binomial(lFree,pMaterial.mOwnKings);
+        mSizes[3]=Binomial(lFree-pMaterial.mOwnKings,pMaterial.mOtherKings);
+    }
+
+    ///number of indices
+    uint64_t Size() const
+    {
+        return mSizes[0]*mSizes[1]*mSizes[2]*mSizes[3];
+    }
+
+    ///returns the index of the position with these pieces (see CBoard::Pieces())
+    uint64_t Index(uint32_t pOwnMen,uint32_t pOwnKings,uint32_t pOtherMen,uint32_t pOtherKings) const
+    {
+        uint32_t lFree=~(pOwnMen|pOtherMen);
+        uint64_t lIndex=Rank(pOwnMen);
+        lIndex=lIndex*mSizes[1]+Rank(pOtherMen>>4);
+        lIndex=lIndex*mSizes[2]+Rank(Compress(pOwnKings,lFree));
+        lIndex=lIndex*mSizes[3]+Rank(Compress(pOtherKings,lFree&~pOwnKings));
+        return lIndex;
+    }
+
+    ///sets \p pBoard to the position with index \p pIndex, with CELL_OWN to move
+
+    ///\return false if the index is not a position
+    bool Position(uint64_t pIndex,CBoard &pBoard) const
+    {
+        uint32_t lRanks[4];
+        for(int i=3;i>=0;i--)
+        {
+            lRanks[i]=pIndex%mSizes[i];
+            pIndex/=mSizes[i];
+        }
+        uint32_t lOwnMen=Unrank(lRanks[0],mMaterial.mOwnMen);
+        uint32_t lOtherMen=Unrank(lRanks[1],mMaterial.mOtherMen)<<4;
+        if(lOwnMen&lOtherMen)
+            return false;
+        uint32_t lFree=~(lOwnMen|lOtherMen);
+        uint32_t lOwnKings=Expand(Unrank(lRanks[2],mMaterial.mOwnKings),lFree);
+        uint32_t lOtherKings=Expand(Unrank(lRanks[3],mMaterial.mOtherKings),lFree&~lOwnKings);
+
+        pBoard=CBoard(false,CELL_OWN);
+        for(int i=0;i<CBoard::cSquares;i++)
+        {
+            uint32_t lBit=uint32_t(1)<<i;
+            if(lOwnMen&lBit)
+                pBoard.Set(i,CELL_OWN);
+            else if(lOwnKings&lBit)
+                pBoard.Set(i,CELL_OWN|CELL_KING);
+            else if(lOtherMen&lBit)
+                pBoard.Set(i,CELL_OTHER);
+            else if(lOtherKings&lBit)
+                pBoard.Set(i,CELL_OTHER|CELL_KING);
+        }
+        return true;
+    }
+
+    const CEndgameMaterial &Material() const
+    {
+        return mMaterial;
+    }
+
+    ///number of ways to choose \p pK of \p pN things
+    static uint64_t Binomial(int pN,int pK)
+    {
+        static uint64_t sTable[CBoard::cSquares+1][CBoard::cSquares+1];
+        static bool sInitialized=false;
+        if(!sInitialized)
+        {
+            for(int n=0;n<=CBoard::cSquares;n++)
+            {
+                sTable[n][0]=1;
+                for(int k=1;k<=CBoard::cSquares;k++)
+                    sTable[n][k]=(n==0)?0:sTable[n-1][k-1]+sTable[n-1][k];
+            }
+            sInitialized=true;
+        }
+        if(pN<0||pK<0||pK>pN)
+            return pK==0?1:0;
+        return sTable[pN][pK];
+    }
+
+private:
+    //colexicographic rank of a set of cells: the i-th lowest cell c adds
+    //Binomial(c,i)
+    static uint32_t Rank(uint32_t pCells)
+    {
+        uint32_t lRank=0;
+        for(int i=1;pCells;i++)
+        {
+            int lCell=__builtin_ctz(pCells);
+            lRank+=Binomial(lCell,i);
+            pCells&=pCells-1;
+        }
+        return lRank;
+    }
+
+    static uint32_t Unrank(uint32_t pRank,int pCount)
+    {
+        uint32_t lCells=0;
+        int lCell=CBoard::cSquares;
+        for(int i=pCount;i>0;i--)
+        {
+            do
+                --lCell;
+            while(Binomial(lCell,i)>pRank);
+            pRank-=Binomial(lCell,i);
+            lCells|=uint32_t(1)<<lCell;
+        }
+        return lCells;
+    }
+
+    //numbers the cells of pCells by their position among the cells of pFree
+    static uint32_t Compress(uint32_t pCells,uint32_t pFree)
+    {
+        uint32_t lResult=0;
+        for(;pCells;pCells&=pCells-1)
+        {
+            uint32_t lBelow=pFree&((pCells&-pCells)-1);
+            lResult|=uint32_t(1)<<__builtin_popcount(lBelow);
+        }
+        return lResult;
+    }
+
+    //inverse of Compress()
+    static uint32_t Expand(uint32_t pCells,uint32_t pFree)
+    {
+        uint32_t lResult=0;
+        for(int i=0;pFree;i++,pFree&=pFree-1)
+        {
+            if(pCells&(uint32_t(1)<<i))
+                lResult|=pFree&-pFree;
+        }
+        return lResult;
+    }
+
+    CEndgameMaterial mMaterial;
+    uint64_t mSizes[4];
+};
+
+///win/loss/draw endgame database, built by egdbgen
+
+///The file is mapped into memory. It has a header, a table of the slices
+///(the positions with one material, CELL_OWN to move), and the values of
+///the slices, four per byte, in order of their index (see CEndgameIndex).
+///Positions with the other player to move are looked up inverted (see
+///CBoard::Invert()), as in CBoard::CanonicalHash().
+class CEndgameDB
+{
+public:
+    struct CHeader
+    {
+        char mMagic[4];             ///< "CHKE"
+        uint32_t mVersion;
+        uint32_t mMaxPieces;
+        uint32_t mSlices;
+    };
+
+    struct CSliceEntry
+    {
+        uint8_t mMaterial[4];       ///< own men, own kings, other men, other kings
+        uint32_t mChecksum;         ///< of the values (see Checksum()), set by Save()
+        uint64_t mOffset;           ///< of the values from the start of the file
+        uint64_t mPositions;
+    };
+
+    static const uint32_t cVersion=2;
+
+    CEndgameDB()
+        :   mData(NULL)
+        ,   mSize(0)
+        ,   mMapped(false)
+        ,   mMaxPieces(0)
+    {
+    }
+
+    ~CEndgameDB()
+    {
+        Close();
+    }
+
+    ///maps the database \p pFile into memory
+
+    ///\return false if it can't be opened or isn't a database
+    bool Open(const std::string &pFile)
+    {
+        Close();
+        int lFD=open(pFile.c_str(),O_RDONLY);
+        if(lFD<0)
+            return false;
+
+        struct stat lStat;
+        if(fstat(lFD,&lStat)!=0||(std::size_t)lStat.st_size<sizeof(CHeader))
+        {
+            close(lFD);
+            return false;
+        }
+        void *lData=mmap(NULL,lStat.st_size,PROT_READ,MAP_SHARED,lFD,0);
+        close(lFD);
+        if(lData==MAP_FAILED)
+            return false;
+        mData=(uint8_t*)lData;
+        mSize=lStat.st_size;
+        mMapped=true;
+
+        const CHeader &lHeader=*(const CHeader*)mData;
+        if(memcmp(lHeader.mMagic,"CHKE",4)!=0||lHeader.mVersion!=cVersion
+                ||Layout(lHeader.mMaxPieces,NULL)!=mSize)
+        {
+            Close();
+            return false;
+        }
+        Attach(lHeader.mMaxPieces);
+        return true;
+    }
+
+    ///reads only the header and the slice table of the database \p pFile
+
+    ///The values stay on disk: SliceValues() are NULL and Lookup() can't be
+    ///used. For CEndgameCache, which reads the values as needed.
+    bool OpenTable(const std::string &pFile)
+    {
+        Close();
+        int lFD=open(pFile.c_str(),O_RDONLY);
+        if(lFD<0)
+            return false;
+
+        struct stat lStat;
+        CHeader lHeader;
+        bool lOk=fstat(lFD,&lStat)==0&&pread(lFD,&lHeader,sizeof(CHeader),0)==(ssize_t)sizeof(CHeader)
+                &&memcmp(lHeader.mMagic,"CHKE",4)==0&&lHeader.mVersion==cVersion
+                &&Layout(lHeader.mMaxPieces,NULL)==(std::size_t)lStat.st_size;
+        if(lOk)
+        {
+            mSize=sizeof(CHeader)+lHeader.mSlices*sizeof(CSliceEntry);
+            mData=(uint8_t*)malloc(mSize);
+            mMapped=false;
+            lOk=mData&&pread(lFD,mData,mSize,0)==(ssize_t)mSize;
+        }
+        close(lFD);
+        if(!lOk)
+        {
+            Close();
+            return false;
+        }
+        Attach(lHeader.mMaxPieces);
+        return true;
+    }
+
+    ///creates an empty database in memory, with all values ENDGAME_UNKNOWN
+    void Create(int pMaxPieces)
+    {
+        Close();
+        std::vector<CSliceEntry> lSlices;
+        mSize=Layout(pMaxPieces,&lSlices);
+        mData=(uint8_t*)calloc(mSize,1);
+        mMapped=false;
+
+        CHeader &lHeader=*(CHeader*)mData;
+        memcpy(lHeader.mMagic,"CHKE",4);
+        lHeader.mVersion=cVersion;
+        lHeader.mMaxPieces=pMaxPieces;
+        lHeader.mSlices=lSlices.size();
+        memcpy(mData+sizeof(CHeader),&lSlices[0],lSlices.size()*sizeof(CSliceEntry));
+        Attach(pMaxPieces);
+    }
+
+    ///writes a database made with Create() to \p pFile, with the checksums of its slices
+    bool Save(const std::string &pFile)
+    {
+        for(int i=0;i<Slices();i++)
+            Entry(i).mChecksum=SliceChecksum(i);
+
+        std::string lTemp=pFile+".tmp";
+        FILE *lFile=fopen(lTemp.c_str(),"wb");
+        if(!lFile)
+            return false;
+        bool lOk=fwrite(mData,1,mSize,lFile)==mSize;
+        lOk=(fclose(lFile)==0)&&lOk;
+        if(lOk)
+            lOk=rename(lTemp.c_str(),pFile.c_str())==0;
+        if(!lOk)
+            remove(lTemp.c_str());
+        return lOk;
+    }
+
+    void Close()
+    {
+        if(mData)
+        {
+            if(mMapped)
+                munmap(mData,mSize);
+            else
+                free(mData);
+        }
+        mData=NULL;
+        mSize=0;
+        mMaxPieces=0;
+        mSlices.clear();
+        mSliceOfMaterial.clear();
+    }
+
+    ///returns the value of \p pBoard for the player to move
+
+    ///Positions where a player has no pieces left are decided without
+    ///looking at the database, positions with more pieces than the database
+    ///holds are ENDGAME_UNKNOWN.
+    EEndgameValue Lookup(const CBoard &pBoard) const
+    {
+        uint32_t lPieces[4];
+        Pieces(pBoard,lPieces);
+        int lSlice=Find(lPieces);
+        if(lSlice<0)
+            return EEndgameValue(-lSlice-1);
+        const CSlice &lS=mSlices[lSlice];
+        return Get(lS.mValues,lS.mIndex.Index(lPieces[0],lPieces[1],lPieces[2],lPieces[3]));
+    }
+
+    ///returns the slice \p pBoard belongs to and its index in the slice
+
+    ///\return false if the position is not in the database
+    bool Locate(const CBoard &pBoard,int &pSlice,uint64_t &pIndex) const
+    {
+        uint32_t lPieces[4];
+        Pieces(pBoard,lPieces);
+        pSlice=Find(lPieces);
+        if(pSlice<0)
+            return false;
+        pIndex=mSlices[pSlice].mIndex.Index(lPieces[0],lPieces[1],lPieces[2],lPieces[3]);
+        return true;
+    }
+
+    ///most pieces of the positions in the database
+    int MaxPieces() const
+    {
+        return mMaxPieces;
+    }
+
+    int Slices() const
+    {
+        return mSlices.size();
+    }
+
+    const CEndgameIndex &SliceIndex(int pSlice) const
+    {
+        return mSlices[pSlice].mIndex;
+    }
+
+    ///the values of slice \p pSlice, four per byte (see Get())
+    uint8_t *SliceValues(int pSlice) const
+    {
+        return mSlices[pSlice].mValues;
+    }
+
+    ///the entry of slice \p pSlice in the slice table of the file
+    const CSliceEntry &SliceEntry(int pSlice) const
+    {
+        return ((const CSliceEntry*)(mData+sizeof(CHeader)))[pSlice];
+    }
+
+    ///computes the checksum of the values of slice \p pSlice, to compare
+    ///with SliceEntry().mChecksum
+    uint32_t SliceChecksum(int pSlice) const
+    {
+        return Checksum(mSlices[pSlice].mValues,(SliceEntry(pSlice).mPositions+3)/4);
+    }
+
+    ///returns the slice holding \p pMaterial, or -1
+    int SliceOf(const CEndgameMaterial &pMaterial) const
+    {
+        if(pMaterial.Pieces()>mMaxPieces)
+            return -1;
+        return mSliceOfMaterial[pMaterial.Key()];
+    }
+
+    static EEndgameValue Get(const uint8_t *pValues,uint64_t pIndex)
+    {
+        return EEndgameValue((pValues[pIndex>>2]>>((pIndex&3)*2))&3);
+    }
+
+    ///sets a value which is still ENDGAME_UNKNOWN, safely with other threads
+
+    ///\return false if it was already set
+    static bool Set(uint8_t *pValues,uint64_t pIndex,EEndgameValue pValue)
+    {
+        uint8_t lBits=uint8_t(pValue<<((pIndex&3)*2));
+        uint8_t lOld=__sync_fetch_and_or(&pValues[pIndex>>2],lBits);
+        return ((lOld>>((pIndex&3)*2))&3)==ENDGAME_UNKNOWN;
+    }
+
+    ///the materials of the database, with both players having at least one
+    ///piece, in the order of the file
+    static void Materials(int pMaxPieces,std::vector<CEndgameMaterial> &pMaterials)
+    {
+        pMaterials.clear();
+        for(int p=2;p<=pMaxPieces;p++)
+            for(int lOwnMen=0;lOwnMen<=p;lOwnMen++)
+                for(int lOwnKings=0;lOwnMen+lOwnKings<=p;lOwnKings++)
+                    for(int lOtherMen=0;lOwnMen+lOwnKings+lOtherMen<=p;lOtherMen++)
+                    {
+                        CEndgameMaterial lMaterial(lOwnMen,lOwnKings,lOtherMen,p-lOwnMen-lOwnKings-lOtherMen);
+                        if(lOwnMen+lOwnKings==0||lMaterial.mOtherMen+lMaterial.mOtherKings==0
+                                ||lOwnMen+lOwnKings>CBoard::cPlayerPieces
+                                ||lMaterial.mOtherMen+lMaterial.mOtherKings>CBoard::cPlayerPieces)
+                            continue;
+                        pMaterials.push_back(lMaterial);
+                    }
+    }
+
+    ///sets \p pPieces to the own men, own kings, other men and other kings
+    ///of \p pBoard as seen by the player to move, as in CEndgameIndex::Index()
+    static void Pieces(const CBoard &pBoard,uint32_t pPieces[4])
+    {
+        if(pBoard.Player()==CELL_OWN)
+        {
+            pPieces[0]=pBoard.Pieces(CELL_OWN);
+            pPieces[1]=pBoard.Pieces(CELL_OWN|CELL_KING);
+            pPieces[2]=pBoard.Pieces(CELL_OTHER);
+            pPieces[3]=pBoard.Pieces(CELL_OTHER|CELL_KING);
+        }
+        else
+        {
+            pPieces[0]=Reverse(pBoard.Pieces(CELL_OTHER));
+            pPieces[1]=Reverse(pBoard.Pieces(CELL_OTHER|CELL_KING));
+            pPieces[2]=Reverse(pBoard.Pieces(CELL_OWN));
+            pPieces[3]=Reverse(pBoard.Pieces(CELL_OWN|CELL_KING));
+        }
+    }
+
+    ///returns the slice of the position with the pieces \p pPieces (see Pieces())
+
+    ///\return the slice, or -1-value if the value is known without a slice
+    int Find(const uint32_t pPieces[4]) const
+    {
+        CEndgameMaterial lMaterial(__builtin_popcount(pPieces[0]),__builtin_popcount(pPieces[1]),
+                                   __builtin_popcount(pPieces[2]),__builtin_popcount(pPieces[3]));
+        if(lMaterial.mOwnMen+lMaterial.mOwnKings==0)
+            return -1-ENDGAME_LOSS;
+        if(lMaterial.mOtherMen+lMaterial.mOtherKings==0)
+            return -1-ENDGAME_WIN;
+        int lSlice=SliceOf(lMaterial);
+        return lSlice<0?-1-ENDGAME_UNKNOWN:lSlice;
+    }
+
+    ///mirrors the cells of a set of pieces, as seen by the other player
+    static uint32_t Reverse(uint32_t pBits)
+    {
+        pBits=((pBits>>1)&0x55555555u)|((pBits&0x55555555u)<<1);
+        pBits=((pBits>>2)&0x33333333u)|((pBits&0x33333333u)<<2);
+        pBits=((pBits>>4)&0x0F0F0F0Fu)|((pBits&0x0F0F0F0Fu)<<4);
+        pBits=((pBits>>8)&0x00FF00FFu)|((pBits&0x00FF00FFu)<<8);
+        return (pBits>>16)|(pBits<<16);
+    }
+
+    ///CRC-32 of \p pSize bytes, continuing from \p pCrc
+    static uint32_t Checksum(const uint8_t *pData,std::size_t pSize,uint32_t pCrc=0)
+    {
+        static uint32_t sTable[256];
+        static bool sInitialized=false;
+        if(!sInitialized)
+        {
+            for(uint32_t i=0;i<256;i++)
+            {
+                uint32_t lCrc=i;
+                for(int b=0;b<8;b++)
+                    lCrc=(lCrc>>1)^((lCrc&1)?0xEDB88320u:0);
+                sTable[i]=lCrc;
+            }
+            sInitialized=true;
+        }
+        pCrc=~pCrc;
+        for(std::size_t i=0;i<pSize;i++)
+            pCrc=sTable[(pCrc^pData[i])&0xFF]^(pCrc>>8);
+        return ~pCrc;
+    }
+
+private:
+    struct CSlice
+    {
+        CEndgameIndex mIndex;
+        uint8_t *mValues;
+    };
+
+    ///returns the size of a database of up to \p pMaxPieces pieces, and
+    ///fills \p pSlices with its slice table if given
+    static std::size_t Layout(int pMaxPieces,std::vector<CSliceEntry> *pSlices)
+    {
+        std::vector<CEndgameMaterial> lMaterials;
+        Materials(pMaxPieces,lMaterials);
+        std::size_t lPos=sizeof(CHeader)+lMaterials.size()*sizeof(CSliceEntry);
+        for(std::size_t i=0;i<lMaterials.size();i++)
+        {
+            lPos=(lPos+7)&~std::size_t(7);
+            CSliceEntry lEntry;
+            memset(&lEntry,0,sizeof(lEntry));
+            lEntry.mMaterial[0]=lMaterials[i].mOwnMen;
+            lEntry.mMaterial[1]=lMaterials[i].mOwnKings;
+            lEntry.mMaterial[2]=lMaterials[i].mOtherMen;
+            lEntry.mMaterial[3]=lMaterials[i].mOtherKings;
+            lEntry.mOffset=lPos;
+            lEntry.mPositions=CEndgameIndex(lMaterials[i]).Size();
+            if(pSlices)
+                pSlices->push_back(lEntry);
+            lPos+=(lEntry.mPositions+3)/4;
+        }
+        return lPos;
+    }
+
+    CSliceEntry &Entry(int pSlice)
+    {
+        return ((CSliceEntry*)(mData+sizeof(CHeader)))[pSlice];
+    }
+
+    void Attach(int pMaxPieces)
+    {
+        mMaxPieces=pMaxPieces;
+        const CHeader &lHeader=*(const CHeader*)mData;
+        const CSliceEntry *lEntries=(const CSliceEntry*)(mData+sizeof(CHeader));
+        mSliceOfMaterial.assign(CEndgameMaterial::cMaxKey,-1);
+        mSlices.resize(lHeader.mSlices);
+        for(uint32_t i=0;i<lHeader.mSlices;i++)
+        {
+            CEndgameMaterial lMaterial(lEntries[i].mMaterial[0],lEntries[i].mMaterial[1],
+                                       lEntries[i].mMaterial[2],lEntries[i].mMaterial[3]);
+            mSlices[i].mIndex=CEndgameIndex(lMaterial);
+            //only the table is in memory after OpenTable()
+            mSlices[i].mValues=lEntries[i].mOffset<mSize?mData+lEntries[i].mOffset:NULL;
+            mSliceOfMaterial[lMaterial.Key()]=i;
+        }
+    }
+
+    uint8_t *mData;
+    std::size_t mSize;
+    bool mMapped;
+    int mMaxPieces;
+    std::vector<CSlice> mSlices;
+    std::vector<int> mSliceOfMaterial;
+};
+
+/*namespace chk*/ }
+
+#endif
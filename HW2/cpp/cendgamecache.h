@@ -0,0 +1,466 @@
+#ifndef _CHECKERS_CENDGAMECACHE_H_
+#define _CHECKERS_CENDGAMECACHE_H_
+
+#include "constants.h"
+#include "cboard.h"
+#include "cendgame.h"
+#include "clargememory.h"
+#include "catomic.h"
+#include <stdint.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace chk {
+
+///endgame database read from disk as needed, into a limited amount of memory
+
+///Only the slice table is read by Open() (see CEndgameDB::OpenTable()). The
+///smallest slices, which come first in the file, are then loaded whole
+///while they fit in a quarter of the memory, or all of them if the whole
+///database fits. The values of the other slices are read in blocks of
+///cBlockSize bytes into a cache using the rest of the memory, replacing the
+///least recently used block.
+///
+///Loading these slices and filling the cache can be left to Load(), called
+///from another thread while lookups go on. Until a slice is loaded its
+///values are read one at a time.
+///
+///A conditional lookup never reads the disk nor waits for another thread
+///doing so, and returns ENDGAME_NOT_CACHED instead, so that the search can
+///probe deep in the tree without stalling. Lookups are safe from several
+///threads.
+class CEndgameCache
+{
+public:
+    static const int cBlockSize=4096;
+    ///the cache has at least this many blocks, whatever the memory given
+    static const int cMinBlocks=64;
+
+    ///counts of lookups since the last ResetStats()
+    struct CStats
+    {
+        uint64_t mRequests;         ///< lookups
+        uint64_t mReturns;          ///< lookups returning a win, loss or draw
+        uint64_t mNotPresent;       ///< lookups of positions not in the database
+        uint64_t mAutoloadHits;     ///< values found in slices loaded whole
+        uint64_t mCacheHits;        ///< values found in cached blocks
+        uint64_t mCacheLoads;       ///< blocks read from disk
+        uint64_t mNotCached;        ///< conditional lookups of blocks not in memory
+    };
+
+    CEndgameCache()
+        :   mFD(-1)
+        ,   mMaxPieces(0)
+        ,   mAutoloadBytes(0)
+        ,   mLoadedSlices(0)
+        ,   mBlocks(NULL)
+        ,   mSlots(0)
+    {
+        pthread_mutex_init(&mMutex,NULL);
+        ResetStats();
+    }
+
+    ~CEndgameCache()
+    {
+        Close();
+        pthread_mutex_destroy(&mMutex);
+    }
+
+    ///opens the database \p pFile, to use about \p pCacheMB megabytes
+
+    ///\param pMaxPieces most pieces of the positions looked up, 0 for all
+    ///those in the database
+    ///\param pLoad load the smallest slices before returning, otherwise
+    ///Load() must be called
+    ///\param pHuge false to keep the block cache on normal pages, see
+    ///CLargeMemory::Allocate()
+    ///\return false if it can't be opened, or has fewer than \p pMaxPieces pieces
+    bool Open(const std::string &pFile,int pCacheMB,int pMaxPieces=0,bool pLoad=true,bool pHuge=true)
+    {
+        Close();
+        if(!mTable.OpenTable(pFile))
+            return false;
+        mMaxPieces=pMaxPieces>0?pMaxPieces:mTable.MaxPieces();
+        mFD=open(pFile.c_str(),O_RDONLY);
+        if(mFD<0||mMaxPieces>mTable.MaxPieces())
+        {
+            Close();
+            return false;
+        }
+
+        uint64_t lMemory=uint64_t(pCacheMB)<<20;
+        uint64_t lValues=0;
+        for(int i=0;i<mTable.Slices();i++)
+        {
+            if(mTable.SliceIndex(i).Material().Pieces()<=mMaxPieces)
+                lValues+=SliceBytes(i);
+        }
+        uint64_t lAutoload=lValues<=lMemory?lValues:lMemory/4;
+
+        mAutoload.assign(mTable.Slices(),(uint8_t*)NULL);
+        for(int i=0;i<mTable.Slices();i++)
+        {
+            uint64_t lBytes=SliceBytes(i);
+            if(mTable.SliceIndex(i).Material().Pieces()>mMaxPieces||mAutoloadBytes+lBytes>lAutoload)
+                continue;
+            uint8_t *lValues=(uint8_t*)malloc(lBytes);
+            if(!lValues)
+            {
+                Close();
+                return false;
+            }
+            mAutoload[i]=lValues;
+            mAutoloadBytes+=lBytes;
+        }
+
+        if(mAutoloadBytes<lValues)
+        {
+            mSlots=std::max<int64_t>(cMinBlocks,(lMemory-std::min(lMemory,mAutoloadBytes))/cBlockSize);
+            mBlockMemory.Allocate(uint64_t(mSlots)*cBlockSize,pHuge);
+            mBlocks=(uint8_t*)mBlockMemory.Data();
+            if(!mBlocks)
+            {
+                Close();
+                return false;
+            }
+            mSlotOfBlock.assign(FileBlocks(),-1);
+            mBlockOfSlot.assign(mSlots,-1);
+            mPrevious.resize(mSlots);
+            mNext.resize(mSlots);
+            for(int i=0;i<mSlots;i++)
+            {
+                mPrevious[i]=i-1;
+                mNext[i]=i+1<mSlots?i+1:-1;
+            }
+            mHead=0;
+            mTail=mSlots-1;
+        }
+        ResetStats();
+        if(pLoad&&!Load())
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    ///reads the slices loaded whole, then fills the empty blocks of the
+    ///cache with the first blocks of the other slices
+
+    ///Lookups may be made meanwhile, but Open() and Close() may not.
+    ///\return false if a slice couldn't be read
+    bool Load()
+    {
+        for(int i=mLoadedSlices;i<mTable.Slices();i++)
+        {
+            if(mAutoload[i]&&!Read(mAutoload[i],SliceBytes(i),mTable.SliceEntry(i).mOffset))
+                return false;
+            Publish(mLoadedSlices,i+1);
+        }
+
+        for(int i=0;i<mTable.Slices();i++)
+        {
+            if(mAutoload[i]||mTable.SliceIndex(i).Material().Pieces()>mMaxPieces)
+                continue;
+            int64_t lBlock=mTable.SliceEntry(i).mOffset/cBlockSize;
+            int64_t lEnd=(mTable.SliceEntry(i).mOffset+SliceBytes(i)+cBlockSize-1)/cBlockSize;
+            for(;lBlock<lEnd;lBlock++)
+            {
+                pthread_mutex_lock(&mMutex);
+                bool lFull=mBlockOfSlot[mTail]>=0;
+                if(!lFull&&mSlotOfBlock[lBlock]<0&&LoadBlock(lBlock)>=0)
+                    ++mStats.mCacheLoads;
+                pthread_mutex_unlock(&mMutex);
+                if(lFull)
+                    return true;
+            }
+        }
+        return true;
+    }
+
+    ///true once Load() has read all the slices loaded whole
+    bool Loaded() const
+    {
+        return Published(mLoadedSlices)==(int)mAutoload.size();
+    }
+
+    void Close()
+    {
+        if(mFD>=0)
+            close(mFD);
+        mFD=-1;
+        for(std::size_t i=0;i<mAutoload.size();i++)
+            free(mAutoload[i]);
+        mAutoload.clear();
+        mAutoloadBytes=0;
+        mLoadedSlices=0;
+        mBlockMemory.Free();
+        mBlocks=NULL;
+        mSlots=0;
+        mSlotOfBlock.clear();
+        mBlockOfSlot.clear();
+        mPrevious.clear();
+        mNext.clear();
+        mTable.Close();
+        mMaxPieces=0;
+    }
+
+    bool IsOpen() const
+    {
+        return mFD>=0;
+    }
+
+    ///most pieces of the positions looked up
+    int MaxPieces() const
+    {
+        return mMaxPieces;
+    }
+
+    ///size of the pages of the cache (see CLargeMemory::PageSize())
+    std::size_t PageSize() const
+    {
+        return mBlockMemory.PageSize();
+    }
+
+    ///memory used for values, in bytes
+    uint64_t Bytes() const
+    {
+        return mAutoloadBytes+uint64_t(mSlots)*cBlockSize;
+    }
+
+    uint64_t AutoloadBytes() const
+    {
+        return mAutoloadBytes;
+    }
+
+    ///returns the value of \p pBoard for the player to move, see Lookup(const uint32_t*,bool)
+    EEndgameValue Lookup(const CBoard &pBoard,bool pConditional)
+    {
+        uint32_t lPieces[4];
+        CEndgameDB::Pieces(pBoard,lPieces);
+        return Lookup(lPieces,pConditional);
+    }
+
+    ///returns the value of the position with the pieces \p pPieces (see CEndgameDB::Pieces())
+
+    ///\param pConditional return ENDGAME_NOT_CACHED rather than read the disk
+    EEndgameValue Lookup(const uint32_t pPieces[4],bool pConditional)
+    {
+        __sync_fetch_and_add(&mStats.mRequests,1);
+        int lSlice=mTable.Find(pPieces);
+        if(lSlice>=0&&mTable.SliceIndex(lSlice).Material().Pieces()>mMaxPieces)
+            lSlice=-1-ENDGAME_UNKNOWN;
+        if(lSlice<0)
+        {
+            EEndgameValue lValue=EEndgameValue(-lSlice-1);
+            __sync_fetch_and_add(lValue==ENDGAME_UNKNOWN?&mStats.mNotPresent:&mStats.mReturns,1);
+            return lValue;
+        }
+
+        uint64_t lIndex=mTable.SliceIndex(lSlice).Index(pPieces[0],pPieces[1],pPieces[2],pPieces[3]);
+        uint64_t lByte=mTable.SliceEntry(lSlice).mOffset+(lIndex>>2);
+        if(mAutoload[lSlice])
+        {
+            uint8_t lValues;
+            if(lSlice<Published(mLoadedSlices))
+            {
+                __sync_fetch_and_add(&mStats.mAutoloadHits,1);
+                lValues=mAutoload[lSlice][lIndex>>2];
+            }
+            else if(pConditional)
+            {
+                __sync_fetch_and_add(&mStats.mNotCached,1);
+                return ENDGAME_NOT_CACHED;
+            }
+            else if(!Read(&lValues,1,lByte))
+            {
+                __sync_fetch_and_add(&mStats.mNotPresent,1);
+                return ENDGAME_UNKNOWN;
+            }
+            __sync_fetch_and_add(&mStats.mReturns,1);
+            return EEndgameValue((lValues>>((lIndex&3)*2))&3);
+        }
+
+        int64_t lBlock=lByte/cBlockSize;
+        if(pConditional)
+        {
+            if(pthread_mutex_trylock(&mMutex)!=0)
+            {
+                __sync_fetch_and_add(&mStats.mNotCached,1);
+                return ENDGAME_NOT_CACHED;
+            }
+        }
+        else
+        {
+            pthread_mutex_lock(&mMutex);
+        }
+
+        int lSlot=mSlotOfBlock[lBlock];
+        if(lSlot>=0)
+        {
+            ++mStats.mCacheHits;
+        }
+        else if(pConditional)
+        {
+            pthread_mutex_unlock(&mMutex);
+            __sync_fetch_and_add(&mStats.mNotCached,1);
+            return ENDGAME_NOT_CACHED;
+        }
+        else
+        {
+            lSlot=LoadBlock(lBlock);
+            if(lSlot<0)
+            {
+                pthread_mutex_unlock(&mMutex);
+                __sync_fetch_and_add(&mStats.mNotPresent,1);
+                return ENDGAME_UNKNOWN;
+            }
+            ++mStats.mCacheLoads;
+        }
+        MoveToFront(lSlot);
+        uint8_t lValues=mBlocks[uint64_t(lSlot)*cBlockSize+lByte%cBlockSize];
+        pthread_mutex_unlock(&mMutex);
+
+        __sync_fetch_and_add(&mStats.mReturns,1);
+        return EEndgameValue((lValues>>((lIndex&3)*2))&3);
+    }
+
+    const CStats &Stats() const
+    {
+        return mStats;
+    }
+
+    void ResetStats()
+    {
+        memset(&mStats,0,sizeof(mStats));
+    }
+
+    ///reads every slice from disk and compares its checksum with that of
+    ///the slice table
+
+    ///\param pBad set to the slices whose checksum is wrong, if not NULL
+    ///\return the number of such slices
+    int Verify(std::vector<CEndgameMaterial> *pBad=NULL) const
+    {
+        const uint64_t cChunk=1<<20;
+        std::vector<uint8_t> lBuffer(cChunk);
+        int lBad=0;
+        for(int i=0;i<mTable.Slices();i++)
+        {
+            uint64_t lBytes=SliceBytes(i);
+            uint32_t lCrc=0;
+            bool lOk=true;
+            for(uint64_t lDone=0;lOk&&lDone<lBytes;lDone+=cChunk)
+            {
+                uint64_t lSize=std::min(cChunk,lBytes-lDone);
+                lOk=Read(&lBuffer[0],lSize,mTable.SliceEntry(i).mOffset+lDone);
+                lCrc=CEndgameDB::Checksum(&lBuffer[0],lSize,lCrc);
+            }
+            if(lOk&&lCrc==mTable.SliceEntry(i).mChecksum)
+                continue;
+            ++lBad;
+            if(pBad)
+                pBad->push_back(mTable.SliceIndex(i).Material());
+        }
+        return lBad;
+    }
+
+private:
+    uint64_t SliceBytes(int pSlice) const
+    {
+        return (mTable.SliceEntry(pSlice).mPositions+3)/4;
+    }
+
+    int64_t FileBlocks() const
+    {
+        int lLast=mTable.Slices()-1;
+        return (mTable.SliceEntry(lLast).mOffset+SliceBytes(lLast)+cBlockSize-1)/cBlockSize;
+    }
+
+    //reads up to pSize bytes, the end of the last block being past the end
+    //of the file
+    bool Read(uint8_t *pData,uint64_t pSize,uint64_t pOffset) const
+    {
+        while(pSize>0)
+        {
+            ssize_t lRead=pread(mFD,pData,pSize,pOffset);
+            if(lRead<0)
+                return false;
+            if(lRead==0)
+            {
+                memset(pData,0,pSize);
+                return true;
+            }
+            pData+=lRead;
+            pSize-=lRead;
+            pOffset+=lRead;
+        }
+        return true;
+    }
+
+    //reads pBlock into the least recently used slot, which becomes the most
+    //recently used, with the mutex held
+    //\return the slot, -1 if it can't be read
+    int LoadBlock(int64_t pBlock)
+    {
+        int lSlot=mTail;
+        if(mBlockOfSlot[lSlot]>=0)
+            mSlotOfBlock[mBlockOfSlot[lSlot]]=-1;
+        mBlockOfSlot[lSlot]=-1;
+        if(!Read(mBlocks+uint64_t(lSlot)*cBlockSize,cBlockSize,pBlock*cBlockSize))
+            return -1;
+        mBlockOfSlot[lSlot]=pBlock;
+        mSlotOfBlock[pBlock]=lSlot;
+        MoveToFront(lSlot);
+        return lSlot;
+    }
+
+    void MoveToFront(int pSlot)
+    {
+        if(pSlot==mHead)
+            return;
+        mNext[mPrevious[pSlot]]=mNext[pSlot];
+        if(pSlot==mTail)
+            mTail=mPrevious[pSlot];
+        else
+            mPrevious[mNext[pSlot]]=mPrevious[pSlot];
+        mPrevious[pSlot]=-1;
+        mNext[pSlot]=mHead;
+        mPrevious[mHead]=pSlot;
+        mHead=pSlot;
+    }
+
+    CEndgameDB mTable;
+    int mFD;
+    int mMaxPieces;
+
+    std::vector<uint8_t*> mAutoload;    ///< values of the slices loaded whole, by slice
+    uint64_t mAutoloadBytes;
+    int mLoadedSlices;                  ///< slices before this one have been read by Load(), see Publish()
+
+    //the cache: the slot of every block of the file (-1 if it isn't
+    //cached), the block held by every slot, and the slots in order of use,
+    //the most recent first
+    CLargeMemory mBlockMemory;          ///< on huge pages, being probed at random
+    uint8_t *mBlocks;
+    int mSlots;
+    std::vector<int32_t> mSlotOfBlock;
+    std::vector<int64_t> mBlockOfSlot;
+    std::vector<int> mPrevious;
+    std::vector<int> mNext;
+    int mHead;
+    int mTail;
+    pthread_mutex_t mMutex;
+
+    CStats mStats;
+};
+
+/*namespace chk*/ }
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef _CHECKERS_CEVALCACHE_H_
+#define _CHECKERS_CEVALCACHE_H_
+
+#include "constants.h"
+#include "clargememory.h"
+#include <stdint.h>
+#include <cstddef>
+
+namespace chk {
+
+///direct mapped cache of static evaluations, indexed by position hash
+
+///Each entry keeps the upper half of the hash as a check and the score,
+///so that a cache of 2^n entries takes 2^(n+3) bytes.
+class CEvalCache
+{
+public:
+    CEvalCache()
+        :   mEntries(NULL)
+        ,   mMask(0)
+    {
+        ResetStats();
+    }
+
+    ///allocates 2^\p pBits empty entries, dropping the current contents
+
+    ///With \p pBits equal to 0 the cache is disabled. As in
+    ///CTransTable::Resize(), the pages are mapped when first written.
+    void Resize(int pBits,bool pHuge=true)
+    {
+        mMask=pBits>0?(uint32_t(1)<<pBits)-1:0;
+        mMemory.Allocate(pBits>0?sizeof(CEntry)*(mMask+1):0,pHuge);
+        mEntries=(CEntry*)mMemory.Data();
+    }
+
+    ///maps every page of the cache, see CTransTable::Prefault()
+    void Prefault()
+    {
+        mMemory.Prefault();
+    }
+
+    ///size of the pages of the cache (see CLargeMemory::PageSize())
+    std::size_t PageSize() const
+    {
+        return mMemory.PageSize();
+    }
+
+    ///returns the size of the cache in bytes
+    std::size_t Bytes() const
+    {
+        return mEntries?sizeof(CEntry)*(mMask+1):0;
+    }
+
+    ///looks up the score of the position with hash \p pKey
+
+    ///\return true if it was found, and then sets \p pScore
+    bool Probe(uint64_t pKey,eval_t &pScore)
+    {
+        if(!mEntries)
+            return false;
+
+        ++mProbes;
+        const CEntry &lEntry=mEntries[pKey&mMask];
+        if(lEntry.mCheck!=Check(pKey))
+            return false;
+
+        ++mHits;
+        pScore=lEntry.mScore;
+        return true;
+    }
+
+    ///stores the score of the position with hash \p pKey
+    void Store(uint64_t pKey,eval_t pScore)
+    {
+        if(!mEntries)
+            return;
+
+        CEntry &lEntry=mEntries[pKey&mMask];
+        lEntry.mCheck=Check(pKey);
+        lEntry.mScore=pScore;
+    }
+
+    ///number of lookups since the last call to ResetStats()
+    int64_t Probes() const     {   return mProbes;     }
+    ///number of successful lookups since the last call to ResetStats()
+    int64_t Hits() const       {   return mHits;       }
+
+    ///returns the fraction of lookups that were successful
+    float HitRate() const
+    {
+        return mProbes?float(mHits)/mProbes:0.0f;
+    }
+
+    void ResetStats()
+    {
+        mProbes=0;
+        mHits=0;
+    }
+
+private:
+    struct CEntry
+    {
+        uint32_t mCheck;
+        eval_t mScore;
+    };
+
+    ///the part of the hash not used for indexing. The lowest bit is always
+    ///set, so that empty entries never match
+    static uint32_t Check(uint64_t pKey)
+    {
+        return uint32_t(pKey>>32)|1;
+    }
+
+    CLargeMemory mMemory;
+    CEntry *mEntries;
+    uint32_t mMask;
+    int64_t mProbes;
+    int64_t mHits;
+};
+
+/*namespace chk*/ }
+
+#endif
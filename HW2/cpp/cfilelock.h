@@ -0,0 +1,63 @@
+#ifndef _CHECKERS_CFILELOCK_H_
+#define _CHECKERS_CFILELOCK_H_
+
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace chk {
+
+///exclusive lock of a file shared by several clients, held while the object lives
+
+///The lock is taken with flock() on \p pFile followed by ".lock", so that
+///the file itself can be replaced by renaming while it is held. Locks taken
+///by different objects exclude each other, also in the same process.
+class CFileLock
+{
+public:
+    explicit CFileLock(const std::string &pFile)
+    {
+        std::string lLockFile=pFile+".lock";
+        mLock=open(lLockFile.c_str(),O_RDWR|O_CREAT,0644);
+        if(mLock>=0&&flock(mLock,LOCK_EX)!=0)
+        {
+            close(mLock);
+            mLock=-1;
+        }
+    }
+
+    ~CFileLock()
+    {
+        if(mLock<0)
+            return;
+        flock(mLock,LOCK_UN);
+        close(mLock);
+    }
+
+    ///false if the lock couldn't be taken
+    bool Locked() const
+    {
+        return mLock>=0;
+    }
+
+    ///a name to write \p pFile under before renaming it, not used by other processes
+    static std::string TempName(const std::string &pFile)
+    {
+        std::ostringstream lName;
+        lName << pFile << "." << getpid() << ".tmp";
+        return lName.str();
+    }
+
+private:
+    CFileLock(const CFileLock&);
+    CFileLock &operator=(const CFileLock&);
+
+    int mLock;
+};
+
+/*namespace chk*/ }
+
+#endif
@@ -0,0 +1,578 @@
+#ifndef _CHECKERS_CJEFARCHIVE_H_
+#define _CHECKERS_CJEFARCHIVE_H_
+
+#include <stdint.h>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace chk {
+
+///memory used to decode one segment of a CJefArchive
+
+///Allocated once for every thread, and reused for all the segments it decodes.
+struct CJefScratch
+{
+    ///size of each buffer, as in GuiCheckers' uncompress.cpp
+    static const std::size_t cSize=1200000+100000;
+
+    CJefScratch()
+        :   mA((uint8_t*)malloc(cSize))
+        ,   mB((uint8_t*)malloc(cSize))
+        ,   mIndices((uint32_t*)malloc(cSize*sizeof(uint32_t)))
+    {
+    }
+
+    ~CJefScratch()
+    {
+        free(mA);
+        free(mB);
+        free(mIndices);
+    }
+
+    bool Valid() const     {   return mA&&mB&&mIndices;    }
+
+    uint8_t *mA;
+    uint8_t *mB;
+    uint32_t *mIndices;
+
+private:
+    CJefScratch(const CJefScratch&);
+    CJefScratch &operator=(const CJefScratch&);
+};
+
+///archive of files compressed by "Jeffrey the Compression Butler", like the
+///database.jef holding the 2 to 4 piece databases of GuiCheckers
+
+///The archive is a sequence of segments, each made of a CHeader, the name
+///of its file (absent if it continues the file of the previous segment) and
+///the compressed data. A segment holds at most cSegmentSize bytes, and is
+///decoded on its own by undoing an arithmetic code, a run length code, move
+///to front, the Burrows-Wheeler transform and a second run length code.
+///
+///Extract() decodes the segments of the requested files in parallel, each
+///thread with its own CJefScratch, straight into the buffers of the caller.
+///The output is the same as that of uncompressFileFromArchive() in
+///GuiCheckers' uncompress.cpp.
+class CJefArchive
+{
+public:
+    struct CHeader
+    {
+        int8_t mCompType;       ///< 1 to 4, all decoded the same way
+        int8_t mPercent;
+        int16_t mNameLen;       ///< of the name, including the terminating 0
+        int32_t mDataLen;
+    };
+
+    struct CSegment
+    {
+        const uint8_t *mData;
+        uint32_t mSize;
+    };
+
+    struct CFile
+    {
+        std::string mName;
+        std::vector<CSegment> mSegments;
+    };
+
+    ///a file to be extracted by Extract()
+    struct CRequest
+    {
+        CRequest(const std::string &pName="",uint8_t *pOut=NULL,std::size_t pCapacity=0)
+            :   mName(pName)
+            ,   mOut(pOut)
+            ,   mCapacity(pCapacity)
+            ,   mSize(-1)
+        {
+        }
+
+        std::string mName;
+        uint8_t *mOut;
+        std::size_t mCapacity;
+        int64_t mSize;          ///< set to the size of the file, -1 if it couldn't be decoded
+    };
+
+    static const std::size_t cSegmentSize=1200000;
+
+    CJefArchive()
+        :   mData(NULL)
+        ,   mSize(0)
+    {
+    }
+
+    ~CJefArchive()
+    {
+        Close();
+        for(std::size_t i=0;i<mScratch.size();i++)
+            delete mScratch[i];
+    }
+
+    ///maps the archive \p pFile into memory and reads its segment headers
+
+    ///\return false if it can't be opened or isn't an archive
+    bool Open(const std::string &pFile)
+    {
+        Close();
+        int lFD=open(pFile.c_str(),O_RDONLY);
+        if(lFD<0)
+            return false;
+
+        struct stat lStat;
+        if(fstat(lFD,&lStat)!=0||lStat.st_size==0)
+        {
+            close(lFD);
+            return false;
+        }
+        void *lData=mmap(NULL,lStat.st_size,PROT_READ,MAP_SHARED,lFD,0);
+        close(lFD);
+        if(lData==MAP_FAILED)
+            return false;
+        mData=(const uint8_t*)lData;
+        mSize=lStat.st_size;
+
+        std::size_t lPos=0;
+        while(lPos<mSize)
+        {
+            CHeader lHeader;
+            if(mSize-lPos<sizeof(CHeader))
+                break;
+            memcpy(&lHeader,mData+lPos,sizeof(CHeader));
+            lPos+=sizeof(CHeader);
+            if(lHeader.mCompType<1||lHeader.mCompType>4||lHeader.mNameLen<0||lHeader.mNameLen>512
+                    ||lHeader.mDataLen<0||(std::size_t)lHeader.mDataLen>cSegmentSize+1
+                    ||mSize-lPos<(std::size_t)lHeader.mNameLen+lHeader.mDataLen)
+                break;
+
+            if(lHeader.mNameLen>0)
+            {
+                const char *lName=(const char*)mData+lPos;
+                mFiles.push_back(CFile());
+                mFiles.back().mName.assign(lName,strnlen(lName,lHeader.mNameLen));
+                lPos+=lHeader.mNameLen;
+            }
+            else if(mFiles.empty())
+            {
+                break;
+            }
+
+            CSegment lSegment={mData+lPos,(uint32_t)lHeader.mDataLen};
+            if(lSegment.mSize>0)
+                mFiles.back().mSegments.push_back(lSegment);
+            lPos+=lHeader.mDataLen;
+        }
+
+        if(lPos!=mSize)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if(mData)
+            munmap((void*)mData,mSize);
+        mData=NULL;
+        mSize=0;
+        mFiles.clear();
+    }
+
+    const std::vector<CFile> &Files() const    {   return mFiles;  }
+
+    ///returns the file called \p pName (ignoring case), or NULL
+    const CFile *Find(const std::string &pName) const
+    {
+        for(std::size_t i=0;i<mFiles.size();i++)
+            if(strcasecmp(mFiles[i].mName.c_str(),pName.c_str())==0)
+                return &mFiles[i];
+        return NULL;
+    }
+
+    ///decodes the files of \p pRequests with up to \p pThreads threads
+
+    ///Every file is written to the buffer of its request if it fits, and its
+    ///mSize is set, also when it doesn't fit, so that the caller can try
+    ///again with a bigger buffer.
+    ///
+    ///\return true if all files were found, decoded and fit in their buffers
+    bool Extract(std::vector<CRequest> &pRequests,int pThreads=1)
+    {
+        CWork lWork;
+        lWork.mRequests=&pRequests;
+        lWork.mNext=0;
+        lWork.mThreaded=false;
+        for(std::size_t r=0;r<pRequests.size();r++)
+        {
+            const CFile *lFile=Find(pRequests[r].mName);
+            pRequests[r].mSize=lFile?0:-1;
+            if(!lFile)
+                continue;
+            for(std::size_t s=0;s<lFile->mSegments.size();s++)
+            {
+                CJob lJob={(int)r,&lFile->mSegments[s],s==0,false,0,0};
+                lWork.mJobs.push_back(lJob);
+            }
+        }
+
+        int lThreads=std::max(1,std::min(pThreads,(int)lWork.mJobs.size()));
+        while((int)mScratch.size()<lThreads)
+            mScratch.push_back(new CJefScratch);
+
+        std::vector<CTask> lTasks(lThreads);
+        for(int t=0;t<lThreads;t++)
+        {
+            lTasks[t].mWork=&lWork;
+            lTasks[t].mScratch=mScratch[t];
+        }
+        if(lThreads==1)
+        {
+            Run(&lTasks[0]);
+        }
+        else
+        {
+            lWork.mThreaded=true;
+            pthread_mutex_init(&lWork.mMutex,NULL);
+            pthread_cond_init(&lWork.mPlaced,NULL);
+            for(int t=0;t<lThreads;t++)
+                pthread_create(&lTasks[t].mThread,NULL,Run,&lTasks[t]);
+            for(int t=0;t<lThreads;t++)
+                pthread_join(lTasks[t].mThread,NULL);
+            pthread_cond_destroy(&lWork.mPlaced);
+            pthread_mutex_destroy(&lWork.mMutex);
+        }
+
+        //the last segment of a file knows where the file ends
+        for(std::size_t j=0;j<lWork.mJobs.size();j++)
+        {
+            const CJob &lJob=lWork.mJobs[j];
+            pRequests[lJob.mRequest].mSize=(lJob.mOffset<0||lJob.mSize<0)?-1:lJob.mOffset+lJob.mSize;
+        }
+        bool lOk=true;
+        for(std::size_t r=0;r<pRequests.size();r++)
+            lOk=lOk&&pRequests[r].mSize>=0&&(std::size_t)pRequests[r].mSize<=pRequests[r].mCapacity;
+        return lOk;
+    }
+
+    ///decodes the file \p pName into \p pOut
+
+    ///\return the size of the file (bigger than \p pCapacity if it didn't fit), or -1
+    int64_t Extract(const std::string &pName,uint8_t *pOut,std::size_t pCapacity,int pThreads=1)
+    {
+        std::vector<CRequest> lRequests(1,CRequest(pName,pOut,pCapacity));
+        Extract(lRequests,pThreads);
+        return lRequests[0].mSize;
+    }
+
+private:
+    ///a segment to decode
+    struct CJob
+    {
+        int mRequest;
+        const CSegment *mSegment;
+        bool mFirst;            ///< the first segment of its file
+        bool mPlaced;           ///< mOffset is known
+        int64_t mSize;          ///< decoded, -1 if it failed
+        int64_t mOffset;        ///< in the file, -1 if an earlier segment failed
+    };
+
+    struct CWork
+    {
+        std::vector<CRequest> *mRequests;
+        std::vector<CJob> mJobs;
+        int mNext;
+        bool mThreaded;
+        pthread_mutex_t mMutex;
+        pthread_cond_t mPlaced;
+    };
+
+    struct CTask
+    {
+        CWork *mWork;
+        CJefScratch *mScratch;
+        pthread_t mThread;
+    };
+
+    //takes segments in order, so that the segment before the one waited for
+    //is always being decoded by another thread
+    static void *Run(void *pTask)
+    {
+        CTask &lTask=*(CTask*)pTask;
+        CWork &lWork=*lTask.mWork;
+        CJefScratch &lScratch=*lTask.mScratch;
+        int lJob;
+        while((lJob=__sync_fetch_and_add(&lWork.mNext,1))<(int)lWork.mJobs.size())
+        {
+            CJob &lJ=lWork.mJobs[lJob];
+            CRequest &lRequest=(*lWork.mRequests)[lJ.mRequest];
+            int64_t lSize=lScratch.Valid()?Decode(*lJ.mSegment,lScratch):-1;
+            //the last run length code is counted first, to know where the
+            //next segment goes
+            lJ.mSize=lSize<0?-1:UnRLE(lScratch.mB,lSize,NULL,0);
+
+            if(lWork.mThreaded)
+                pthread_mutex_lock(&lWork.mMutex);
+            if(!lJ.mFirst)
+            {
+                const CJob &lPrevious=lWork.mJobs[lJob-1];
+                while(!lPrevious.mPlaced)
+                    pthread_cond_wait(&lWork.mPlaced,&lWork.mMutex);
+                lJ.mOffset=(lPrevious.mOffset<0||lPrevious.mSize<0)?-1:lPrevious.mOffset+lPrevious.mSize;
+            }
+            lJ.mPlaced=true;
+            if(lWork.mThreaded)
+            {
+                pthread_cond_broadcast(&lWork.mPlaced);
+                pthread_mutex_unlock(&lWork.mMutex);
+            }
+
+            if(lJ.mOffset>=0&&lJ.mSize>=0&&(uint64_t)(lJ.mOffset+lJ.mSize)<=lRequest.mCapacity)
+                UnRLE(lScratch.mB,lSize,lRequest.mOut+lJ.mOffset,lJ.mSize);
+        }
+        return NULL;
+    }
+
+    ///undoes all but the last run length code of \p pSegment into pScratch.mB
+
+    ///\return the size of the result, or -1 if the segment is corrupt
+    static int64_t Decode(const CSegment &pSegment,CJefScratch &pScratch)
+    {
+        const std::size_t lCapacity=CJefScratch::cSize;
+        int64_t lSize=UnARI(pSegment.mData,pSegment.mSize,pScratch.mA,lCapacity);
+        if(lSize>=0)
+            lSize=UnRLE(pScratch.mA,lSize,pScratch.mB,lCapacity);
+        if(lSize>=0)
+            lSize=UnMTF(pScratch.mB,lSize,pScratch.mA);
+        if(lSize>=0)
+            lSize=UnBWT(pScratch.mA,lSize,pScratch.mB,lCapacity,pScratch.mIndices,lCapacity);
+        return lSize;
+    }
+
+    ///undoes the adaptive arithmetic code of Witten, Neal and Cleary
+    static int64_t UnARI(const uint8_t *pIn,std::size_t pSize,uint8_t *pOut,std::size_t pCapacity)
+    {
+        const int cSymbols=256+1;
+        const int cEOF=256+1;
+        const int cTop=(1<<16)-1;
+        const int cFirstQuarter=cTop/4+1;
+        const int cHalf=2*cFirstQuarter;
+        const int cThirdQuarter=3*cFirstQuarter;
+        const int cMaxFrequency=16383;
+
+        int lFreq[cSymbols+1];
+        int lCumFreq[cSymbols+1];
+        uint8_t lIndexToChar[cSymbols+1];
+        for(int i=0;i<256;i++)
+            lIndexToChar[i+1]=i;
+        for(int i=0;i<=cSymbols;i++)
+        {
+            lFreq[i]=1;
+            lCumFreq[i]=cSymbols-i;
+        }
+        lFreq[0]=0;
+
+        //bits are taken from the lowest of each byte, and are 0 past the end
+        std::size_t lIn=0;
+        int lBuffer=0,lBits=0;
+#define JEF_INPUT_BIT(pBit) \
+        do { \
+            if(lBits==0) { lBuffer=lIn<pSize?pIn[lIn]:0; lIn++; lBits=8; } \
+            pBit=lBuffer&1; lBuffer>>=1; lBits--; \
+        } while(0)
+
+        int lValue=0,lLow=0,lHigh=cTop,lBit;
+        for(int i=0;i<16;i++)
+        {
+            JEF_INPUT_BIT(lBit);
+            lValue=2*lValue+lBit;
+        }
+
+        std::size_t lOut=0;
+        for(;;)
+        {
+            int lRange=lHigh-lLow+1;
+            int lCum=((lValue-lLow+1)*lCumFreq[0]-1)/lRange;
+            int lSymbol;
+            for(lSymbol=1;lSymbol<cSymbols&&lCumFreq[lSymbol]>lCum;lSymbol++) {}
+            lHigh=lLow+(lRange*lCumFreq[lSymbol-1])/lCumFreq[0]-1;
+            lLow=lLow+(lRange*lCumFreq[lSymbol])/lCumFreq[0];
+            for(;;)
+            {
+                if(lHigh<cHalf)
+                {
+                }
+                else if(lLow>=cHalf)
+                {
+                    lValue-=cHalf;
+                    lLow-=cHalf;
+                    lHigh-=cHalf;
+                }
+                else if(lLow>=cFirstQuarter&&lHigh<cThirdQuarter)
+                {
+                    lValue-=cFirstQuarter;
+                    lLow-=cFirstQuarter;
+                    lHigh-=cFirstQuarter;
+                }
+                else
+                {
+                    break;
+                }
+                lLow=2*lLow;
+                lHigh=2*lHigh+1;
+                JEF_INPUT_BIT(lBit);
+                lValue=2*lValue+lBit;
+            }
+            if(lSymbol==cEOF)
+                break;
+            if(lOut==pCapacity)
+                return -1;
+            pOut[lOut++]=lIndexToChar[lSymbol];
+
+            //update the model
+            if(lCumFreq[0]==cMaxFrequency)
+            {
+                int lTotal=0;
+                for(int i=cSymbols;i>=0;i--)
+                {
+                    lFreq[i]=(lFreq[i]+1)/2;
+                    lCumFreq[i]=lTotal;
+                    lTotal+=lFreq[i];
+                }
+            }
+            int i;
+            for(i=lSymbol;lFreq[i]==lFreq[i-1];i--) {}
+            if(i<lSymbol)
+                std::swap(lIndexToChar[i],lIndexToChar[lSymbol]);
+            lFreq[i]++;
+            while(i>0)
+                lCumFreq[--i]++;
+        }
+#undef JEF_INPUT_BIT
+        //the archiver codes one byte too many
+        return lOut>0?(int64_t)lOut-1:-1;
+    }
+
+    ///undoes a run length code in which a byte seen three times in a row is
+    ///followed by the number of further repetitions, in bytes of 255 and a last
+    ///one below
+
+    ///If \p pOut is NULL, the size is counted without writing anything.
+    static int64_t UnRLE(const uint8_t *pIn,std::size_t pSize,uint8_t *pOut,std::size_t pCapacity)
+    {
+        std::size_t lIn=0,lOut=0;
+        int lLast=0,lLast2=1;
+        while(lIn<pSize)
+        {
+            uint8_t lC=pIn[lIn++];
+            std::size_t lRun=1;
+            if(lC==lLast&&lC==lLast2&&lIn<pSize)
+            {
+                uint8_t lCount;
+                while((lCount=pIn[lIn++])==255)
+                {
+                    lRun+=255;
+                    if(lIn==pSize)
+                        return -1;
+                }
+                lRun+=lCount;
+            }
+            if(pOut)
+            {
+                if(lOut+lRun>pCapacity)
+                    return -1;
+                if(lRun==1)
+                    pOut[lOut]=lC;
+                else
+                    memset(pOut+lOut,lC,lRun);
+            }
+            lOut+=lRun;
+            lLast2=lLast;
+            lLast=lC;
+        }
+        return lOut;
+    }
+
+    ///undoes move to front, into \p pOut of the same size as \p pIn
+    static int64_t UnMTF(const uint8_t *pIn,std::size_t pSize,uint8_t *pOut)
+    {
+        uint8_t lOrder[256];
+        for(int i=0;i<256;i++)
+            lOrder[i]=i;
+        for(std::size_t i=0;i<pSize;i++)
+        {
+            uint8_t lIndex=pIn[i];
+            uint8_t lC=lOrder[lIndex];
+            pOut[i]=lC;
+            memmove(lOrder+1,lOrder,lIndex);
+            lOrder[0]=lC;
+        }
+        return pSize;
+    }
+
+    static uint32_t ReadInt(const uint8_t *pIn)
+    {
+        return ((uint32_t)pIn[0]<<24)|((uint32_t)pIn[1]<<16)|((uint32_t)pIn[2]<<8)|pIn[3];
+    }
+
+    ///undoes the Burrows-Wheeler transform
+
+    ///\p pIn holds the length n, n+1 bytes of the last column (one of which,
+    ///at the index of the end of the text, doesn't count), the index of the
+    ///first byte of the text and the index of the end of the text.
+    static int64_t UnBWT(const uint8_t *pIn,std::size_t pSize,uint8_t *pOut,std::size_t pCapacity,
+                         uint32_t *pIndices,std::size_t pIndicesSize)
+    {
+        if(pSize<4)
+            return -1;
+        uint64_t lLength=ReadInt(pIn);
+        if(lLength+13>pSize||lLength>pCapacity||lLength+1>pIndicesSize)
+            return -1;
+        const uint8_t *lData=pIn+4;
+        uint32_t lFirst=ReadInt(lData+lLength+1);
+        uint32_t lLast=ReadInt(lData+lLength+5);
+        if(lFirst>lLength)
+            return -1;
+
+        //the end of the text sorts after every byte
+        uint32_t lNext[257];
+        memset(lNext,0,sizeof(lNext));
+        for(uint32_t i=0;i<=lLength;i++)
+            lNext[i==lLast?256:lData[i]]++;
+        uint32_t lSum=0;
+        for(int c=0;c<257;c++)
+        {
+            uint32_t lCount=lNext[c];
+            lNext[c]=lSum;
+            lSum+=lCount;
+        }
+        for(uint32_t i=0;i<=lLength;i++)
+            pIndices[lNext[i==lLast?256:lData[i]]++]=i;
+
+        uint32_t lIndex=lFirst;
+        for(uint64_t j=0;j<lLength;j++)
+        {
+            pOut[j]=lData[lIndex];
+            lIndex=pIndices[lIndex];
+        }
+        return lLength;
+    }
+
+    const uint8_t *mData;
+    std::size_t mSize;
+    std::vector<CFile> mFiles;
+    std::vector<CJefScratch*> mScratch;
+};
+
+/*namespace chk*/ }
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef _CHECKERS_CLARGEMEMORY_H_
+#define _CHECKERS_CLARGEMEMORY_H_
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace chk {
+
+///zeroed memory for a large table, on huge pages if the system gives them
+
+///The tables probed at random by the search (transposition table,
+///evaluation cache, endgame blocks) miss the TLB on almost every probe with
+///4 KB pages. Allocate() first asks for reserved huge pages (MAP_HUGETLB),
+///then for memory aligned to the huge page size and marked for
+///transparent huge pages (MADV_HUGEPAGE), and otherwise takes normal pages.
+///Which one it got is only known once the pages are mapped, see PageSize().
+class CLargeMemory
+{
+public:
+    CLargeMemory()
+        :   mData(NULL)
+        ,   mBytes(0)
+        ,   mMapped(0)
+        ,   mHugeTLB(false)
+    {
+    }
+
+    ~CLargeMemory()
+    {
+        Free();
+    }
+
+    ///allocates \p pBytes zeroed bytes, dropping the current memory
+
+    ///\param pHuge false to ask for normal pages even where transparent huge
+    ///pages are always used, to compare
+    ///\return false if there isn't enough memory
+    bool Allocate(std::size_t pBytes,bool pHuge=true)
+    {
+        Free();
+        if(pBytes==0)
+            return true;
+        std::size_t lHuge=HugePageSize();
+        pHuge=pHuge&&pBytes>=lHuge;
+        mBytes=pBytes;
+#ifdef MAP_HUGETLB
+        if(pHuge)
+        {
+            mMapped=(pBytes+lHuge-1)/lHuge*lHuge;
+            mData=Map(mMapped,MAP_HUGETLB);
+            mHugeTLB=(mData!=NULL);
+            if(mData)
+                return true;
+        }
+#endif
+        if(pHuge)
+        {
+            //over-allocate to align the start on a huge page
+            std::size_t lSize=(pBytes+lHuge-1)/lHuge*lHuge;
+            uint8_t *lData=(uint8_t*)Map(lSize+lHuge,0);
+            if(lData)
+            {
+                std::size_t lSkip=(lHuge-uintptr_t(lData)%lHuge)%lHuge;
+                if(lSkip>0)
+                    munmap(lData,lSkip);
+                munmap(lData+lSkip+lSize,lHuge-lSkip);
+                mData=lData+lSkip;
+                mMapped=lSize;
+#ifdef MADV_HUGEPAGE
+                madvise(mData,mMapped,MADV_HUGEPAGE);
+#endif
+                return true;
+            }
+        }
+        mMapped=pBytes;
+        mData=Map(mMapped,0);
+#ifdef MADV_NOHUGEPAGE
+        if(mData&&!pHuge)
+            madvise(mData,mMapped,MADV_NOHUGEPAGE);
+#endif
+        if(!mData)
+            mBytes=mMapped=0;
+        return mData!=NULL;
+    }
+
+    void Free()
+    {
+        if(mData)
+            munmap(mData,mMapped);
+        mData=NULL;
+        mBytes=mMapped=0;
+        mHugeTLB=false;
+    }
+
+    void *Data() const
+    {
+        return mData;
+    }
+
+    std::size_t Bytes() const
+    {
+        return mBytes;
+    }
+
+    ///maps every page, so that the search doesn't take the page faults
+
+    ///Every page is written with an atomic add of zero, which leaves what is
+    ///there as it is, so this is safe while another thread uses the memory.
+    void Prefault()
+    {
+        std::size_t lPage=sysconf(_SC_PAGESIZE);
+        uint8_t *lEnd=(uint8_t*)mData+mMapped;
+        for(uint8_t *lByte=(uint8_t*)mData;mData&&lByte<lEnd;lByte+=lPage)
+            __sync_fetch_and_add(lByte,0);
+    }
+
+    ///returns the size of the pages backing most of the memory mapped so far
+
+    ///Transparent huge pages are told by /proc/self/smaps, elsewhere this
+    ///is the normal page size unless MAP_HUGETLB succeeded.
+    std::size_t PageSize() const
+    {
+        if(mHugeTLB)
+            return HugePageSize();
+        std::size_t lPage=sysconf(_SC_PAGESIZE);
+        FILE *lFile=fopen("/proc/self/smaps","r");
+        if(!mData||!lFile)
+        {
+            if(lFile)
+                fclose(lFile);
+            return lPage;
+        }
+        //the huge pages of every mapping the memory is part of, since the
+        //kernel may have merged it with its neighbours
+        uint64_t lHugeKB=0;
+        bool lInside=false;
+        char lLine[256];
+        while(fgets(lLine,sizeof(lLine),lFile))
+        {
+            unsigned long long lStart,lEnd,lKB;
+            char lDash;
+            if(sscanf(lLine,"%llx%c%llx",&lStart,&lDash,&lEnd)==3&&lDash=='-')
+                lInside=lStart<uintptr_t(mData)+mMapped&&lEnd>uintptr_t(mData);
+            else if(lInside&&sscanf(lLine,"AnonHugePages: %llu kB",&lKB)==1)
+                lHugeKB+=lKB;
+        }
+        fclose(lFile);
+        return lHugeKB*1024>=mMapped/2?HugePageSize():lPage;
+    }
+
+    ///the size of a huge page, from /proc/meminfo, 2 MB if it doesn't say
+    static std::size_t HugePageSize()
+    {
+        std::size_t lSize=2<<20;
+        FILE *lFile=fopen("/proc/meminfo","r");
+        if(!lFile)
+            return lSize;
+        char lLine[256];
+        unsigned long long lKB;
+        while(fgets(lLine,sizeof(lLine),lFile))
+        {
+            if(sscanf(lLine,"Hugepagesize: %llu kB",&lKB)==1)
+                lSize=lKB*1024;
+        }
+        fclose(lFile);
+        return lSize;
+    }
+
+private:
+    static void *Map(std::size_t pBytes,int pFlags)
+    {
+        void *lData=mmap(NULL,pBytes,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANON|pFlags,-1,0);
+        return lData==MAP_FAILED?NULL:lData;
+    }
+
+    void *mData;
+    std::size_t mBytes;
+    std::size_t mMapped;    ///< bytes mapped, a whole number of huge pages if they were asked for
+    bool mHugeTLB;          ///< the memory is on reserved huge pages
+};
+
+/*namespace chk*/ }
+
+#endif
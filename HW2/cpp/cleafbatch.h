@@ -0,0 +1,180 @@
+#ifndef _CHECKERS_CLEAFBATCH_H_
+#define _CHECKERS_CLEAFBATCH_H_
+
+#include "constants.h"
+#include "evalweights.h"
+#include "cboard.h"
+#include <stdint.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace chk {
+
+///evaluates a block of positions at once
+
+///The positions are kept as four bitboards each, one array per kind of
+///piece, and all the terms of CBoard::Evaluate() are counted with popcounts
+///of masked bitboards. With AVX2 (compile with -mavx2) eight positions are
+///evaluated per instruction, otherwise one at a time.
+///
+///The scores are those of CBoard::Evaluate() for positions with at least
+///one move. Positions without moves have to be handled separately.
+class CLeafBatch
+{
+public:
+    static const int cMaxBoards=64;     ///< more than the moves of any position
+
+    CLeafBatch()
+        :   mSize(0)
+    {
+    }
+
+    ///removes all positions
+    void Clear()
+    {
+        mSize=0;
+    }
+
+    int Size() const
+    {
+        return mSize;
+    }
+
+    bool Full() const
+    {
+        return mSize==cMaxBoards;
+    }
+
+    ///appends a position, which must not be full
+    void Add(const CBoard &pBoard)
+    {
+        mOwnMen[mSize]=pBoard.Pieces(CELL_OWN);
+        mOwnKings[mSize]=pBoard.Pieces(CELL_OWN|CELL_KING);
+        mOtherMen[mSize]=pBoard.Pieces(CELL_OTHER);
+        mOtherKings[mSize]=pBoard.Pieces(CELL_OTHER|CELL_KING);
+        ++mSize;
+    }
+
+    ///sets \p pScores[i] to the score of the i-th position
+
+    ///\param pRandom source of the noise of the scores, as in CBoard::Evaluate()
+    void Evaluate(eval_t *pScores,CRandom *pRandom=NULL) const
+    {
+        int lOwn[cMaxBoards];
+        int lOther[cMaxBoards];
+
+        int i=0;
+#ifdef __AVX2__
+        for(;i+8<=mSize;i+=8)
+        {
+            _mm256_storeu_si256((__m256i*)(lOwn+i),Material(
+                    _mm256_loadu_si256((const __m256i*)(mOwnMen+i)),
+                    _mm256_loadu_si256((const __m256i*)(mOwnKings+i)),OwnAdvance()));
+            _mm256_storeu_si256((__m256i*)(lOther+i),Material(
+                    _mm256_loadu_si256((const __m256i*)(mOtherMen+i)),
+                    _mm256_loadu_si256((const __m256i*)(mOtherKings+i)),OtherAdvance()));
+        }
+#endif
+        for(;i<mSize;i++)
+        {
+            lOwn[i]=Material(mOwnMen[i],mOwnKings[i],OwnAdvance());
+            lOther[i]=Material(mOtherMen[i],mOtherKings[i],OtherAdvance());
+        }
+
+        for(i=0;i<mSize;i++)
+            pScores[i]=CBoard::MaterialScore(lOwn[i],lOther[i],pRandom?pRandom->Next():0);
+    }
+
+private:
+    ///kings on these cells are on the edge of the board (rows 0 and 7, and
+    ///the columns at the ends of the rows)
+    static const uint32_t cKingTopBottom=0xF000000Fu;
+    static const uint32_t cKingLeftRight=0x18181818u;
+
+    ///a man on row r is worth PAWN_POS*r*r for us and PAWN_POS*(7-r)*(7-r)
+    ///for the other player. Bit b of the mask is set for the rows where bit
+    ///b of that square is set, so that the sum is the popcount of each
+    ///mask times 2^b (bit 1 is never set in a square).
+    static const int cAdvanceBits=5;
+
+    static int AdvanceShift(int pBit)
+    {
+        static const int sShift[cAdvanceBits]={0,2,3,4,5};
+        return sShift[pBit];
+    }
+
+    //rows 1,3,5,7 / 2,6 / 3,5 / 4,5,7 / 6,7, and mirrored for the other player
+    static const uint32_t *OwnAdvance()
+    {
+        static const uint32_t sMasks[cAdvanceBits]={0xF0F0F0F0u,0x0F000F00u,0x00F0F000u,0xF0FF0000u,0xFF000000u};
+        return sMasks;
+    }
+
+    static const uint32_t *OtherAdvance()
+    {
+        static const uint32_t sMasks[cAdvanceBits]={0x0F0F0F0Fu,0x00F000F0u,0x000F0F00u,0x0000FF0Fu,0x000000FFu};
+        return sMasks;
+    }
+
+    static int PopCount(uint32_t pBits)
+    {
+        return __builtin_popcount(pBits);
+    }
+
+    static int Material(uint32_t pMen,uint32_t pKings,const uint32_t *pAdvance)
+    {
+        int lAdvance=0;
+        for(int b=0;b<cAdvanceBits;b++)
+            lAdvance+=PopCount(pMen&pAdvance[b])<<AdvanceShift(b);
+
+        return EVAL_PAWN_SCORE*PopCount(pMen)
+             + EVAL_KING_SCORE*PopCount(pKings)
+             + EVAL_KING_SIDE*(PopCount(pKings&cKingTopBottom)+PopCount(pKings&cKingLeftRight))
+             + EVAL_PAWN_POS*lAdvance;
+    }
+
+#ifdef __AVX2__
+    ///popcount of each 32 bit lane, with a lookup table of nibble counts
+    static __m256i PopCount(__m256i pBits)
+    {
+        const __m256i lTable=_mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                              0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+        const __m256i lNibble=_mm256_set1_epi8(0x0f);
+        __m256i lCounts=_mm256_add_epi8(
+                _mm256_shuffle_epi8(lTable,_mm256_and_si256(pBits,lNibble)),
+                _mm256_shuffle_epi8(lTable,_mm256_and_si256(_mm256_srli_epi16(pBits,4),lNibble)));
+        //add up the four bytes of each lane
+        return _mm256_madd_epi16(_mm256_maddubs_epi16(lCounts,_mm256_set1_epi8(1)),_mm256_set1_epi16(1));
+    }
+
+    static __m256i PopCount(__m256i pBits,uint32_t pMask)
+    {
+        return PopCount(_mm256_and_si256(pBits,_mm256_set1_epi32(pMask)));
+    }
+
+    static __m256i Material(__m256i pMen,__m256i pKings,const uint32_t *pAdvance)
+    {
+        __m256i lAdvance=_mm256_setzero_si256();
+        for(int b=0;b<cAdvanceBits;b++)
+            lAdvance=_mm256_add_epi32(lAdvance,_mm256_slli_epi32(PopCount(pMen,pAdvance[b]),AdvanceShift(b)));
+
+        __m256i lSide=_mm256_add_epi32(PopCount(pKings,cKingTopBottom),PopCount(pKings,cKingLeftRight));
+
+        __m256i lSum=_mm256_mullo_epi32(PopCount(pMen),_mm256_set1_epi32(EVAL_PAWN_SCORE));
+        lSum=_mm256_add_epi32(lSum,_mm256_mullo_epi32(PopCount(pKings),_mm256_set1_epi32(EVAL_KING_SCORE)));
+        lSum=_mm256_add_epi32(lSum,_mm256_mullo_epi32(lSide,_mm256_set1_epi32(EVAL_KING_SIDE)));
+        return _mm256_add_epi32(lSum,_mm256_mullo_epi32(lAdvance,_mm256_set1_epi32(EVAL_PAWN_POS)));
+    }
+#endif
+
+    uint32_t mOwnMen[cMaxBoards];
+    uint32_t mOwnKings[cMaxBoards];
+    uint32_t mOtherMen[cMaxBoards];
+    uint32_t mOtherKings[cMaxBoards];
+    int mSize;
+};
+
+/*namespace chk*/ }
+
+#endif
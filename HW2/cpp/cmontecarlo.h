@@ -0,0 +1,362 @@
+#ifndef _CHECKERS_CMONTECARLO_H_
+#define _CHECKERS_CMONTECARLO_H_
+
+#include "constants.h"
+#include "ctime.h"
+#include "cmove.h"
+#include "cboard.h"
+#include "crandom.h"
+#include "csearchconfig.h"
+#include "clargememory.h"
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+
+namespace chk {
+
+///Monte Carlo tree search, the alternative to the alpha-beta search of CPlayer
+
+///Every playout walks down the tree choosing the child with the best UCT
+///value, expands the node it ends at once it has been visited
+///cExpandVisits times, plays random moves from there to the end of the game
+///and adds the result to the nodes of the path.
+///
+///The tree is searched by several threads at once. Its nodes come from a
+///pool of fixed size and their statistics are updated with atomic
+///operations, without locks. A thread passing through a node adds a virtual
+///loss to it until its playout is done, so that the other threads try other
+///paths meanwhile. The children of a node are expanded by the thread which
+///claims it first, the others play out from the node itself.
+class CMonteCarlo
+{
+public:
+    ///visits of a leaf before its children are added
+    static const int cExpandVisits=2;
+    ///plies of a playout after which the side ahead in material wins
+    static const int cPlayoutPlies=200;
+    ///score reported for a sure win, the win rate being scaled to +-this
+    static const int cScoreScale=1000;
+
+    CMonteCarlo()
+        :   mNodes(NULL)
+        ,   mCapacity(0)
+        ,   mSize(0)
+        ,   mPlayouts(0)
+        ,   mStop(false)
+    {
+    }
+
+    ///allocates the pool for \p pNodes nodes
+    void Resize(int pNodes,bool pHuge=true)
+    {
+        mMemory.Allocate(sizeof(CNode)*std::size_t(pNodes),pHuge);
+        mNodes=(CNode*)mMemory.Data();
+        mCapacity=mNodes?pNodes:0;
+        mSize=0;
+    }
+
+    ///maps the pages of the pool, see CLargeMemory::Prefault()
+    void Prefault()
+    {
+        mMemory.Prefault();
+    }
+
+    ///searches \p pBoard until \p pDue
+
+    ///\param pRandom seeds the random numbers of the threads
+    ///\return the move played most often, NullMove if there is none
+    CMove Search(const CBoard &pBoard,const CTime &pDue,const CSearchConfig &pConfig,CRandom &pRandom)
+    {
+        mRoot=pBoard;
+        mDue=pDue;
+        mDrawPlies=pConfig.mDrawPlies;
+        mExploration=pConfig.mMCTSExploration/100.0;
+        mPlayouts=0;
+        mStop=false;
+        mPrincipalVariation.clear();
+        mScore=0;
+
+        std::vector<CMove> lMoves;
+        mRoot.FindPossibleMoves(lMoves);
+        if(lMoves.empty()||mCapacity<1+(int)lMoves.size())
+            return lMoves.empty()?NullMove:lMoves[0];
+        mSize=1;
+        InitNode(mNodes[0]);
+        Expand(mNodes[0],lMoves);
+        if(lMoves.size()==1)
+        {
+            mPrincipalVariation.assign(1,lMoves[0]);
+            return lMoves[0];
+        }
+
+        int lThreads=std::max(1,pConfig.mMCTSThreads);
+        std::vector<CWorker> lWorkers(lThreads);
+        std::vector<pthread_t> lIds(lThreads);
+        for(int i=0;i<lThreads;i++)
+        {
+            lWorkers[i].mSearch=this;
+            lWorkers[i].mSeed=pRandom.Next();
+        }
+        int lStarted=1;
+        for(;lStarted<lThreads;lStarted++)
+        {
+            if(pthread_create(&lIds[lStarted],NULL,Worker,&lWorkers[lStarted])!=0)
+                break;
+        }
+        Worker(&lWorkers[0]);
+        for(int i=1;i<lStarted;i++)
+            pthread_join(lIds[i],NULL);
+
+        int lBest=BestChild(mNodes[0]);
+        const CNode &lChild=mNodes[mNodes[0].mFirstChild+lBest];
+        mScore=lChild.mVisits?eval_t(cScoreScale*(lChild.mScore/double(lChild.mVisits)-1)):0;
+        FindPrincipalVariation();
+        return lMoves[lBest];
+    }
+
+    ///playouts of the last search
+    int64_t Playouts() const
+    {
+        return mPlayouts;
+    }
+
+    ///nodes of the tree of the last search
+    int Nodes() const
+    {
+        return mSize<mCapacity?mSize:mCapacity;
+    }
+
+    ///win rate of the move played, scaled to [-cScoreScale,cScoreScale]
+    eval_t Score() const
+    {
+        return mScore;
+    }
+
+    ///the most visited path from the root
+    const std::vector<CMove> &PrincipalVariation() const
+    {
+        return mPrincipalVariation;
+    }
+
+private:
+    enum
+    {
+        NODE_LEAF,
+        NODE_EXPANDING,
+        NODE_EXPANDED
+    };
+
+    struct CNode
+    {
+        volatile int32_t mState;        ///< one of NODE_LEAF, NODE_EXPANDING, NODE_EXPANDED
+        int32_t mFirstChild;            ///< children are in the order of FindPossibleMoves()
+        int32_t mChildren;
+        volatile int32_t mVisits;       ///< finished playouts through the node
+        volatile int32_t mScore;        ///< their half points, for the player who moved into the node
+        volatile int32_t mVirtualLoss;  ///< playouts through the node under way
+    };
+
+    struct CWorker
+    {
+        CMonteCarlo *mSearch;
+        uint64_t mSeed;
+    };
+
+    static void *Worker(void *pWorker)
+    {
+        CWorker *lWorker=(CWorker*)pWorker;
+        lWorker->mSearch->Run(lWorker->mSeed);
+        return NULL;
+    }
+
+    static void InitNode(CNode &pNode)
+    {
+        pNode.mState=NODE_LEAF;
+        pNode.mFirstChild=-1;
+        pNode.mChildren=0;
+        pNode.mVisits=0;
+        pNode.mScore=0;
+        pNode.mVirtualLoss=0;
+    }
+
+    //adds the children of a node claimed by setting it to NODE_EXPANDING,
+    //or gives it back if the pool is full
+    bool Expand(CNode &pNode,const std::vector<CMove> &pMoves)
+    {
+        int lCount=pMoves.size();
+        int lFirst=mSize+lCount<=mCapacity?__sync_fetch_and_add(&mSize,lCount):mCapacity;
+        if(lFirst+lCount>mCapacity)
+        {
+            pNode.mState=NODE_LEAF;
+            return false;
+        }
+        for(int i=0;i<lCount;i++)
+            InitNode(mNodes[lFirst+i]);
+        pNode.mFirstChild=lFirst;
+        pNode.mChildren=lCount;
+        __sync_synchronize();
+        pNode.mState=NODE_EXPANDED;
+        return true;
+    }
+
+    //the child with the best UCT value, counting virtual losses as lost
+    //playouts. Children never visited come first
+    int SelectChild(const CNode &pNode) const
+    {
+        double lLogVisits=std::log(double(pNode.mVisits+pNode.mVirtualLoss+1));
+        int lBest=0;
+        double lBestValue=-1;
+        for(int i=0;i<pNode.mChildren;i++)
+        {
+            const CNode &lChild=mNodes[pNode.mFirstChild+i];
+            int lVisits=lChild.mVisits+lChild.mVirtualLoss;
+            if(lVisits==0)
+                return i;
+            double lValue=lChild.mScore/(2.0*lVisits)+mExploration*std::sqrt(lLogVisits/lVisits);
+            if(lValue>lBestValue)
+            {
+                lBestValue=lValue;
+                lBest=i;
+            }
+        }
+        return lBest;
+    }
+
+    int BestChild(const CNode &pNode) const
+    {
+        int lBest=0;
+        for(int i=1;i<pNode.mChildren;i++)
+        {
+            if(mNodes[pNode.mFirstChild+i].mVisits>mNodes[pNode.mFirstChild+lBest].mVisits)
+                lBest=i;
+        }
+        return lBest;
+    }
+
+    //playouts until the time is up, by one thread
+    void Run(uint64_t pSeed)
+    {
+        CRandom lRandom(pSeed);
+        std::vector<CMove> lMoves;
+        std::vector<CNode*> lPath;
+        while(!mStop)
+        {
+            CBoard lBoard(mRoot);
+            lPath.assign(1,&mNodes[0]);
+            int lResult=-1;     //half points of the player to move at the end of the path
+            for(;;)
+            {
+                CNode &lNode=*lPath.back();
+                if(mDrawPlies>0&&lBoard.ReversiblePlies()>=mDrawPlies)
+                {
+                    lResult=1;
+                    break;
+                }
+                if(lNode.mState!=NODE_EXPANDED)
+                {
+                    if(lNode.mVisits+1<cExpandVisits||
+                       !__sync_bool_compare_and_swap(&lNode.mState,NODE_LEAF,NODE_EXPANDING))
+                        break;
+                    lBoard.FindPossibleMoves(lMoves);
+                    if(!Expand(lNode,lMoves))
+                        break;
+                }
+                if(lNode.mChildren==0)
+                {
+                    lResult=0;
+                    break;
+                }
+                int lChild=SelectChild(lNode);
+                lBoard.FindPossibleMoves(lMoves);
+                lBoard.DoMove(lMoves[lChild]);
+                CNode &lNext=mNodes[lNode.mFirstChild+lChild];
+                __sync_fetch_and_add(&lNext.mVirtualLoss,1);
+                lPath.push_back(&lNext);
+            }
+            if(lResult<0)
+                lResult=Playout(lBoard,lMoves,lRandom);
+
+            //the player who moved into a node is the one not to move there
+            for(int i=lPath.size()-1;i>=0;i--)
+            {
+                lResult=2-lResult;
+                __sync_fetch_and_add(&lPath[i]->mScore,lResult);
+                __sync_fetch_and_add(&lPath[i]->mVisits,1);
+                if(i>0)
+                    __sync_fetch_and_sub(&lPath[i]->mVirtualLoss,1);
+            }
+            __sync_fetch_and_add(&mPlayouts,1);
+            if(CTime::GetCurrent()>=mDue)
+                mStop=true;
+        }
+    }
+
+    //plays random moves to the end of the game, crowning whenever possible.
+    //Returns the half points of the player to move in pBoard
+    int Playout(CBoard &pBoard,std::vector<CMove> &pMoves,CRandom &pRandom) const
+    {
+        ECell lPlayer=pBoard.Player();
+        for(int lPly=0;lPly<cPlayoutPlies;lPly++)
+        {
+            if(mDrawPlies>0&&pBoard.ReversiblePlies()>=mDrawPlies)
+                return 1;
+            pBoard.FindPossibleMoves(pMoves);
+            if(pMoves.empty())
+                return pBoard.Player()==lPlayer?0:2;
+            int lMove=pRandom.Next()%pMoves.size();
+            for(std::size_t i=0;i<pMoves.size();i++)
+            {
+                if(pBoard.IsPromotion(pMoves[i]))
+                {
+                    lMove=i;
+                    break;
+                }
+            }
+            pBoard.DoMove(pMoves[lMove]);
+        }
+        pBoard.FindPossibleMoves(pMoves);
+        eval_t lScore=pBoard.Evaluate(pMoves);
+        if(lPlayer!=CELL_OWN)
+            lScore=-lScore;
+        return lScore>0?2:lScore<0?0:1;
+    }
+
+    void FindPrincipalVariation()
+    {
+        CBoard lBoard(mRoot);
+        std::vector<CMove> lMoves;
+        const CNode *lNode=&mNodes[0];
+        while(lNode->mState==NODE_EXPANDED&&lNode->mChildren>0)
+        {
+            int lBest=BestChild(*lNode);
+            if(mNodes[lNode->mFirstChild+lBest].mVisits==0)
+                break;
+            lBoard.FindPossibleMoves(lMoves);
+            mPrincipalVariation.push_back(lMoves[lBest]);
+            lBoard.DoMove(lMoves[lBest]);
+            lNode=&mNodes[lNode->mFirstChild+lBest];
+        }
+    }
+
+    CLargeMemory mMemory;
+    CNode *mNodes;
+    int mCapacity;
+    volatile int mSize;             ///< nodes taken from the pool, may pass mCapacity
+
+    CBoard mRoot;
+    CTime mDue;
+    int mDrawPlies;
+    double mExploration;
+
+    volatile int64_t mPlayouts;
+    volatile bool mStop;
+
+    std::vector<CMove> mPrincipalVariation;
+    eval_t mScore;
+};
+
+/*namespace chk*/ }
+
+#endif
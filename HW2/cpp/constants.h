@@ -1,23 +1,25 @@
 #ifndef _CHECKERS_CONSTANTS_H_
 #define _CHECKERS_CONSTANTS_H_
 
-#include <limits>
-
 #define DEBUG
 #define INFO
 //#define LINEAR_EVAL
-#define EXTEND_FORCE_MOVE
 
 
 namespace chk {
 
-#ifdef LINEAR_EVAL
 typedef int eval_t;
-#else
-typedef float eval_t;
-#endif
 
-const float Infinity = std::numeric_limits<eval_t>::max();
+///value of a won position. A win in n plies is worth cWin-n, a loss in n
+///plies -cWin+n, so that shorter wins and longer losses are preferred
+const eval_t cWin = 30000;
+///scores beyond +-cWinBound are wins or losses found by the search
+const eval_t cWinBound = cWin - 1000;
+///value of a position the endgame database says is won, in fewer plies than
+///the search could find
+const eval_t cDatabaseWin = cWinBound - 1000;
+///bigger than any score
+const eval_t Infinity = cWin + 1;
 
 ///this enumeration is used as the contents of squares in CBoard.
 ///the CELL_OWN and CELL_OTHER constants are also used to refer
@@ -0,0 +1,275 @@
+#ifndef _CHECKERS_COPENINGBOOK_H_
+#define _CHECKERS_COPENINGBOOK_H_
+
+#include "constants.h"
+#include "cboard.h"
+#include "cfilelock.h"
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace chk {
+
+///a position the book knows, reached by a move of the player not to move in it
+struct CBookEntry
+{
+    uint64_t mKey;          ///< CBoard::CanonicalHash() of the position
+    uint32_t mPieces[4];    ///< the position seen by the player to move, see CEndgameDB::Pieces()
+    int16_t mScore;         ///< value for the player who moved, from the last offline search
+    int16_t mDepth;         ///< depth of that search in plies, 0 if it wasn't searched
+    uint16_t mGames;        ///< games in which we played the move
+    uint16_t mWins;         ///< of those, the ones we won
+    uint16_t mLosses;       ///< and the ones we lost
+    uint16_t mSearchedLosses;   ///< mLosses when mScore was searched, see COpeningBook::ToDeepen()
+};
+
+///opening moves and the results of the games they were played in
+
+///The book learns from our games: after every game CPlayer::GameOver()
+///records the positions our first moves led to and whether the game was
+///won, drawn or lost. The next games play again the moves which did well
+///without searching, and search instead of those which lost more than they
+///won. Positions lost since their last offline search are searched deeper
+///(see book.cpp), which sets their score.
+///
+///Positions are keyed by CBoard::CanonicalHash(), so that what is learned
+///playing one colour is used playing the other. The file is a header
+///followed by the entries sorted by key. Several clients may share it:
+///Update() changes it under a lock and replaces it by renaming, so that it
+///is never seen half written and no update is lost.
+class COpeningBook
+{
+public:
+    ///weight of the results of the games against the score of the offline search
+    static const int cResultWeight=1000;
+
+    ///reads \p pFile, replacing the contents of the book
+
+    ///\return false if it doesn't exist or has the wrong format, leaving the book empty
+    bool Load(const std::string &pFile)
+    {
+        mEntries.clear();
+        FILE *lFile=fopen(pFile.c_str(),"rb");
+        if(!lFile)
+            return false;
+
+        CHeader lHeader;
+        bool lOk=fread(&lHeader,sizeof(lHeader),1,lFile)==1&&lHeader==CHeader();
+        if(lOk)
+        {
+            mEntries.resize(lHeader.mEntries);
+            if(!mEntries.empty())
+                lOk=fread(&mEntries[0],sizeof(CBookEntry),mEntries.size(),lFile)==mEntries.size();
+        }
+        fclose(lFile);
+        if(!lOk)
+            mEntries.clear();
+        return lOk;
+    }
+
+    ///writes the book to \p pFile, under a temporary name first
+
+    ///Writers sharing a file have to hold its lock, see Update().
+    bool Save(const std::string &pFile) const
+    {
+        std::string lTemp=CFileLock::TempName(pFile);
+        FILE *lFile=fopen(lTemp.c_str(),"wb");
+        if(!lFile)
+            return false;
+
+        CHeader lHeader;
+        lHeader.mEntries=mEntries.size();
+        bool lOk=fwrite(&lHeader,sizeof(lHeader),1,lFile)==1;
+        if(lOk&&!mEntries.empty())
+            lOk=fwrite(&mEntries[0],sizeof(CBookEntry),mEntries.size(),lFile)==mEntries.size();
+        lOk=(fclose(lFile)==0)&&lOk;
+        if(lOk)
+            lOk=rename(lTemp.c_str(),pFile.c_str())==0;
+        if(!lOk)
+            remove(lTemp.c_str());
+        return lOk;
+    }
+
+    ///adds the changes \p pChanges to the book in \p pFile
+
+    ///The file is locked, read again, changed and replaced, so that changes
+    ///made meanwhile by other clients are kept. The book itself is left as
+    ///it is.
+    static bool Update(const std::string &pFile,const COpeningBook &pChanges)
+    {
+        CFileLock lLock(pFile);
+        if(!lLock.Locked())
+            return false;
+
+        COpeningBook lBook;
+        lBook.Load(pFile);
+        lBook.Add(pChanges);
+        return lBook.Save(pFile);
+    }
+
+    ///returns the entry of the position with key \p pKey, NULL if there is none
+    const CBookEntry *Probe(uint64_t pKey) const
+    {
+        std::vector<CBookEntry>::const_iterator lIt=std::lower_bound(mEntries.begin(),mEntries.end(),pKey,KeyLess);
+        if(lIt==mEntries.end()||lIt->mKey!=pKey)
+            return NULL;
+        return &*lIt;
+    }
+
+    ///records a game in which the position \p pBoard was reached by our move
+
+    ///\param pResult the result of the game for us, as given by the server
+    ///(1 for a win, 2 for a loss, 3 for a draw)
+    void AddGame(const CBoard &pBoard,int pResult)
+    {
+        CBookEntry &lEntry=Insert(pBoard);
+        lEntry.mGames++;
+        if(pResult==1)
+            lEntry.mWins++;
+        else if(pResult==2)
+            lEntry.mLosses++;
+    }
+
+    ///sets the score of the position \p pBoard, found by a search of \p pDepth plies
+
+    ///\param pScore the value for the player who moved into the position
+    ///\param pLosses the games lost from the position when the search began,
+    ///so that those lost meanwhile still have it searched again
+    void AddScore(const CBoard &pBoard,eval_t pScore,int pDepth,int pLosses)
+    {
+        CBookEntry &lEntry=Insert(pBoard);
+        lEntry.mScore=std::max(-cWin,std::min(cWin,pScore));
+        lEntry.mDepth=pDepth;
+        lEntry.mSearchedLosses=pLosses;
+    }
+
+    ///adds the games of the entries of \p pChanges, and the scores searched
+    ///deeper than those of the book
+    void Add(const COpeningBook &pChanges)
+    {
+        for(std::size_t i=0;i<pChanges.mEntries.size();i++)
+        {
+            const CBookEntry &lChange=pChanges.mEntries[i];
+            CBookEntry &lEntry=Insert(lChange);
+            lEntry.mGames=Saturate(lEntry.mGames+lChange.mGames);
+            lEntry.mWins=Saturate(lEntry.mWins+lChange.mWins);
+            lEntry.mLosses=Saturate(lEntry.mLosses+lChange.mLosses);
+            if(lChange.mDepth>0&&lChange.mDepth>=lEntry.mDepth)
+            {
+                lEntry.mScore=lChange.mScore;
+                lEntry.mDepth=lChange.mDepth;
+                lEntry.mSearchedLosses=lChange.mSearchedLosses;
+            }
+        }
+    }
+
+    ///true if a game was lost from the position of \p pEntry since its last offline search
+    static bool ToDeepen(const CBookEntry &pEntry)
+    {
+        return pEntry.mLosses>pEntry.mSearchedLosses;
+    }
+
+    ///value of the move leading to \p pEntry for the player making it
+
+    ///The score of the offline search, raised by the share of the games won
+    ///and lowered by that of the games lost, counting one more game as a draw.
+    static int Value(const CBookEntry &pEntry)
+    {
+        return (pEntry.mDepth>0?pEntry.mScore:0)
+              +cResultWeight*(pEntry.mWins-pEntry.mLosses)/(pEntry.mGames+1);
+    }
+
+    ///returns the board of \p pEntry, the player to move being CELL_OWN
+    static CBoard Board(const CBookEntry &pEntry)
+    {
+        CBoard lBoard(false,CELL_OWN);
+        const uint8_t cPieces[4]={CELL_OWN,CELL_OWN|CELL_KING,CELL_OTHER,CELL_OTHER|CELL_KING};
+        for(int i=0;i<4;i++)
+        {
+            for(int j=0;j<CBoard::cSquares;j++)
+            {
+                if(pEntry.mPieces[i]&(uint32_t(1)<<j))
+                    lBoard.Set(j,cPieces[i]);
+            }
+        }
+        return lBoard;
+    }
+
+    std::size_t Size() const
+    {
+        return mEntries.size();
+    }
+
+    const CBookEntry &At(std::size_t pIndex) const
+    {
+        return mEntries[pIndex];
+    }
+
+private:
+    struct CHeader
+    {
+        CHeader()
+            :   mVersion(2)
+            ,   mEntries(0)
+        {
+            memcpy(mMagic,"CHKB",4);
+        }
+
+        //files are told apart by the magic and the version
+        bool operator==(const CHeader &pRH) const
+        {
+            return memcmp(mMagic,pRH.mMagic,4)==0&&mVersion==pRH.mVersion;
+        }
+
+        char mMagic[4];
+        uint32_t mVersion;
+        uint64_t mEntries;
+    };
+
+    static bool KeyLess(const CBookEntry &pEntry,uint64_t pKey)
+    {
+        return pEntry.mKey<pKey;
+    }
+
+    static uint16_t Saturate(int pCount)
+    {
+        return pCount<0xffff?pCount:0xffff;
+    }
+
+    //the entry of the position, added empty if it isn't there
+    CBookEntry &Insert(const CBoard &pBoard)
+    {
+        CBoard lBoard(pBoard);
+        if(lBoard.Player()!=CELL_OWN)
+            lBoard.Invert();
+        CBookEntry lEntry;
+        memset(&lEntry,0,sizeof(lEntry));
+        lEntry.mKey=lBoard.Hash();
+        lEntry.mPieces[0]=lBoard.Pieces(CELL_OWN);
+        lEntry.mPieces[1]=lBoard.Pieces(CELL_OWN|CELL_KING);
+        lEntry.mPieces[2]=lBoard.Pieces(CELL_OTHER);
+        lEntry.mPieces[3]=lBoard.Pieces(CELL_OTHER|CELL_KING);
+        return Insert(lEntry);
+    }
+
+    CBookEntry &Insert(const CBookEntry &pEntry)
+    {
+        std::vector<CBookEntry>::iterator lIt=std::lower_bound(mEntries.begin(),mEntries.end(),pEntry.mKey,KeyLess);
+        if(lIt!=mEntries.end()&&lIt->mKey==pEntry.mKey)
+            return *lIt;
+        CBookEntry lEntry;
+        memset(&lEntry,0,sizeof(lEntry));
+        lEntry.mKey=pEntry.mKey;
+        memcpy(lEntry.mPieces,pEntry.mPieces,sizeof(lEntry.mPieces));
+        return *mEntries.insert(lIt,lEntry);
+    }
+
+    std::vector<CBookEntry> mEntries;
+};
+
+/*namespace chk*/ }
+
+#endif
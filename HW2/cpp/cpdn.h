@@ -0,0 +1,626 @@
+#ifndef _CHECKERS_CPDN_H_
+#define _CHECKERS_CPDN_H_
+
+#include "constants.h"
+#include "cmove.h"
+#include "cboard.h"
+#include <stdint.h>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace chk {
+
+///result of a game, as written in PDN ("1-0" is a win of the first player)
+enum EPDNResult
+{
+    PDN_UNKNOWN,        ///< "*", or no result given
+    PDN_FIRST_WINS,     ///< "1-0"
+    PDN_SECOND_WINS,    ///< "0-1"
+    PDN_DRAW            ///< "1/2-1/2"
+};
+
+///converts a cell of a board (see CBoard::At()) to a PDN square
+
+///PDN squares are numbered 1 to 32 from the side of the player who moves
+///first, so the conversion depends on whether we moved first.
+inline int PDNSquare(int pCell,bool pFirst)
+{
+    return pFirst?pCell+1:CBoard::cSquares-pCell;
+}
+
+///converts a PDN square to a cell, the inverse of PDNSquare()
+inline int PDNCell(int pSquare,bool pFirst)
+{
+    return pFirst?pSquare-1:CBoard::cSquares-pSquare;
+}
+
+///writes a move in PDN, like "11-15" or "15x24x31"
+inline std::string PDNMove(const CMove &pMove,bool pFirst)
+{
+    std::string lText;
+    for(std::size_t i=0;i<pMove.Length();i++)
+    {
+        if(i>0)
+            lText+=pMove.IsJump()?'x':'-';
+        char lSquare[8];
+        sprintf(lSquare,"%d",PDNSquare(pMove[i],pFirst));
+        lText+=lSquare;
+    }
+    return lText;
+}
+
+///reads a position in the format of the PDN FEN tag, like "W:W21,22,K30:B1-4,K9"
+
+///The first field is the player to move, the others the pieces of each
+///player, kings marked by a K. Black is the player who moves first.
+///\param pBoard set to the position seen by the player to move, who is CELL_OWN
+///\param pFirst set to true if the player to move is the one who moves first,
+///as needed by PDNCell() and PDNMove()
+///\return false if the text can't be parsed
+inline bool PDNSetup(const std::string &pFEN,CBoard &pBoard,bool &pFirst)
+{
+    std::string lFEN;
+    for(std::size_t i=0;i<pFEN.size();i++)
+    {
+        if(pFEN[i]!=' '&&pFEN[i]!='\t'&&pFEN[i]!='"'&&pFEN[i]!='.')
+            lFEN+=toupper(pFEN[i]);
+    }
+    if(lFEN.size()<1||(lFEN[0]!='W'&&lFEN[0]!='B')||(lFEN.size()>1&&lFEN[1]!=':'))
+        return false;
+
+    pFirst=lFEN[0]=='B';
+    pBoard=CBoard(false,CELL_OWN);
+    std::size_t lPos=1;
+    while(lPos<lFEN.size())
+    {
+        ++lPos;     //the ':'
+        if(lPos>=lFEN.size()||(lFEN[lPos]!='W'&&lFEN[lPos]!='B'))
+            return false;
+        uint8_t lColour=(lFEN[lPos]==lFEN[0])?CELL_OWN:CELL_OTHER;
+        ++lPos;
+        while(lPos<lFEN.size()&&lFEN[lPos]!=':')
+        {
+            uint8_t lPiece=lColour;
+            if(lFEN[lPos]=='K')
+            {
+                lPiece|=CELL_KING;
+                ++lPos;
+            }
+            char *lEnd;
+            int lFirst=strtol(lFEN.c_str()+lPos,&lEnd,10);
+            int lLast=lFirst;
+            if(*lEnd=='-')
+                lLast=strtol(lEnd+1,&lEnd,10);
+            if(lEnd==lFEN.c_str()+lPos||lFirst<1||lLast<lFirst||lLast>CBoard::cSquares)
+                return false;
+            for(int s=lFirst;s<=lLast;s++)
+                pBoard.Set(PDNCell(s,pFirst),lPiece);
+            lPos=lEnd-lFEN.c_str();
+            if(lPos<lFEN.size()&&lFEN[lPos]==',')
+                ++lPos;
+        }
+    }
+    return true;
+}
+
+///a piece of text that isn't copied, used for the tokens of a PDN file
+struct CPDNSpan
+{
+    CPDNSpan()
+        :   mBegin(NULL)
+        ,   mEnd(NULL)
+    {
+    }
+
+    CPDNSpan(const char *pBegin,const char *pEnd)
+        :   mBegin(pBegin)
+        ,   mEnd(pEnd)
+    {
+    }
+
+    std::size_t Length() const  {   return mEnd-mBegin; }
+    bool Empty() const          {   return mEnd==mBegin;    }
+
+    bool operator==(const char *pString) const
+    {
+        return strlen(pString)==Length()&&memcmp(mBegin,pString,Length())==0;
+    }
+
+    std::string Str() const
+    {
+        return std::string(mBegin,mEnd);
+    }
+
+    const char *mBegin;
+    const char *mEnd;
+};
+
+///splits the text of PDN games into tokens
+
+///Works like PDNparseGetnextPDNtoken() of cake's PDNparser.c, but returns
+///the tokens as spans of the text instead of copying them.
+class CPDNTokenizer
+{
+public:
+    enum EToken
+    {
+        TOKEN_END,          ///< no more tokens
+        TOKEN_TAG,          ///< [Name "value"], without the brackets
+        TOKEN_NUMBER,       ///< move number, like "12."
+        TOKEN_MOVE,         ///< a move, like "11-15" or "22x15"
+        TOKEN_RESULT,       ///< game termination, one of "1-0", "0-1", "1/2-1/2", "*"
+        TOKEN_COMMENT,      ///< {comment}, without the braces
+        TOKEN_OTHER         ///< variations, annotations and anything not understood
+    };
+
+    CPDNTokenizer(const CPDNSpan &pText)
+        :   mPos(pText.mBegin)
+        ,   mEnd(pText.mEnd)
+    {
+    }
+
+    ///returns the type of the next token and sets \p pToken to its text
+    EToken Next(CPDNSpan &pToken)
+    {
+        while(mPos<mEnd&&IsSpace(*mPos))
+            ++mPos;
+        if(mPos==mEnd)
+        {
+            pToken=CPDNSpan(mEnd,mEnd);
+            return TOKEN_END;
+        }
+
+        const char *lStart=mPos;
+        switch(*mPos)
+        {
+        case '[':
+            return Delimited(']',TOKEN_TAG,pToken);
+        case '{':
+            return Delimited('}',TOKEN_COMMENT,pToken);
+        case '(':
+        {
+            //variations can be nested
+            int lLevel=0;
+            for(;mPos<mEnd;++mPos)
+            {
+                if(*mPos=='(')
+                    ++lLevel;
+                else if(*mPos==')'&&--lLevel==0)
+                {
+                    ++mPos;
+                    break;
+                }
+            }
+            pToken=CPDNSpan(lStart,mPos);
+            return TOKEN_OTHER;
+        }
+        default:
+            break;
+        }
+
+        //move numbers end with their dots, even if the move follows
+        //without a space, as in "1.11-15"
+        while(mPos<mEnd&&!IsSpace(*mPos)&&*mPos!='['&&*mPos!='{'&&*mPos!='(')
+        {
+            if(*mPos++=='.')
+            {
+                while(mPos<mEnd&&*mPos=='.')
+                    ++mPos;
+                break;
+            }
+        }
+        pToken=CPDNSpan(lStart,mPos);
+
+        if(pToken=="*"||pToken=="1-0"||pToken=="0-1"||pToken=="1/2-1/2")
+            return TOKEN_RESULT;
+        if(pToken.mEnd[-1]=='.')
+            return TOKEN_NUMBER;
+        if(IsDigit(*lStart))
+            return TOKEN_MOVE;
+        return TOKEN_OTHER;
+    }
+
+    ///returns the position of the next character to be read
+    const char *Position() const
+    {
+        return mPos;
+    }
+
+    ///splits a tag token into its name and value (without quotes)
+    static bool ParseTag(const CPDNSpan &pTag,CPDNSpan &pName,CPDNSpan &pValue)
+    {
+        const char *lPos=pTag.mBegin;
+        while(lPos<pTag.mEnd&&IsSpace(*lPos))
+            ++lPos;
+        const char *lName=lPos;
+        while(lPos<pTag.mEnd&&!IsSpace(*lPos)&&*lPos!='"')
+            ++lPos;
+        pName=CPDNSpan(lName,lPos);
+
+        while(lPos<pTag.mEnd&&*lPos!='"')
+            ++lPos;
+        if(lPos==pTag.mEnd)
+            return false;
+        const char *lValue=++lPos;
+        while(lPos<pTag.mEnd&&*lPos!='"')
+            ++lPos;
+        pValue=CPDNSpan(lValue,lPos);
+        return !pName.Empty();
+    }
+
+    static EPDNResult ParseResult(const CPDNSpan &pResult)
+    {
+        if(pResult=="1-0")
+            return PDN_FIRST_WINS;
+        if(pResult=="0-1")
+            return PDN_SECOND_WINS;
+        if(pResult=="1/2-1/2")
+            return PDN_DRAW;
+        return PDN_UNKNOWN;
+    }
+
+private:
+    EToken Delimited(char pClose,EToken pType,CPDNSpan &pToken)
+    {
+        const char *lStart=++mPos;
+        while(mPos<mEnd&&*mPos!=pClose)
+            ++mPos;
+        pToken=CPDNSpan(lStart,mPos);
+        if(mPos<mEnd)
+            ++mPos;
+        return pType;
+    }
+
+    static bool IsSpace(char pC)
+    {
+        return pC==' '||pC=='\t'||pC=='\n'||pC=='\r';
+    }
+
+    static bool IsDigit(char pC)
+    {
+        return pC>='0'&&pC<='9';
+    }
+
+    const char *mPos;
+    const char *mEnd;
+};
+
+///a game of a PDN file, pointing into the text of the file
+class CPDNGame
+{
+public:
+    ///the text of the game, from its first tag to its termination
+    CPDNSpan mText;
+
+    ///returns the value of tag \p pName, or an empty span
+    CPDNSpan Tag(const char *pName) const
+    {
+        CPDNTokenizer lTokens(mText);
+        CPDNSpan lToken,lName,lValue;
+        CPDNTokenizer::EToken lType;
+        while((lType=lTokens.Next(lToken))==CPDNTokenizer::TOKEN_TAG||lType==CPDNTokenizer::TOKEN_COMMENT)
+        {
+            if(lType==CPDNTokenizer::TOKEN_TAG&&CPDNTokenizer::ParseTag(lToken,lName,lValue)&&lName==pName)
+                return lValue;
+        }
+        return CPDNSpan();
+    }
+
+    ///the result from the Result tag, or from the game termination if there is none
+    EPDNResult Result() const
+    {
+        CPDNSpan lResult=Tag("Result");
+        if(!lResult.Empty())
+            return CPDNTokenizer::ParseResult(lResult);
+
+        CPDNTokenizer lTokens(mText);
+        CPDNSpan lToken;
+        CPDNTokenizer::EToken lType;
+        while((lType=lTokens.Next(lToken))!=CPDNTokenizer::TOKEN_END)
+        {
+            if(lType==CPDNTokenizer::TOKEN_RESULT)
+                return CPDNTokenizer::ParseResult(lToken);
+        }
+        return PDN_UNKNOWN;
+    }
+
+    ///replays the moves of the game from the initial position
+
+    ///The boards are seen from the first player, i.e. the first player is
+    ///CELL_OWN. Games with a FEN tag are not supported.
+    ///\param pMoves the moves, which can be played with CBoard::DoMove()
+    ///\return false if the game has a setup position or an illegal move,
+    ///\p pMoves then contains the moves up to that point
+    bool Moves(std::vector<CMove> &pMoves) const
+    {
+        pMoves.clear();
+        if(!Tag("FEN").Empty())
+            return false;
+
+        CBoard lBoard(true,CELL_OWN);
+        CPDNTokenizer lTokens(mText);
+        CPDNSpan lToken;
+        CPDNTokenizer::EToken lType;
+        while((lType=lTokens.Next(lToken))!=CPDNTokenizer::TOKEN_END&&lType!=CPDNTokenizer::TOKEN_RESULT)
+        {
+            if(lType!=CPDNTokenizer::TOKEN_MOVE)
+                continue;
+
+            CMove lMove;
+            if(!FindMove(lBoard,lToken,lMove))
+                return false;
+            pMoves.push_back(lMove);
+            lBoard.DoMove(lMove);
+        }
+        return true;
+    }
+
+    ///finds the move of \p pBoard written as \p pToken
+
+    ///Jumps may be written with only their first and last squares, like
+    ///"15x24", or with all of them, like "15x22x31".
+    ///\param pFirst true if \p pBoard is seen by the player who moved first
+    static bool FindMove(const CBoard &pBoard,const CPDNSpan &pToken,CMove &pMove,bool pFirst=true)
+    {
+        int lSquares[cMaxSquares];
+        int lCount=0;
+        const char *lPos=pToken.mBegin;
+        while(lPos<pToken.mEnd&&lCount<cMaxSquares)
+        {
+            if(*lPos<'0'||*lPos>'9')
+                break;
+            int lSquare=0;
+            while(lPos<pToken.mEnd&&*lPos>='0'&&*lPos<='9')
+                lSquare=lSquare*10+(*lPos++-'0');
+            if(lSquare<1||lSquare>CBoard::cSquares)
+                return false;
+            lSquares[lCount++]=PDNCell(lSquare,pFirst);
+            if(lPos<pToken.mEnd&&(*lPos=='-'||*lPos=='x'||*lPos=='X'||*lPos==':'))
+                ++lPos;
+        }
+        if(lCount<2)
+            return false;
+
+        std::vector<CMove> lMoves;
+        pBoard.FindPossibleMoves(lMoves);
+        int lFound=0;
+        for(std::size_t i=0;i<lMoves.size();i++)
+        {
+            const CMove &lMove=lMoves[i];
+            bool lMatch;
+            if(lCount==(int)lMove.Length())
+            {
+                lMatch=true;
+                for(int j=0;j<lCount;j++)
+                    lMatch=lMatch&&lMove[j]==lSquares[j];
+            }
+            else
+            {
+                lMatch=lCount==2&&lMove[0]==lSquares[0]&&lMove[lMove.Length()-1]==lSquares[1];
+            }
+            if(lMatch)
+            {
+                pMove=lMove;
+                ++lFound;
+            }
+        }
+        return lFound==1;
+    }
+
+private:
+    static const int cMaxSquares=16;
+};
+
+///reads the games of a PDN file
+
+///The file is mapped into memory and the games point into it, so nothing is
+///copied. The games are only valid while the reader is open.
+class CPDNReader
+{
+public:
+    CPDNReader()
+        :   mData(NULL)
+        ,   mSize(0)
+        ,   mPos(NULL)
+    {
+    }
+
+    ~CPDNReader()
+    {
+        Close();
+    }
+
+    ///maps \p pFile into memory
+
+    ///\return false if it can't be opened
+    bool Open(const std::string &pFile)
+    {
+        Close();
+        int lFD=open(pFile.c_str(),O_RDONLY);
+        if(lFD<0)
+            return false;
+
+        struct stat lStat;
+        bool lOk=fstat(lFD,&lStat)==0;
+        if(lOk&&lStat.st_size>0)
+        {
+            void *lData=mmap(NULL,lStat.st_size,PROT_READ,MAP_PRIVATE,lFD,0);
+            if(lData==MAP_FAILED)
+            {
+                lOk=false;
+            }
+            else
+            {
+                mData=(const char*)lData;
+                mSize=lStat.st_size;
+                madvise(lData,mSize,MADV_SEQUENTIAL);
+            }
+        }
+        close(lFD);
+        mPos=mData;
+        return lOk;
+    }
+
+    void Close()
+    {
+        if(mData)
+            munmap((void*)mData,mSize);
+        mData=NULL;
+        mSize=0;
+        mPos=NULL;
+    }
+
+    ///finds the next game
+
+    ///Works like PDNparseGetnextgame() of cake's PDNparser.c: a game ends
+    ///with its termination, or where the tags of the next game begin.
+    ///\return false if there are no more games
+    bool NextGame(CPDNGame &pGame)
+    {
+        if(!mData)
+            return false;
+
+        CPDNTokenizer lTokens(CPDNSpan(mPos,mData+mSize));
+        CPDNSpan lToken;
+        const char *lBegin=NULL;
+        const char *lEnd=NULL;
+        bool lMoves=false;
+        bool lNextTags=false;
+        while(true)
+        {
+            const char *lBefore=lTokens.Position();
+            CPDNTokenizer::EToken lType=lTokens.Next(lToken);
+            if(lType==CPDNTokenizer::TOKEN_END)
+            {
+                lEnd=lTokens.Position();
+                break;
+            }
+            if(lType==CPDNTokenizer::TOKEN_TAG&&lMoves)
+            {
+                lEnd=lBefore;
+                lNextTags=true;
+                break;
+            }
+            if(!lBegin)
+                lBegin=lType==CPDNTokenizer::TOKEN_TAG?lToken.mBegin-1:lToken.mBegin;
+            if(lType==CPDNTokenizer::TOKEN_RESULT)
+            {
+                lEnd=lToken.mEnd;
+                break;
+            }
+            if(lType==CPDNTokenizer::TOKEN_MOVE||lType==CPDNTokenizer::TOKEN_NUMBER)
+                lMoves=true;
+        }
+
+        //the tag read past is the first of the next game
+        mPos=lNextTags?lEnd:lTokens.Position();
+        if(!lBegin)
+            return false;
+        pGame.mText=CPDNSpan(lBegin,lEnd);
+        return true;
+    }
+
+    ///returns the position of \p pGame in the file, for GameAt()
+    std::size_t Offset(const CPDNGame &pGame) const
+    {
+        return pGame.mText.mBegin-mData;
+    }
+
+    ///returns the game at position \p pOffset of the file, and continues
+    ///reading from there
+    bool GameAt(std::size_t pOffset,CPDNGame &pGame)
+    {
+        if(pOffset>=mSize)
+            return false;
+        mPos=mData+pOffset;
+        return NextGame(pGame);
+    }
+
+private:
+    const char *mData;
+    std::size_t mSize;
+    const char *mPos;
+};
+
+///writes the games played by the client in PDN
+class CPDNWriter
+{
+public:
+    ///starts a new game
+
+    ///\param pFirst true if we move first
+    void Begin(bool pFirst)
+    {
+        mFirst=pFirst;
+        mMoves.clear();
+        time_t lNow=time(NULL);
+        char lDate[16];
+        strftime(lDate,sizeof(lDate),"%Y.%m.%d",localtime(&lNow));
+        mDate=lDate;
+    }
+
+    ///adds a move, with the cells of our board
+    void Add(const CMove &pMove)
+    {
+        mMoves.push_back(pMove);
+    }
+
+    ///writes the game to \p pOut
+
+    ///\param pResult the result of the game for us, as given by the server
+    ///(1 for a win, 2 for a loss, 3 for a draw)
+    void Write(std::ostream &pOut,int pResult) const
+    {
+        const char *lResult="*";
+        if(pResult==1||pResult==2)
+            lResult=((pResult==1)==mFirst)?"1-0":"0-1";
+        else if(pResult==3)
+            lResult="1/2-1/2";
+
+        pOut << "[Event \"KTH AI checkers\"]\n"
+             << "[Date \"" << mDate << "\"]\n"
+             << "[Black \"" << (mFirst?"client":"opponent") << "\"]\n"
+             << "[White \"" << (mFirst?"opponent":"client") << "\"]\n"
+             << "[Result \"" << lResult << "\"]\n";
+
+        std::string lLine;
+        for(std::size_t i=0;i<mMoves.size();i++)
+        {
+            std::string lText;
+            if(i%2==0)
+            {
+                char lNumber[16];
+                sprintf(lNumber,"%d. ",int(i/2+1));
+                lText=lNumber;
+            }
+            lText+=PDNMove(mMoves[i],mFirst);
+            if(lLine.size()+lText.size()>=79)
+            {
+                pOut << lLine << '\n';
+                lLine.clear();
+            }
+            lLine+=lText+' ';
+        }
+        pOut << lLine << lResult << "\n\n";
+        pOut.flush();
+    }
+
+private:
+    bool mFirst;
+    std::string mDate;
+    std::vector<CMove> mMoves;
+};
+
+/*namespace chk*/ }
+
+#endif
@@ -1,7 +1,6 @@
 #include "cplayer.h"
 #include <cstdlib>
-#include <signal.h>
-#include <sys/time.h>
+#include <unistd.h>
 #include <iostream>
 #include <algorithm>
 
@@ -10,33 +9,92 @@ using namespace std;
 namespace chk
 {
 
-bool gTimeout = false;
+CPlayer::CPlayer()
+	: mBookReady(false)
+	, mFollowProof(false)
+	, mPreloading(false)
+	, mPreloadDone(false)
+	, mPreloadStoreReady(false)
+	, mRootScore(-Infinity)
+	, mListener(NULL)
+{
+}
 
-void timeout_handler (int i) {
-	gTimeout = true;
+CPlayer::~CPlayer()
+{
+	WaitPreload();
 }
 
-void check_timeout() {
-	if(gTimeout) {
+// throws timeout_exception once the time of the move is up. The clock is
+// read every cTimeoutBoards boards, which keeps its cost out of the search
+void CPlayer::CheckTimeout()
+{
+	if ((mNumberOfBoards & (cTimeoutBoards - 1)) == 0 && CTime::GetCurrent() >= mDue)
 		throw timeout_exception();
-	}
 }
 
-CPlayer::CPlayer()
+// looks for a forced win with the proof-number search when few pieces are
+// left or the last move was found much better for us. If there is one, its
+// moves become the principal variation
+bool CPlayer::ProveWin(const CBoard &pBoard, const CTime &pDue)
 {
-}
+	int lPieces = CBoard::cSquares - __builtin_popcount(pBoard.Pieces(CELL_EMPTY));
+	// the scores of the Monte Carlo search are win rates, not evaluations
+	bool lAhead = !mConfig.mMCTS && mRootScore >= mConfig.mProofScore;
+	if (lPieces > mConfig.mProofPieces && !lAhead)
+		return false;
+	// the alpha-beta search plays the positions of the database
+	if (mEndgame.IsOpen() && lPieces <= mEndgame.MaxPieces())
+		return false;
 
-void CPlayer::DisableTimer() {
-	setitimer(ITIMER_REAL, 0, 0);
-}
+	CTime lStart = CTime::GetCurrent();
+	EProofResult lResult = mProofSearch.Solve(pBoard, mGameHistory, pDue, mConfig.mDrawPlies, &mEndgame,
+			mConfig.mProofNodes);
+	int64_t lTime = CTime::GetCurrent() - lStart;
+#ifdef INFO
+	cout << "Proof-number search: " << (lResult == PROOF_WIN ? "win" : lResult == PROOF_NO_WIN ? "no win" : "unknown");
+	if (lResult == PROOF_WIN)
+		cout << " in " << mProofSearch.Distance() << " plies";
+	cout << " after " << mProofSearch.Nodes() << " nodes in " << lTime / 1000000.0 << " s, "
+		 << mProofSearch.EndgameHits() << " endgame database hits" << endl;
+#endif
+	if (lResult != PROOF_WIN || mProofSearch.ProofLine().empty())
+		return false;
 
-void CPlayer::EnableTimer(const CTime &pDue) {
-	struct itimerval diff;
+	mPrincipalVariation = mProofSearch.ProofLine();
+	// like the search, which can't tell how long the wins of the database take
+	mRootScore = (mProofSearch.DatabaseWin() ? cDatabaseWin : cWin) - mProofSearch.Distance();
+	if (mListener)
+		mListener->Iteration(mPrincipalVariation.size(), mRootScore, mPrincipalVariation, mProofSearch.Nodes(), lTime);
+	return true;
+}
 
-	CTime::GetCurrent().ToITimevalUntil(pDue, diff);
-	gTimeout = false;
+// plays the move of the book with the best value, if there is one which
+// didn't lose more than it won
+bool CPlayer::BookMove(const CBoard &pBoard, CMove &pMove)
+{
+	if (!Published(mBookReady) || (int)mBookPositions.size() >= mConfig.mBookMoves)
+		return false;
 
-	setitimer(ITIMER_REAL, &diff, 0);
+	vector<CMove> lMoves;
+	pBoard.FindPossibleMoves(lMoves);
+	const CBookEntry *lBest = NULL;
+	for(size_t i = 0; i < lMoves.size(); ++i) {
+		const CBookEntry *lEntry = mBook.Probe(CBoard(pBoard, lMoves[i]).CanonicalHash());
+		if (!lEntry || COpeningBook::Value(*lEntry) < 0)
+			continue;
+		if (!lBest || COpeningBook::Value(*lEntry) > COpeningBook::Value(*lBest)) {
+			lBest = lEntry;
+			pMove = lMoves[i];
+		}
+	}
+	if (!lBest)
+		return false;
+#ifdef INFO
+	cout << "Book move " << pMove.ToString() << ": " << lBest->mGames << " games, " << lBest->mWins << " won, "
+		 << lBest->mLosses << " lost, value " << COpeningBook::Value(*lBest) << endl;
+#endif
+	return true;
 }
 
 bool CPlayer::Idle(const CBoard &pBoard)
@@ -46,19 +104,134 @@ bool CPlayer::Idle(const CBoard &pBoard)
 
 void CPlayer::Initialize(bool pFirst,const CTime &pDue)
 {
-	signal(SIGALRM,timeout_handler);
-    srand(CTime::GetCurrent().Get());
+    mRandom.Seed(CTime::GetCurrent().Get());
+
+    WaitPreload();
+
+    mTransTable.Resize(mConfig.mTransTableBits, mConfig.mHugePages);
+    mEvalCache.Resize(mConfig.mEvalCacheBits, mConfig.mHugePages);
+    if (mConfig.mMCTS)
+    	mMonteCarlo.Resize(mConfig.mMCTSNodes, mConfig.mHugePages);
+    if (mConfig.mProofSearch)
+    	mProofSearch.Resize(mConfig.mProofTableMB, mConfig.mHugePages);
+    mFollowProof = false;
+    mRootScore = -Infinity;
+    mBookPositions.clear();
+
+    if (!mConfig.mEndgameFile.empty() && !mEndgame.IsOpen()
+    		&& mEndgame.Open(mConfig.mEndgameFile, mConfig.mEndgameCacheMB, 0, false,
+    				mConfig.mHugePages)) {
+#ifdef INFO
+    	cout << "Opened " << mEndgame.MaxPieces() << " piece endgame database, "
+    		 << mEndgame.AutoloadBytes() / 1024 << " KB to load" << endl;
+#endif
+    }
+
+    mPreloadFile = mConfig.mTransStoreFile;
+    mPreloadBookFile = mConfig.mBookFile;
+    mBookReady = false;
+    mPreloadStore = CTransStore();
+    mPreloadStoreReady = false;
+    mPreloadDone = false;
+    mPreloading = (pthread_create(&mPreloadThread, NULL, PreloadThread, this) == 0);
+    if (!mPreloading)
+    	Preload();
+
+    // the rest of the time is better spent loading than waiting for the
+    // first move, which would take the page faults
+    while (!Published(mPreloadDone) && CTime::GetCurrent() + 100000 < pDue)
+    	usleep(1000);
+#ifdef INFO
+    if (Published(mPreloadDone))
+    	cout << "Loading done, transposition table on " << mTransTable.PageSize() / 1024 << " KB pages" << endl;
+    else
+    	cout << "Loading goes on while playing" << endl;
+#endif
+}
+
+void *CPlayer::PreloadThread(void *pPlayer)
+{
+	((CPlayer *)pPlayer)->Preload();
+	return NULL;
+}
+
+void CPlayer::Preload()
+{
+	// cheap, and every search needs it
+	mTransTable.Prefault();
+	mEvalCache.Prefault();
+	mMonteCarlo.Prefault();
+	mProofSearch.Prefault();
+
+	if (!mPreloadBookFile.empty() && mBook.Load(mPreloadBookFile)) {
+		Publish(mBookReady, true);
+	}
+
+	if (!mPreloadFile.empty() && mPreloadStore.Load(mPreloadFile)) {
+		Publish(mPreloadStoreReady, true);
+	}
+
+	if (mEndgame.IsOpen() && !mEndgame.Loaded() && !mEndgame.Load())
+		cerr << "Can't read the endgame database" << endl;
+
+	Publish(mPreloadDone, true);
+}
+
+void CPlayer::WaitPreload()
+{
+	if (mPreloading) {
+		pthread_join(mPreloadThread, NULL);
+		mPreloading = false;
+	}
+}
+
+void CPlayer::GameOver(int pResult)
+{
+	WaitPreload();
+
+	// what the first moves of this game led to, for the next games
+	if (!mConfig.mBookFile.empty() && !mBookPositions.empty() && pResult >= 1 && pResult <= 3) {
+		COpeningBook lChanges;
+		for(size_t i = 0; i < mBookPositions.size(); ++i)
+			lChanges.AddGame(mBookPositions[i], pResult);
+		if (!COpeningBook::Update(mConfig.mBookFile, lChanges))
+			cerr << "Can't write " << mConfig.mBookFile << endl;
+#ifdef INFO
+		else
+			cout << "Learned the result of " << mBookPositions.size() << " book moves" << endl;
+#endif
+	}
+	mBookPositions.clear();
+
+	if (mConfig.mTransStoreFile.empty())
+		return;
+
+	// add the deep results of this game to those of earlier games
+	CTransStore lChanges;
+	lChanges.Add(mTransTable, mConfig.mTransStoreDepth*cOnePly);
+	size_t lSize = 0;
+	if (!CTransStore::Update(mConfig.mTransStoreFile, lChanges, mConfig.mTransStoreSize, &lSize)) {
+		cerr << "Can't write " << mConfig.mTransStoreFile << endl;
+		return;
+	}
+#ifdef INFO
+	cout << "Stored " << lSize << " search results" << endl;
+#endif
 }
     
 CMove CPlayer::Play(const CBoard &pBoard,const CTime &pDue)
 {
+	// the move generator changes the board while looking for jumps, and the
+	// caller's board may be searched by other players in other threads
+	const CBoard lRoot(pBoard);
+
 #ifdef INFO
 	cout << endl << "### NEXT ROUND ###" << endl << endl;
 
     pBoard.Print();
 
     std::vector<CMove> lMoves;
-    pBoard.FindPossibleMoves(lMoves);
+    lRoot.FindPossibleMoves(lMoves);
 #endif
 
 #ifdef INFO
@@ -78,164 +251,626 @@ CMove CPlayer::Play(const CBoard &pBoard,const CTime &pDue)
 
     // mMoveHistory.DampScores(2); // FIXME: bit twiddeling about how much to damp
 
-    const int ultimateDepthLimit = 1000;
+    // only positions since the last irreversible move can be repeated
+    if (pBoard.ReversiblePlies() == 0) {
+    	mGameHistory.clear();
+    }
+    mRootIndex = mGameHistory.size();
+    mHashStack.assign(mGameHistory.begin(), mGameHistory.end());
+    mHashStack.resize(mRootIndex + cMaxPly);
+
+    // continue the principal variation of the last move if the opponent
+    // replied as expected
+    if (mPrincipalVariation.size() > 2 && pBoard == mExpectedBoard) {
+    	mPrincipalVariation.erase(mPrincipalVariation.begin(), mPrincipalVariation.begin() + 2);
+#ifdef DEBUG
+    	cout << "Opponent played the expected reply, continuing principal variation" << endl;
+#endif
+    } else {
+    	mPrincipalVariation.clear();
+    	mFollowProof = false;
+    }
+
+    // results of earlier games, once they have been read
+    if (Published(mPreloadStoreReady)) {
+    	mPreloadStoreReady = false;
+    	mPreloadStore.Fill(mTransTable);
+#ifdef INFO
+    	cout << "Loaded " << mPreloadStore.Size() << " stored search results" << endl;
+#endif
+    	mPreloadStore = CTransStore();
+    }
+
+    const int ultimateDepthLimit = mConfig.mMaxSearchDepth > 0 ? mConfig.mMaxSearchDepth : 1000;
     pair<CMove,bool> result;
 
-    EnableTimer(pDue);
+    CTime lStart = CTime::GetCurrent();
+    int lCompletedDepth = 0;
+    int64_t lCompletedTime = 0;
+    int64_t lNodes = 0;
+    mReductions = 0;
+    mReSearches = 0;
+    mFutilityPrunes = 0;
+    mTTHits = 0;
+    mTTCutoffs = 0;
+    mEndgameHits = 0;
+    mMTDPasses = 0;
+    mEvalCache.ResetStats();
+    mEndgame.ResetStats();
+
+    InitRootMoves(lRoot);
+    // the game is lost, which the client tells the server
+    if (mRootMoves.empty())
+    	return CMove(CMove::MOVE_EOG);
 
-    try {
-    	// NOTE: possible variation: increase 2 ply at a time.
-    	for(mMaxDepth = 1; mMaxDepth <= ultimateDepthLimit; mMaxDepth += 1) {
+    mDue = pDue;
+
+    // a proven win is played without searching while the opponent makes
+    // the replies of the proof
+    bool lProven = mFollowProof;
+    bool lBook = false;
+    if (lProven) {
+    	result.first = mPrincipalVariation[0];
 #ifdef INFO
-    		cout << "                     	Searching depth " << mMaxDepth << endl;
+    	cout << "Following the proven win" << endl;
 #endif
-    		result = AlphaBetaSearch(pBoard);
-    		if (! result.second)
-    			break;
-    	}
-    	DisableTimer();
-    } catch(exception &e) {
+    } else if (BookMove(lRoot, result.first)) {
+    	lBook = true;
+    	mPrincipalVariation.clear();
+    } else if (mConfig.mProofSearch) {
+    	lProven = ProveWin(lRoot, lStart + (pDue - lStart) * mConfig.mProofTime / 100);
+    	if (lProven)
+    		result.first = mPrincipalVariation[0];
+    }
+
+    if (lProven || lBook) {
+    	// nothing left to search
+    } else if (mConfig.mMCTS) {
+    	result.first = mMonteCarlo.Search(lRoot, pDue, mConfig, mRandom);
+    	mPrincipalVariation = mMonteCarlo.PrincipalVariation();
+    	mRootScore = mMonteCarlo.Score();
+    	lCompletedDepth = mPrincipalVariation.size();
+    	lCompletedTime = CTime::GetCurrent() - lStart;
+    	lNodes = mMonteCarlo.Playouts();
+    	if (mListener)
+    		mListener->Iteration(lCompletedDepth, mRootScore, mPrincipalVariation, lNodes, lCompletedTime);
+#ifdef INFO
+    	cout << "Monte Carlo search: " << lNodes << " playouts in " << lCompletedTime / 1000000.0 << " s ("
+    		 << (lCompletedTime > 0 ? lNodes * 1000000 / lCompletedTime : 0) << " per second) with "
+    		 << mConfig.mMCTSThreads << " threads, " << mMonteCarlo.Nodes() << " nodes" << endl;
+#endif
+    } else {
+    	try {
+    		// NOTE: possible variation: increase 2 ply at a time.
+    		for(mMaxDepth = 1; mMaxDepth <= ultimateDepthLimit; mMaxDepth += 1) {
+#ifdef INFO
+    			cout << "                     	Searching depth " << mMaxDepth << endl;
+#endif
+    			mNumberOfBoards = 0;
+    			result = AlphaBetaSearch(lRoot);
+    			lCompletedDepth = mMaxDepth;
+    			lCompletedTime = CTime::GetCurrent() - lStart;
+    			lNodes += mNumberOfBoards;
+    			if (mListener)
+    				mListener->Iteration(mMaxDepth, mRootMoves.size() == 1 ? -Infinity : mRootScore,
+    						mPrincipalVariation, lNodes, lCompletedTime);
+#ifdef INFO
+    			cout << "PV:";
+    			for(vector<CMove>::iterator it = mPrincipalVariation.begin(); it != mPrincipalVariation.end(); ++it) {
+    				cout << " [" << it->ToString() << "]";
+    			}
+    			cout << endl;
+#endif
+    			if (! result.second)
+    				break;
+    		}
+    	} catch(exception &e) {
 #ifdef DEBUG
-    	cout << "Exception: " << e.what() << endl;
+    		cout << "Exception: " << e.what() << endl;
+#endif
+    	}
+    }
+
+#ifdef INFO
+    cout << "Completed depth " << lCompletedDepth << " after "
+    	 << lCompletedTime / 1000000.0 << " s, "
+    	 << mReductions << " reductions, " << mReSearches << " re-searches, "
+    	 << mFutilityPrunes << " futility prunes, "
+    	 << mTTHits << " table hits, " << mTTCutoffs << " table cutoffs, "
+    	 << mMTDPasses << " MTD(f) passes, "
+    	 << mEndgameHits << " endgame database hits (" << mEndgame.Stats().mCacheLoads << " blocks read, "
+    	 << mEndgame.Stats().mNotCached << " not cached), "
+    	 << mEvalCache.Hits() << "/" << mEvalCache.Probes() << " evaluation cache hits ("
+    	 << 100 * mEvalCache.HitRate() << "% of " << mEvalCache.Bytes() / 1024 << " KB)" << endl;
 #endif
+
+    mGameHistory.push_back(pBoard.Hash());
+    CBoard lNext(pBoard, result.first);
+    if (lNext.ReversiblePlies() == 0) {
+    	mGameHistory.clear();
     }
+    mGameHistory.push_back(lNext.Hash());
+    if ((int)mBookPositions.size() < mConfig.mBookMoves && !result.first.IsNull())
+    	mBookPositions.push_back(lNext);
+
+    if (mPrincipalVariation.size() >= 2 && mPrincipalVariation[0] == result.first) {
+    	mExpectedBoard = CBoard(CBoard(pBoard, mPrincipalVariation[0]), mPrincipalVariation[1]);
+    } else {
+    	mPrincipalVariation.clear();
+    }
+    mFollowProof = lProven && !mPrincipalVariation.empty();
 
     return result.first;
 
     //return lMoves[rand()%lMoves.size()];
 }
 
-bool CPlayer::CutoffTest(const CBoard &pBoard, const std::vector<CMove> &pMoves, int depth) const {
-	if (pBoard.GameOver(pMoves))
+bool CPlayer::CutoffTest(int depth, int ply) const {
+	if (ply >= cMaxPly - 1)
 		return true;
-	if (depth >= mMaxDepth)
+	if (depth >= mMaxDepth*cOnePly)
 		return true;
 	return false;
 }
 
+bool CPlayer::IsQuiet(const CBoard &pBoard, const CMove &move) const {
+	return !move.IsJump() && !pBoard.IsPromotion(move);
+}
+
+// late quiet moves are first searched with reduced depth, and only searched
+// fully if the reduced search says they are better than expected
+bool CPlayer::ReduceMove(bool quiet, int moveNumber, int depth) const {
+	return mConfig.mLateMoveReductions && quiet
+			&& moveNumber >= mConfig.mLMRMinMoves
+			&& mMaxDepth*cOnePly - depth >= mConfig.mLMRMinDepth*cOnePly;
+}
+
+// at a frontier node all children are evaluated statically
+bool CPlayer::FrontierNode(int depth) const {
+	return mConfig.mFutilityPruning && depth + cOnePly >= mMaxDepth*cOnePly;
+}
+
+// the children of a leaf parent are evaluated statically, unless they are
+// extended
+bool CPlayer::LeafParent(int depth) const {
+	return mConfig.mBatchLeaves && depth + cOnePly >= mMaxDepth*cOnePly;
+}
+
+// returns by how much (in fractions of a ply) the line starting with \p move
+// is extended. Extensions add up per move but never exceed one ply, and the
+// extensions along one path never exceed the configured limit.
+int CPlayer::Extension(const CBoard &pBoard, const CMove &move, bool forced, int extended) const {
+	int ext = 0;
+	if (forced)
+		ext += mConfig.mForcedExtension;
+	if (move.GetType() > 1)
+		ext += mConfig.mMultiJumpExtension;
+	if (pBoard.IsPromotion(move))
+		ext += mConfig.mPromotionExtension;
+	else if (pBoard.IsRunaway(move))
+		ext += mConfig.mRunawayExtension;
+
+	ext = min(ext, min(cOnePly, mConfig.mExtensionLimit - extended));
+	return max(ext, 0);
+}
+
 pair<CMove,bool> CPlayer::AlphaBetaSearch(const CBoard &pBoard)
 {
+    // the value of the last completed iteration, of this move or of the
+    // last one, is the first guess of MTD(f)
+    eval_t guess = mRootScore != -Infinity ? mRootScore : 0;
+
+    mPVLength[0] = 0;
+    mHashStack[mRootIndex] = pBoard.Hash();
+
+    if (mRootMoves.size() == 1) {
+    	UpdatePV(mRootMoves[0].mMove, 0);
+    	mPrincipalVariation.assign(mPV[0], mPV[0] + mPVLength[0]);
+    	return pair<CMove,bool>(mRootMoves[0].mMove, false);
+    }
+
+    eval_t v;
+    CMove m = NullMove;
+
+    OrderRootMoves();
+
+    if (mConfig.mMTDF) {
+    	v = MTDF(pBoard, guess, m);
+    	TransTablePV(pBoard, m);
+    } else {
+    	v = SearchRoot(pBoard, -Infinity, Infinity, m);
+    	mPrincipalVariation.assign(mPV[0], mPV[0] + mPVLength[0]);
+    }
+    mRootScore = v;
+
+    // do something clever when you think we have lost...
+
 #ifdef DEBUG
-	mNumberOfBoards = 0;
+    cout << "Number of Boards looked at: " << mNumberOfBoards << endl;
 #endif
 
-    vector<CMove> lMoves;
-    pBoard.FindPossibleMoves(lMoves);
+    // don't search on if we know we will win or loose, deeper searches can't
+    // find a shorter way to the end
+    if (abs(v) > cWinBound && mMaxDepth >= cWin - abs(v))
+    	return pair<CMove, bool>(m, false);
 
-    if (lMoves.size() == 1) {
-    	return pair<CMove,bool>(lMoves[0], false);
+    if (EasyMove()) {
+#ifdef INFO
+    	cout << "Move " << m.ToString() << " dominates all others, stopping early" << endl;
+#endif
+    	return pair<CMove, bool>(m, false);
     }
 
-    float v = -Infinity;
-    CMove m = NullMove;
+    return pair<CMove, bool>(m, true);
+}
+
+// searches the root moves in order with the window (a,b), failing soft,
+// and sets m to the best one
+eval_t CPlayer::SearchRoot(const CBoard &pBoard, eval_t a, eval_t b, CMove &m)
+{
+    eval_t v = -Infinity;
 
     // FIXME: call MaxValue really, and add history ordering this way.
-    for(vector<CMove>::iterator iter = lMoves.begin(); iter != lMoves.end(); ++iter) {
-    	float vcurr = MinValue(CBoard(pBoard, *iter), v, Infinity, 0);
+    for(vector<CRootMove>::iterator iter = mRootMoves.begin(); iter != mRootMoves.end(); ++iter) {
+    	int nodes = mNumberOfBoards;
+    	eval_t vcurr = MinValue(CBoard(pBoard, iter->mMove), a, b, 0, 0, 1);
+    	iter->mScore = vcurr;
+    	iter->mNodes = mNumberOfBoards - nodes;
 #ifdef DEBUG
-    	cout << "Move " << iter->ToString() << " has value " << vcurr << endl;
+    	cout << "Move " << iter->mMove.ToString() << " has value " << vcurr
+    		 << " (" << iter->mNodes << " boards)" << endl;
 #endif
     	if (vcurr > v) {
     		v = vcurr;
-    		m = *iter;
+    		m = iter->mMove;
+    		UpdatePV(iter->mMove, 0);
     	}
+    	if (v >= b)
+    		break;
+    	a = max(a, v);
     }
+    return v;
+}
 
-    // do something clever when you think we have lost...
+// MTD(f): closes in on the value of the root with searches of zero width
+// around the guess, each of them telling whether the value is below or
+// above it, until the bounds meet. Sets m to the best move
+eval_t CPlayer::MTDF(const CBoard &pBoard, eval_t guess, CMove &m)
+{
+	eval_t lower = -Infinity;
+	eval_t upper = Infinity;
+	eval_t g = guess;
+	while (lower < upper) {
+		eval_t beta = max<eval_t>(g, lower + 1);
+		CMove best = NullMove;
+		g = SearchRoot(pBoard, beta - 1, beta, best);
+		++mMTDPasses;
+		if (g < beta) {
+			upper = g;
+		} else {
+			lower = g;
+			m = best;
+			// the move that failed high is searched first by the next pass
+			for(vector<CRootMove>::iterator iter = mRootMoves.begin(); iter != mRootMoves.end(); ++iter) {
+				if (iter->mMove == best) {
+					rotate(mRootMoves.begin(), iter, iter + 1);
+					break;
+				}
+			}
+		}
+		// the previous principal variation is only followed by the first pass
+		mFollowPV = false;
+	}
+	// the last pass may fail low, but m was set by an earlier pass failing
+	// high: the lower bound starts at -Infinity, below any value, so the
+	// bounds only meet once a pass has raised it
+	return g;
+}
 
-#ifdef DEBUG
-    cout << "Number of Boards looked at: " << mNumberOfBoards << endl;
-#endif
+// the principal variation of MTD(f), whose searches of zero width don't
+// keep mPV, from the best moves stored in the transposition table
+void CPlayer::TransTablePV(const CBoard &pBoard, const CMove &first)
+{
+	mPrincipalVariation.assign(1, first);
+	CBoard board(pBoard, first);
+	while ((int)mPrincipalVariation.size() < mMaxDepth) {
+		const CTransEntry *entry = mTransTable.Probe(board.CanonicalHash());
+		if (!entry || entry->mMove == 0)
+			break;
+		uint16_t move = board.Player() != CELL_OWN ? CTransTable::InvertMoveKey(entry->mMove) : entry->mMove;
+		vector<CMove> moves;
+		board.FindPossibleMoves(moves);
+		vector<CMove>::iterator iter = moves.begin();
+		while (iter != moves.end() && CTransTable::MoveKey(*iter) != move)
+			++iter;
+		if (iter == moves.end())
+			break;
+		mPrincipalVariation.push_back(*iter);
+		board = CBoard(board, *iter);
+	}
+}
 
-    return pair<CMove, bool>(m, (v == 1.0 || v == 0.0) ? false : true); // don't search on if we know we will win or loose.
+void CPlayer::InitRootMoves(const CBoard &pBoard)
+{
+	vector<CMove> lMoves;
+	pBoard.FindPossibleMoves(lMoves);
+	OrderMoves(lMoves);
+
+	mRootMoves.assign(lMoves.begin(), lMoves.end());
 }
 
-float CPlayer::MaxValue(const CBoard &pBoard, float a, float b, int depth)
+static bool CompareRootMoves(const CRootMove &lhs, const CRootMove &rhs)
 {
-	check_timeout();
+	if (lhs.mScore != rhs.mScore)
+		return lhs.mScore > rhs.mScore;
+	return lhs.mNodes > rhs.mNodes;
+}
+
+// best moves of the last iteration first, and among moves that failed low
+// those with bigger subtrees, which were harder to refute. The move of the
+// principal variation goes first, which also covers a variation carried
+// over from the last move.
+void CPlayer::OrderRootMoves()
+{
+	stable_sort(mRootMoves.begin(), mRootMoves.end(), CompareRootMoves);
+
+	mFollowPV = false;
+	if (mPrincipalVariation.empty())
+		return;
+
+	for(vector<CRootMove>::iterator iter = mRootMoves.begin(); iter != mRootMoves.end(); ++iter) {
+		if (iter->mMove == mPrincipalVariation[0]) {
+			rotate(mRootMoves.begin(), iter, iter + 1);
+			mFollowPV = true;
+			break;
+		}
+	}
+}
+
+// the best move dominates if every other root move is known to be worse by
+// the margin. The other scores are upper bounds, so this is safe.
+bool CPlayer::EasyMove() const
+{
+	if (!mConfig.mEasyMove || mMaxDepth < mConfig.mEasyMoveDepth)
+		return false;
+
+	eval_t best = -Infinity;
+	eval_t second = -Infinity;
+	for(vector<CRootMove>::const_iterator iter = mRootMoves.begin(); iter != mRootMoves.end(); ++iter) {
+		if (iter->mScore > best) {
+			second = best;
+			best = iter->mScore;
+		} else if (iter->mScore > second) {
+			second = iter->mScore;
+		}
+	}
+
+	return best - second >= mConfig.mEasyMoveMargin;
+}
+
+eval_t CPlayer::MaxValue(const CBoard &pBoard, eval_t a, eval_t b, int depth, int extended, int ply)
+{
+	CheckTimeout();
 
-#ifdef DEBUG
 	++mNumberOfBoards;
-#endif
+
+	mPVLength[ply] = 0;
+
+	if (IsDraw(pBoard, ply))
+		return 0;
+
+	// mate distance pruning: losing right here is the worst, winning with
+	// the next move the best that can happen
+	a = max(a, -cWin + ply);
+	b = min(b, cWin - ply - 1);
+	if (a >= b)
+		return a;
+
+	eval_t ttScore;
+	uint16_t ttMove = 0;
+	if (ProbeTransTable(pBoard, a, b, depth, ply, ttScore, ttMove))
+		return ttScore;
+
+	eval_t egScore;
+	if (ProbeEndgame(pBoard, depth, ply, egScore))
+		return egScore;
 
 	vector<CMove> lMoves;
 	pBoard.FindPossibleMoves(lMoves);
 
-	if (lMoves.size() == 1) {
-#ifndef EXTEND_FORCE_MOVE
-		++depth;
-#endif
-		return MinValue(CBoard(pBoard,lMoves[0]), a, b, depth);
+	if (lMoves.empty())
+		return -cWin + ply;
+
+	// a forced reply is played out right away, even beyond the horizon
+	if (lMoves.size() == 1 && ply < cMaxPly - 1) {
+		int ext = Extension(pBoard, lMoves[0], true, extended);
+		if (ext > 0) {
+			if (mFollowPV)
+				FollowPV(lMoves, ply);
+			eval_t v = MinValue(CBoard(pBoard,lMoves[0]), a, b, depth+cOnePly-ext, extended+ext, ply+1);
+			UpdatePV(lMoves[0], ply);
+			return v;
+		}
 	}
 
-	if (CutoffTest(pBoard, lMoves, depth)) {
-		return pBoard.Evaluate(lMoves);
+	if (CutoffTest(depth, ply)) {
+		return Evaluate(pBoard, lMoves);
 	}
 
 	OrderMoves(lMoves);
+	TransTableMoveFirst(lMoves, ttMove);
+	if (mFollowPV)
+		FollowPV(lMoves, ply);
 
-	float v = -Infinity;
+	const eval_t alpha = a;
+	eval_t v = -Infinity;
     CMove m = NullMove;
 
-    for(vector<CMove>::iterator iter = lMoves.begin(); iter != lMoves.end(); ++iter) {
-    	float vcurr = MinValue(CBoard(pBoard, *iter), a, b, depth+1);
+    // quiet moves can't lift a hopeless frontier node up to alpha
+    bool futile = false;
+    if (FrontierNode(depth)) {
+    	eval_t futility = Evaluate(pBoard, lMoves) + mConfig.mFutilityMargin;
+    	if (futility <= a) {
+    		futile = true;
+    		v = futility;
+    	}
+    }
+
+    if (!futile && LeafParent(depth))
+    	EvaluateLeaves(pBoard, lMoves);
+
+    int moveNumber = 0;
+    for(vector<CMove>::iterator iter = lMoves.begin(); iter != lMoves.end(); ++iter, ++moveNumber) {
+    	int ext = Extension(pBoard, *iter, false, extended);
+    	bool quiet = ext == 0 && IsQuiet(pBoard, *iter);
+    	if (futile && quiet) {
+    		++mFutilityPrunes;
+    		continue;
+    	}
+
+    	CBoard child(pBoard, *iter);
+    	eval_t vcurr;
+    	if (ReduceMove(quiet, moveNumber, depth)) {
+    		++mReductions;
+    		vcurr = MinValue(child, a, b, depth+(1+mConfig.mLMRReduction)*cOnePly, extended, ply+1);
+    		if (vcurr > a) {
+    			++mReSearches;
+    			vcurr = MinValue(child, a, b, depth+cOnePly, extended, ply+1);
+    		}
+    	} else {
+    		vcurr = MinValue(child, a, b, depth+cOnePly-ext, extended+ext, ply+1);
+    	}
 
     	if (vcurr > v) {
     		v = vcurr;
     		m = *iter;
+    		if (v > a)
+    			UpdatePV(*iter, ply);
     	}
     	if (v >= b) {
     		RecordSufficientMove(*iter,depth);
+    		StoreTransTable(pBoard, v, depth, ply, BOUND_LOWER, *iter);
     		return v;
     	}
     	a = max(a,v);
     }
 
-	RecordSufficientMove(m,depth);
+    if (!m.IsNull())
+    	RecordSufficientMove(m,depth);
+    StoreTransTable(pBoard, v, depth, ply, v > alpha ? BOUND_EXACT : BOUND_UPPER, m);
     return v;
 }
 
-float CPlayer::MinValue(const CBoard &pBoard, float a, float b, int depth)
+eval_t CPlayer::MinValue(const CBoard &pBoard, eval_t a, eval_t b, int depth, int extended, int ply)
 {
-	check_timeout();
+	CheckTimeout();
 
-#ifdef DEBUG
 	++mNumberOfBoards;
-#endif
+
+	mPVLength[ply] = 0;
+
+	if (IsDraw(pBoard, ply))
+		return 0;
+
+	// mate distance pruning: losing with the next move is the worst,
+	// winning right here the best that can happen
+	a = max(a, -cWin + ply + 1);
+	b = min(b, cWin - ply);
+	if (a >= b)
+		return b;
+
+	eval_t ttScore;
+	uint16_t ttMove = 0;
+	if (ProbeTransTable(pBoard, a, b, depth, ply, ttScore, ttMove))
+		return ttScore;
+
+	eval_t egScore;
+	if (ProbeEndgame(pBoard, depth, ply, egScore))
+		return egScore;
 
 	vector<CMove> lMoves;
 	pBoard.FindPossibleMoves(lMoves);
 
-	if (lMoves.size() == 1) {
-#ifndef EXTEND_FORCE_MOVE
-		++depth;
-#endif
-		return MaxValue(CBoard(pBoard,lMoves[0]), a, b, depth);
+	if (lMoves.empty())
+		return cWin - ply;
+
+	// a forced reply is played out right away, even beyond the horizon
+	if (lMoves.size() == 1 && ply < cMaxPly - 1) {
+		int ext = Extension(pBoard, lMoves[0], true, extended);
+		if (ext > 0) {
+			if (mFollowPV)
+				FollowPV(lMoves, ply);
+			eval_t v = MaxValue(CBoard(pBoard,lMoves[0]), a, b, depth+cOnePly-ext, extended+ext, ply+1);
+			UpdatePV(lMoves[0], ply);
+			return v;
+		}
 	}
 
-	if (CutoffTest(pBoard, lMoves, depth)) {
-		return pBoard.Evaluate(lMoves);
+	if (CutoffTest(depth, ply)) {
+		return Evaluate(pBoard, lMoves);
 	}
 
 	OrderMoves(lMoves);
+	TransTableMoveFirst(lMoves, ttMove);
+	if (mFollowPV)
+		FollowPV(lMoves, ply);
 
-	float v = Infinity;
+	const eval_t beta = b;
+	eval_t v = Infinity;
     CMove m = NullMove;
 
-    for(vector<CMove>::iterator iter = lMoves.begin(); iter != lMoves.end(); ++iter) {
-    	float vcurr = MaxValue(CBoard(pBoard, *iter), a, b, depth+1);
+    // quiet moves can't pull a hopeless frontier node down to beta
+    bool futile = false;
+    if (FrontierNode(depth)) {
+    	eval_t futility = Evaluate(pBoard, lMoves) - mConfig.mFutilityMargin;
+    	if (futility >= b) {
+    		futile = true;
+    		v = futility;
+    	}
+    }
+
+    if (!futile && LeafParent(depth))
+    	EvaluateLeaves(pBoard, lMoves);
+
+    int moveNumber = 0;
+    for(vector<CMove>::iterator iter = lMoves.begin(); iter != lMoves.end(); ++iter, ++moveNumber) {
+    	int ext = Extension(pBoard, *iter, false, extended);
+    	bool quiet = ext == 0 && IsQuiet(pBoard, *iter);
+    	if (futile && quiet) {
+    		++mFutilityPrunes;
+    		continue;
+    	}
+
+    	CBoard child(pBoard, *iter);
+    	eval_t vcurr;
+    	if (ReduceMove(quiet, moveNumber, depth)) {
+    		++mReductions;
+    		vcurr = MaxValue(child, a, b, depth+(1+mConfig.mLMRReduction)*cOnePly, extended, ply+1);
+    		if (vcurr < b) {
+    			++mReSearches;
+    			vcurr = MaxValue(child, a, b, depth+cOnePly, extended, ply+1);
+    		}
+    	} else {
+    		vcurr = MaxValue(child, a, b, depth+cOnePly-ext, extended+ext, ply+1);
+    	}
+
     	if (vcurr < v) {
     		v = vcurr;
     		m = *iter;
+    		if (v < b)
+    			UpdatePV(*iter, ply);
     	}
     	if (v <= a) {
     		RecordSufficientMove(*iter,depth);
+    		StoreTransTable(pBoard, v, depth, ply, BOUND_UPPER, *iter);
     		return v;
     	}
     	b = min(b,v);
     }
 
-	RecordSufficientMove(m,depth);
+    if (!m.IsNull())
+    	RecordSufficientMove(m,depth);
+    StoreTransTable(pBoard, v, depth, ply, v < beta ? BOUND_EXACT : BOUND_LOWER, m);
     return v;
 }
 
@@ -245,9 +880,177 @@ void CPlayer::OrderMoves(vector<CMove> &moves)
 	sort(moves.begin(), moves.end(), mMoveHistory.mCompareMoves);
 }
 
+// moves the move of the previous principal variation to the front, and keeps
+// following the variation only while its moves are found
+void CPlayer::FollowPV(vector<CMove> &moves, int ply)
+{
+	mFollowPV = false;
+	if (ply >= (int)mPrincipalVariation.size())
+		return;
+
+	vector<CMove>::iterator pvMove = find(moves.begin(), moves.end(), mPrincipalVariation[ply]);
+	if (pvMove != moves.end()) {
+		rotate(moves.begin(), pvMove, pvMove + 1);
+		mFollowPV = true;
+	}
+}
+
+// the variation at ply is move followed by the variation found below it
+void CPlayer::UpdatePV(const CMove &move, int ply)
+{
+	mPV[ply][0] = move;
+	int length = (ply + 1 < cMaxPly) ? mPVLength[ply + 1] : 0;
+	for(int i = 0; i < length; ++i) {
+		mPV[ply][i + 1] = mPV[ply + 1][i];
+	}
+	mPVLength[ply] = length + 1;
+}
+
+// records the position on the path from the root, and returns true if it is
+// a draw because it repeats an earlier position or nothing irreversible
+// happened for too long
+bool CPlayer::IsDraw(const CBoard &pBoard, int ply)
+{
+	int index = mRootIndex + ply;
+	mHashStack[index] = pBoard.Hash();
+
+	int reversible = pBoard.ReversiblePlies();
+	if (mConfig.mDrawPlies > 0 && reversible >= mConfig.mDrawPlies)
+		return true;
+
+	// the same player is to move only every other ply, and it takes at
+	// least four plies to get back to a position
+	int oldest = max(index - reversible, 0);
+	for(int i = index - 4; i >= oldest; i -= 2) {
+		if (mHashStack[i] == pBoard.Hash())
+			return true;
+	}
+	return false;
+}
+
+// static evaluation of a position with moves, through the evaluation cache
+eval_t CPlayer::Evaluate(const CBoard &pBoard, const vector<CMove> &pMoves)
+{
+	eval_t score;
+	if (!mEvalCache.Probe(pBoard.Hash(), score)) {
+		score = pBoard.Evaluate(pMoves, &mRandom);
+		mEvalCache.Store(pBoard.Hash(), score);
+	}
+	return score;
+}
+
+// evaluates all children of a leaf parent together and puts the scores into
+// the evaluation cache, where the children find them
+void CPlayer::EvaluateLeaves(const CBoard &pBoard, const vector<CMove> &pMoves)
+{
+	if (mEvalCache.Bytes() == 0 || pMoves.size() > (size_t)CLeafBatch::cMaxBoards)
+		return;
+
+	uint64_t hashes[CLeafBatch::cMaxBoards];
+	eval_t scores[CLeafBatch::cMaxBoards];
+	mLeafBatch.Clear();
+	for(vector<CMove>::const_iterator iter = pMoves.begin(); iter != pMoves.end(); ++iter) {
+		CBoard child(pBoard, *iter);
+		hashes[mLeafBatch.Size()] = child.Hash();
+		mLeafBatch.Add(child);
+	}
+	mLeafBatch.Evaluate(scores, &mRandom);
+	for(int i = 0; i < mLeafBatch.Size(); ++i)
+		mEvalCache.Store(hashes[i], scores[i]);
+}
+
+// looks the position up in the transposition table. Returns true if the
+// stored score settles the node, and sets move to the stored best move.
+// Entries are seen by the player to move (see CBoard::CanonicalHash()), so
+// that a position and its colour-flipped mirror share them, and have to be
+// inverted when the other player is to move
+bool CPlayer::ProbeTransTable(const CBoard &pBoard, eval_t a, eval_t b, int depth, int ply,
+		eval_t &score, uint16_t &move)
+{
+	const CTransEntry *entry = mTransTable.Probe(pBoard.CanonicalHash());
+	if (!entry)
+		return false;
+
+	bool inverted = pBoard.Player() != CELL_OWN;
+	++mTTHits;
+	move = inverted ? CTransTable::InvertMoveKey(entry->mMove) : entry->mMove;
+	if (entry->mDepth < mMaxDepth*cOnePly - depth)
+		return false;
+
+	eval_t stored = CTransTable::ScoreFromTT(entry->mScore, ply);
+	EBound bound = EBound(entry->mBound);
+	if (inverted) {
+		stored = -stored;
+		bound = CTransTable::InvertBound(bound);
+	}
+	if (bound == BOUND_EXACT
+			|| (bound == BOUND_LOWER && stored >= b)
+			|| (bound == BOUND_UPPER && stored <= a)) {
+		++mTTCutoffs;
+		score = stored;
+		return true;
+	}
+	return false;
+}
+
+void CPlayer::StoreTransTable(const CBoard &pBoard, eval_t score, int depth, int ply,
+		EBound bound, const CMove &move)
+{
+	uint16_t key = CTransTable::MoveKey(move);
+	if (pBoard.Player() != CELL_OWN) {
+		score = -score;
+		bound = CTransTable::InvertBound(bound);
+		key = CTransTable::InvertMoveKey(key);
+	}
+	mTransTable.Store(pBoard.CanonicalHash(), CTransTable::ScoreToTT(score, ply),
+			mMaxDepth*cOnePly - depth, bound, key);
+}
+
+// looks the position up in the endgame database. Near the horizon only what
+// is in memory is used, so that the search doesn't wait for the disk
+bool CPlayer::ProbeEndgame(const CBoard &pBoard, int depth, int ply, eval_t &score)
+{
+	if (!mEndgame.IsOpen()
+			|| CBoard::cSquares - __builtin_popcount(pBoard.Pieces(CELL_EMPTY)) > mEndgame.MaxPieces())
+		return false;
+
+	bool conditional = mMaxDepth*cOnePly - depth < mConfig.mEndgameLoadDepth*cOnePly;
+	switch(mEndgame.Lookup(pBoard, conditional)) {
+	case ENDGAME_WIN:
+		score = cDatabaseWin - ply;
+		break;
+	case ENDGAME_LOSS:
+		score = -cDatabaseWin + ply;
+		break;
+	case ENDGAME_DRAW:
+		score = 0;
+		break;
+	default:
+		return false;
+	}
+	// the value is for the player to move
+	if (pBoard.Player() != CELL_OWN)
+		score = -score;
+	++mEndgameHits;
+	return true;
+}
+
+void CPlayer::TransTableMoveFirst(vector<CMove> &moves, uint16_t move)
+{
+	if (move == 0)
+		return;
+
+	for(vector<CMove>::iterator iter = moves.begin(); iter != moves.end(); ++iter) {
+		if (CTransTable::MoveKey(*iter) == move) {
+			rotate(moves.begin(), iter, iter + 1);
+			return;
+		}
+	}
+}
+
 void CPlayer::RecordSufficientMove(const CMove &move, int curr_depth)
 {
-	int subtree_depth = mMaxDepth - curr_depth;
+	int subtree_depth = max(mMaxDepth - curr_depth/cOnePly, 0);
 	// FIXME: find out best value.
 	//        1<<depth has been suggested, but then we need to worry about overflow.
 	//		  depth*depth, or 1 would also be possible
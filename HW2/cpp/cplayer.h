@@ -6,9 +6,22 @@
 #include "cmove.h"
 #include "cboard.h"
 #include "cmovehistory.h"
+#include "csearchconfig.h"
+#include "ctranstable.h"
+#include "ctranstore.h"
+#include "cevalcache.h"
+#include "cleafbatch.h"
+#include "cendgamecache.h"
+#include "crandom.h"
+#include "cmontecarlo.h"
+#include "cproofsearch.h"
+#include "copeningbook.h"
+#include "catomic.h"
 #include <vector>
+#include <string>
 #include <exception>
 #include <utility>
+#include <pthread.h>
 
 using namespace std;
 
@@ -24,8 +37,50 @@ public:
 	}
 };
 
+///a move at the root of the search, with what the last iteration found out about it
+struct CRootMove
+{
+    CRootMove(const CMove &pMove)
+        :   mMove(pMove)
+        ,   mScore(-Infinity)
+        ,   mNodes(0)
+    {
+    }
+
+    CMove mMove;
+    eval_t mScore;   ///< value, or upper bound, from the last iteration that searched it
+    int mNodes;     ///< number of boards in its subtree in that iteration
+};
+
+///receives the result of every completed iteration of the search
+
+///\sa CPlayer::SetListener()
+class CSearchListener
+{
+public:
+    virtual ~CSearchListener() {}
+
+    ///called when the iteration to depth \p pDepth (in plies) is completed
+
+    ///\param pScore the value of the best move, -Infinity if it wasn't searched
+    ///because it is the only move
+    ///\param pPV the principal variation, starting with the best move
+    ///\param pNodes boards looked at for this move so far, in all iterations
+    ///\param pTime microseconds since the search started
+    virtual void Iteration(int pDepth,eval_t pScore,const vector<CMove> &pPV,
+                           int64_t pNodes,int64_t pTime)=0;
+};
+
+///the search engine
+
+///Everything a search uses, its clock, random numbers, tables and statistics,
+///belongs to the object, so that several players can search at the same time
+///in threads of one process.
 class CPlayer
 {
+    //the checks of test.cpp look into the search
+    friend class CPlayerTest;
+
 public:
     ///constructor
     
@@ -33,6 +88,9 @@ public:
     ///Initialize
     CPlayer();
 
+    ///waits for the loading started by Initialize()
+    ~CPlayer();
+
     ///called when waiting for the other player to move
     
     ///\param pBoard the current state of the board
@@ -42,6 +100,8 @@ public:
     
     ///perform initialization of the player
     
+    ///The tables are loaded and their memory mapped by a thread, which
+    ///goes on after returning if it isn't done by \p pDue.
     ///\param pFirst true if we will move first, false otherwise
     ///\param pDue time before which we must have returned. To check,
     ///for example, to check if we have less than 100 ms to return, we can check if
@@ -53,32 +113,178 @@ public:
 
     ///\param pBoard the current state of the board
     ///\param pDue time before which we must have returned
-    ///\return the move we make
+    ///\return the move we make, an end of game move if there is none
     CMove Play(const CBoard &pBoard,const CTime &pDue);
 
+    ///called when the game is over, to keep what was learned for the next games
+
+    ///\param pResult the result of the game for us, as given by the server
+    ///(1 for a win, 2 for a loss, 3 for a draw), 0 if it isn't known, in
+    ///which case the book learns nothing
+    void GameOver(int pResult=0);
+
+    ///returns the runtime search parameters, which may be changed between moves
+    CSearchConfig &Config()
+    {
+        return mConfig;
+    }
+
+    ///sets the object told about every completed iteration, NULL for none
+    void SetListener(CSearchListener *pListener)
+    {
+        mListener=pListener;
+    }
+
+    ///restarts the noise of the evaluation from \p pSeed, to repeat a search
+    void Seed(uint64_t pSeed)
+    {
+        mRandom.Seed(pSeed);
+    }
+
+    ///returns the principal variation found by the last completed iteration
+    const vector<CMove> &PrincipalVariation() const
+    {
+        return mPrincipalVariation;
+    }
+
 private:
-    void EnableTimer(const CTime &pDue);
-    void DisableTimer();
+    static void *PreloadThread(void *pPlayer);
+    void Preload();
+    void WaitPreload();
+
+    void CheckTimeout();
+
+    bool ProveWin(const CBoard &pBoard, const CTime &pDue);
+    bool BookMove(const CBoard &pBoard, CMove &pMove);
+
+    bool CutoffTest(int depth, int ply) const;
 
-    bool CutoffTest(const CBoard &pBoard, const vector<CMove> &pMoves, int depth) const;
+    bool IsQuiet(const CBoard &pBoard, const CMove &move) const;
+    bool ReduceMove(bool quiet, int moveNumber, int depth) const;
+    bool FrontierNode(int depth) const;
+    bool LeafParent(int depth) const;
+    int Extension(const CBoard &pBoard, const CMove &move, bool forced, int extended) const;
 
     pair<CMove,bool> AlphaBetaSearch(const CBoard &pBoard);
+    eval_t SearchRoot(const CBoard &pBoard, eval_t a, eval_t b, CMove &m);
+    eval_t MTDF(const CBoard &pBoard, eval_t guess, CMove &m);
+    void TransTablePV(const CBoard &pBoard, const CMove &first);
 
-    float MinValue(const CBoard &pBoard, float a, float b, int depth);
-    float MaxValue(const CBoard &pBoard, float a, float b, int depth);
+    void InitRootMoves(const CBoard &pBoard);
+    void OrderRootMoves();
+    bool EasyMove() const;
+
+    eval_t MinValue(const CBoard &pBoard, eval_t a, eval_t b, int depth, int extended, int ply);
+    eval_t MaxValue(const CBoard &pBoard, eval_t a, eval_t b, int depth, int extended, int ply);
 
     void OrderMoves(vector<CMove> &moves);
+    void FollowPV(vector<CMove> &moves, int ply);
+    bool IsDraw(const CBoard &pBoard, int ply);
+    eval_t Evaluate(const CBoard &pBoard, const vector<CMove> &pMoves);
+    void EvaluateLeaves(const CBoard &pBoard, const vector<CMove> &pMoves);
+    bool ProbeTransTable(const CBoard &pBoard, eval_t a, eval_t b, int depth, int ply,
+    		eval_t &score, uint16_t &move);
+    void StoreTransTable(const CBoard &pBoard, eval_t score, int depth, int ply,
+    		EBound bound, const CMove &move);
+    bool ProbeEndgame(const CBoard &pBoard, int depth, int ply, eval_t &score);
+    void TransTableMoveFirst(vector<CMove> &moves, uint16_t move);
+    void UpdatePV(const CMove &move, int ply);
     void RecordSufficientMove(const CMove &move, int depth);
 
 private:
+    ///maximum distance from the root the search can reach
+    static const int cMaxPly = 128;
+    ///boards searched between readings of the clock, a power of 2
+    static const int cTimeoutBoards = 256;
 
     int mMaxDepth;
 
+    // triangular array of principal variations, mPV[ply] holds the variation
+    // starting at distance ply from the root
+    CMove mPV[cMaxPly][cMaxPly];
+    int mPVLength[cMaxPly];
+
+    // principal variation of the last completed iteration, searched first in
+    // the next one while mFollowPV is set
+    vector<CMove> mPrincipalVariation;
+    bool mFollowPV;
+
+    // hashes of the game positions since the last irreversible move, not
+    // including the current one
+    vector<uint64_t> mGameHistory;
+    // the game positions followed by those on the path from the root of the
+    // search, the root being at mRootIndex
+    vector<uint64_t> mHashStack;
+    int mRootIndex;
+
+    // position expected after our move and the opponent's reply from the
+    // principal variation
+    CBoard mExpectedBoard;
+
     CMoveHistory mMoveHistory;
 
-#ifdef DEBUG
+    CTransTable mTransTable;
+
+    CEvalCache mEvalCache;
+
+    CLeafBatch mLeafBatch;
+
+    CEndgameCache mEndgame;
+
+    CMonteCarlo mMonteCarlo;
+
+    CProofSearch mProofSearch;
+
+    // opening book, read by the loading thread, and the positions our
+    // moves led to in this game while it is used
+    COpeningBook mBook;
+    bool mBookReady;
+    string mPreloadBookFile;
+    vector<CBoard> mBookPositions;
+
+    // the principal variation is a proof of a win, played without
+    // searching while the opponent follows it
+    bool mFollowProof;
+
+    CSearchConfig mConfig;
+
+    // end of the time for the current move
+    CTime mDue;
+
+    // noise of the evaluation, seeded by Initialize() (see Seed())
+    CRandom mRandom;
+
+    // loading started by Initialize(): the endgame database, the memory of
+    // the tables, and the search results of earlier games, which are copied
+    // into the transposition table by the first Play() after they are read.
+    // The thread sets the flags once the data is written, see Publish()
+    pthread_t mPreloadThread;
+    bool mPreloading;
+    bool mPreloadDone;
+    string mPreloadFile;
+    CTransStore mPreloadStore;
+    bool mPreloadStoreReady;
+
+    // selective search statistics of the current move
+    int mReductions;
+    int mReSearches;
+    int mFutilityPrunes;
+    int mTTHits;
+    int mTTCutoffs;
+    int mEndgameHits;
+    int mMTDPasses;
+
+    // moves of the current root position, kept between iterations
+    vector<CRootMove> mRootMoves;
+
     int mNumberOfBoards;
-#endif
+
+    // value of the best root move in the last completed iteration, kept
+    // until an iteration of the next move completes, -Infinity before the
+    // first of a game
+    eval_t mRootScore;
+
+    CSearchListener *mListener;
 
 };
 
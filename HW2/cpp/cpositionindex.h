@@ -0,0 +1,206 @@
+#ifndef _CHECKERS_CPOSITIONINDEX_H_
+#define _CHECKERS_CPOSITIONINDEX_H_
+
+#include "constants.h"
+#include "cboard.h"
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace chk {
+
+///an occurrence of a position in a game of a PDN archive
+struct CPositionPosting
+{
+    uint32_t mGame;     ///< number of the game in the archive, from 0
+    uint32_t mPly;      ///< number of moves played before the position
+};
+
+///index from positions to the games of a PDN archive they occur in
+
+///The index is a file written by pdnindex and mapped into memory, laid out
+///as follows (all in native byte order, every section 8 byte aligned):
+///
+/// - CHeader
+/// - the offset in the archive of every game (uint64_t, see CPDNReader::GameAt())
+/// - for every bucket, the first key of the bucket (uint32_t), and one past the end
+/// - the keys (CKey), ordered by bucket
+/// - the postings of every key (CPositionPosting), ordered by game
+///
+///A key belongs to bucket Hash()&(buckets-1). Positions are those seen by the
+///first player of each game, so that boards seen by the second player have
+///to be inverted (see CBoard::Invert()) before looking them up.
+class CPositionIndex
+{
+public:
+    struct CHeader
+    {
+        char mMagic[4];         ///< "CHKI"
+        uint32_t mVersion;
+        uint64_t mGames;
+        uint64_t mBuckets;      ///< a power of two
+        uint64_t mKeys;
+        uint64_t mPostings;
+    };
+
+    struct CKey
+    {
+        uint64_t mKey;          ///< CBoard::Hash() of the position
+        uint32_t mFirst;        ///< index of its first posting
+        uint32_t mCount;        ///< number of postings
+    };
+
+    static const uint32_t cVersion=2;
+
+    ///sets \p pOffsets to the offsets of the sections of an index with
+    ///header \p pHeader, and returns the size of the file
+    static std::size_t Layout(const CHeader &pHeader,std::size_t pOffsets[4])
+    {
+        std::size_t lPos=sizeof(CHeader);
+        pOffsets[0]=lPos;
+        lPos+=pHeader.mGames*sizeof(uint64_t);
+        pOffsets[1]=lPos;
+        lPos+=Align((pHeader.mBuckets+1)*sizeof(uint32_t));
+        pOffsets[2]=lPos;
+        lPos+=pHeader.mKeys*sizeof(CKey);
+        pOffsets[3]=lPos;
+        lPos+=pHeader.mPostings*sizeof(CPositionPosting);
+        return lPos;
+    }
+
+    static std::size_t Align(std::size_t pSize)
+    {
+        return (pSize+7)&~std::size_t(7);
+    }
+
+    CPositionIndex()
+        :   mData(NULL)
+        ,   mSize(0)
+    {
+    }
+
+    ~CPositionIndex()
+    {
+        Close();
+    }
+
+    ///maps the index file \p pFile into memory
+
+    ///\return false if it can't be opened or isn't an index
+    bool Open(const std::string &pFile)
+    {
+        Close();
+        int lFD=open(pFile.c_str(),O_RDONLY);
+        if(lFD<0)
+            return false;
+
+        struct stat lStat;
+        if(fstat(lFD,&lStat)!=0||(std::size_t)lStat.st_size<sizeof(CHeader))
+        {
+            close(lFD);
+            return false;
+        }
+        void *lData=mmap(NULL,lStat.st_size,PROT_READ,MAP_SHARED,lFD,0);
+        close(lFD);
+        if(lData==MAP_FAILED)
+            return false;
+        mData=(const char*)lData;
+        mSize=lStat.st_size;
+
+        const CHeader &lHeader=Header();
+        std::size_t lOffsets[4];
+        if(memcmp(lHeader.mMagic,"CHKI",4)!=0||lHeader.mVersion!=cVersion
+                ||Layout(lHeader,lOffsets)!=mSize)
+        {
+            Close();
+            return false;
+        }
+        mGameOffsets=(const uint64_t*)(mData+lOffsets[0]);
+        mBuckets=(const uint32_t*)(mData+lOffsets[1]);
+        mKeys=(const CKey*)(mData+lOffsets[2]);
+        mPostings=(const CPositionPosting*)(mData+lOffsets[3]);
+        return true;
+    }
+
+    void Close()
+    {
+        if(mData)
+            munmap((void*)mData,mSize);
+        mData=NULL;
+        mSize=0;
+    }
+
+    ///returns the occurrences of the position with hash \p pKey
+
+    ///\param pCount set to the number of occurrences
+    ///\return the first occurrence, pointing into the index
+    const CPositionPosting *Find(uint64_t pKey,std::size_t &pCount) const
+    {
+        pCount=0;
+        if(!mData)
+            return NULL;
+
+        uint64_t lBucket=pKey&(Header().mBuckets-1);
+        for(uint32_t i=mBuckets[lBucket];i<mBuckets[lBucket+1];i++)
+        {
+            if(mKeys[i].mKey==pKey)
+            {
+                pCount=mKeys[i].mCount;
+                return mPostings+mKeys[i].mFirst;
+            }
+        }
+        return NULL;
+    }
+
+    ///returns the occurrences of \p pBoard
+
+    ///\param pFirst true if \p pBoard is seen by the player who moved first
+    const CPositionPosting *Find(const CBoard &pBoard,bool pFirst,std::size_t &pCount) const
+    {
+        if(pFirst)
+            return Find(pBoard.Hash(),pCount);
+
+        CBoard lBoard(pBoard);
+        lBoard.Invert();
+        return Find(lBoard.Hash(),pCount);
+    }
+
+    ///number of games in the archive
+    std::size_t Games() const
+    {
+        return mData?Header().mGames:0;
+    }
+
+    ///number of distinct positions
+    std::size_t Keys() const
+    {
+        return mData?Header().mKeys:0;
+    }
+
+    ///offset of game \p pGame in the archive
+    uint64_t GameOffset(std::size_t pGame) const
+    {
+        return mGameOffsets[pGame];
+    }
+
+private:
+    const CHeader &Header() const
+    {
+        return *(const CHeader*)mData;
+    }
+
+    const char *mData;
+    std::size_t mSize;
+    const uint64_t *mGameOffsets;
+    const uint32_t *mBuckets;
+    const CKey *mKeys;
+    const CPositionPosting *mPostings;
+};
+
+/*namespace chk*/ }
+
+#endif
@@ -0,0 +1,477 @@
+#ifndef _CHECKERS_CPROOFSEARCH_H_
+#define _CHECKERS_CPROOFSEARCH_H_
+
+#include "constants.h"
+#include "ctime.h"
+#include "cmove.h"
+#include "cboard.h"
+#include "cendgamecache.h"
+#include "clargememory.h"
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace chk {
+
+///outcome of CProofSearch::Solve()
+enum EProofResult
+{
+    PROOF_UNKNOWN=0,    ///< the time ran out first
+    PROOF_WIN=1,        ///< the player to move wins whatever the other does
+    PROOF_NO_WIN=2      ///< the other player can draw or win
+};
+
+///depth-first proof-number search (df-pn), to prove that the player to move
+///wins
+
+///Every position has a proof number, the least number of unknown positions
+///which must turn out to be won to prove it won, and a disproof number, the
+///least number which must turn out not to be won to disprove it. The search
+///always goes down to the most proving position, and only comes back up when
+///the numbers of the node pass the thresholds given by its parent, keeping
+///the numbers of the nodes it leaves in a table of fixed size. When the
+///table is full the nodes with the smallest subtrees are dropped and found
+///again if needed, so the memory is bounded whatever the time given.
+///
+///Draws by the draw_plies rule count as not won. The rule makes the result
+///depend on the reversible plies of a position, which are part of its key
+///in the table, so that no path comes back to a position and the numbers
+///don't depend on the path. Without the rule repetitions on the path count
+///as not won, and the numbers do, as in most df-pn solvers.
+class CProofSearch
+{
+public:
+    ///proof or disproof number of a position which can't be proven or disproven
+    static const uint32_t cInfinite=0x3fffffff;
+    ///longest path searched, deeper positions count as not won
+    static const int cMaxPly=200;
+    ///positions searched between readings of the clock and checks of the
+    ///node limit, a power of 2
+    static const int cTimeoutNodes=1024;
+
+    CProofSearch()
+        :   mEntries(NULL)
+        ,   mMask(0)
+        ,   mNodes(0)
+        ,   mEndgameHits(0)
+        ,   mDistance(0)
+        ,   mDatabaseWin(false)
+    {
+    }
+
+    ///allocates about \p pMB megabytes for the table, dropping its contents
+    void Resize(int pMB,bool pHuge=true)
+    {
+        std::size_t lBuckets=1;
+        while(lBuckets*2*sizeof(CBucket)<=(std::size_t(pMB)<<20))
+            lBuckets*=2;
+        mMemory.Allocate(pMB>0?lBuckets*sizeof(CBucket):0,pHuge);
+        mEntries=(CBucket*)mMemory.Data();
+        mMask=mEntries?lBuckets-1:0;
+    }
+
+    ///maps every page of the table, see CLargeMemory::Prefault()
+    void Prefault()
+    {
+        mMemory.Prefault();
+    }
+
+    ///tries to prove that the player to move in \p pBoard wins
+
+    ///The numbers found are kept in the table, so that a later search of a
+    ///position of the proof is answered from it.
+    ///\param pHistory hashes of the game positions since the last
+    ///irreversible move, not including \p pBoard, to tell repetitions
+    ///\param pDrawPlies see CSearchConfig::mDrawPlies
+    ///\param pEndgame database giving the value of the positions it has,
+    ///NULL for none
+    ///\param pMaxNodes positions it may search besides the time, 0 for no limit
+    EProofResult Solve(const CBoard &pBoard,const std::vector<uint64_t> &pHistory,const CTime &pDue,
+                       int pDrawPlies,CEndgameCache *pEndgame,int64_t pMaxNodes=0)
+    {
+        mProofLine.clear();
+        mDistance=0;
+        mDatabaseWin=false;
+        mNodes=0;
+        mEndgameHits=0;
+        if(!mEntries)
+            return PROOF_UNKNOWN;
+
+        mDue=pDue;
+        mMaxNodes=pMaxNodes;
+        mStop=false;
+        mDrawPlies=pDrawPlies;
+        mEndgame=pEndgame&&pEndgame->IsOpen()?pEndgame:NULL;
+        mAttacker=pBoard.Player();
+        mRootIndex=pHistory.size();
+        mHashes.assign(pHistory.begin(),pHistory.end());
+        mHashes.resize(mRootIndex+cMaxPly+1);
+        mHashes[mRootIndex]=pBoard.Hash();
+
+        CNumbers lRoot;
+        while(!mStop)
+        {
+            Search(pBoard,0,cInfinite,cInfinite,lRoot);
+            if(lRoot.mProof==0||lRoot.mDisproof==0)
+                break;
+        }
+        if(lRoot.mDisproof==0)
+            return PROOF_NO_WIN;
+        if(lRoot.mProof!=0)
+            return PROOF_UNKNOWN;
+        mDistance=lRoot.mDistance;
+        FindProofLine(pBoard);
+
+        //a line which doesn't reach the end of the game may rely on the
+        //database, as does one ending in it
+        CBoard lEnd(pBoard);
+        for(std::size_t i=0;i<mProofLine.size();i++)
+            lEnd.DoMove(mProofLine[i]);
+        std::vector<CMove> lMoves;
+        lEnd.FindPossibleMoves(lMoves);
+        mDatabaseWin=!lMoves.empty()&&(InEndgame(lEnd)||mEndgameHits>0);
+        return PROOF_WIN;
+    }
+
+    ///plies along the proof to the end of the game or to a position the
+    ///database has as won, if the last Solve() found one
+    int Distance() const
+    {
+        return mDistance;
+    }
+
+    ///true if the win found by the last Solve() ends in a position of the
+    ///database rather than at the end of the game, so that Distance() is
+    ///not the length of the win
+    bool DatabaseWin() const
+    {
+        return mDatabaseWin;
+    }
+
+    ///the moves of the proof from the position solved, the longest
+    ///resistance being chosen for the other player
+
+    ///It stops at the first position of the database, and may stop sooner if
+    ///the table has lost positions of the proof and there is no time left to
+    ///prove them again. It is empty if the position solved is in the database.
+    const std::vector<CMove> &ProofLine() const
+    {
+        return mProofLine;
+    }
+
+    ///positions expanded by the last Solve()
+    int64_t Nodes() const
+    {
+        return mNodes;
+    }
+
+    ///positions valued by the endgame database in the last Solve()
+    int64_t EndgameHits() const
+    {
+        return mEndgameHits;
+    }
+
+private:
+    struct CEntry
+    {
+        uint64_t mKey;
+        uint32_t mProof;
+        uint32_t mDisproof;
+        uint32_t mWork;         ///< positions expanded below the node, to choose the one to replace
+        uint16_t mDistance;     ///< plies to the end of the game, once proven
+        uint16_t mPad;
+    };
+
+    struct CBucket
+    {
+        CEntry mEntry[4];
+    };
+
+    struct CNumbers
+    {
+        uint32_t mProof;
+        uint32_t mDisproof;
+        int mDistance;
+    };
+
+    uint64_t Key(const CBoard &pBoard) const
+    {
+        if(mDrawPlies<=0)
+            return pBoard.Hash();
+        return pBoard.Hash()^(uint64_t(pBoard.ReversiblePlies()+1)*0x9e3779b97f4a7c15ULL);
+    }
+
+    const CEntry *Probe(uint64_t pKey) const
+    {
+        const CBucket &lBucket=mEntries[pKey&mMask];
+        for(int i=0;i<4;i++)
+        {
+            if(lBucket.mEntry[i].mKey==pKey&&lBucket.mEntry[i].mWork!=0)
+                return &lBucket.mEntry[i];
+        }
+        return NULL;
+    }
+
+    //replaces the entry of the same position, or else the one with the
+    //smallest subtree
+    void Store(uint64_t pKey,const CNumbers &pNumbers,uint32_t pWork)
+    {
+        CBucket &lBucket=mEntries[pKey&mMask];
+        CEntry *lEntry=&lBucket.mEntry[0];
+        for(int i=0;i<4;i++)
+        {
+            if(lBucket.mEntry[i].mKey==pKey)
+            {
+                lEntry=&lBucket.mEntry[i];
+                break;
+            }
+            if(lBucket.mEntry[i].mWork<lEntry->mWork)
+                lEntry=&lBucket.mEntry[i];
+        }
+        lEntry->mKey=pKey;
+        lEntry->mProof=pNumbers.mProof;
+        lEntry->mDisproof=pNumbers.mDisproof;
+        lEntry->mWork=pWork?pWork:1;
+        lEntry->mDistance=pNumbers.mDistance;
+    }
+
+    static void SetNumbers(CNumbers &pNumbers,uint32_t pProof,uint32_t pDisproof,int pDistance=0)
+    {
+        pNumbers.mProof=pProof;
+        pNumbers.mDisproof=pDisproof;
+        pNumbers.mDistance=pDistance;
+    }
+
+    //true if the position at pIndex of mHashes was there before, with the
+    //same player to move and no irreversible move in between. Only checked
+    //without the draw_plies rule
+    bool Repeated(const CBoard &pBoard,int pIndex) const
+    {
+        if(mDrawPlies>0)
+            return false;
+        int lOldest=pIndex-pBoard.ReversiblePlies();
+        if(lOldest<0)
+            lOldest=0;
+        for(int i=pIndex-4;i>=lOldest;i-=2)
+        {
+            if(mHashes[i]==mHashes[pIndex])
+                return true;
+        }
+        return false;
+    }
+
+    //the numbers of a position about to be searched at pPly, from the
+    //table, the rules or the endgame database, or 1 and 1 if it is unknown.
+    //Returns false if the numbers depend on the path and mustn't be stored
+    bool Evaluate(const CBoard &pBoard,uint64_t pKey,int pPly,CNumbers &pNumbers)
+    {
+        mHashes[mRootIndex+pPly]=pBoard.Hash();
+        if(pPly>=cMaxPly||Repeated(pBoard,mRootIndex+pPly))
+        {
+            SetNumbers(pNumbers,cInfinite,0);
+            return false;
+        }
+        if(const CEntry *lEntry=Probe(pKey))
+        {
+            SetNumbers(pNumbers,lEntry->mProof,lEntry->mDisproof,lEntry->mDistance);
+            return true;
+        }
+        if(mDrawPlies>0&&pBoard.ReversiblePlies()>=mDrawPlies)
+        {
+            SetNumbers(pNumbers,cInfinite,0);
+            return true;
+        }
+        if(InEndgame(pBoard))
+        {
+            EEndgameValue lValue=mEndgame->Lookup(pBoard,false);
+            if(lValue==ENDGAME_WIN||lValue==ENDGAME_LOSS||lValue==ENDGAME_DRAW)
+            {
+                mEndgameHits++;
+                //the database doesn't say how long the win takes
+                if((lValue==ENDGAME_WIN)==(pBoard.Player()==mAttacker)&&lValue!=ENDGAME_DRAW)
+                    SetNumbers(pNumbers,0,cInfinite,0);
+                else
+                    SetNumbers(pNumbers,cInfinite,0);
+                return true;
+            }
+        }
+        SetNumbers(pNumbers,1,1);
+        return true;
+    }
+
+    bool InEndgame(const CBoard &pBoard) const
+    {
+        return mEndgame&&CBoard::cSquares-__builtin_popcount(pBoard.Pieces(CELL_EMPTY))<=mEndgame->MaxPieces();
+    }
+
+    //searches pBoard, at pPly from the root, until its proof number reaches
+    //pProof or its disproof number reaches pDisproof, and stores its numbers
+    void Search(const CBoard &pBoard,int pPly,uint32_t pProof,uint32_t pDisproof,CNumbers &pNumbers)
+    {
+        uint64_t lKey=Key(pBoard);
+        if(!Evaluate(pBoard,lKey,pPly,pNumbers)||pNumbers.mProof>=pProof||pNumbers.mDisproof>=pDisproof)
+            return;
+        if((++mNodes&(cTimeoutNodes-1))==0&&
+           ((mMaxNodes>0&&mNodes>=mMaxNodes)||CTime::GetCurrent()>=mDue))
+            mStop=true;
+        int64_t lNodes=mNodes;
+        bool lAttacker=(pBoard.Player()==mAttacker);
+
+        std::vector<CMove> lMoves;
+        pBoard.FindPossibleMoves(lMoves);
+        if(lMoves.empty())
+        {
+            //the player to move has lost
+            if(lAttacker)
+                SetNumbers(pNumbers,cInfinite,0);
+            else
+                SetNumbers(pNumbers,0,cInfinite,0);
+            Store(lKey,pNumbers,1);
+            return;
+        }
+
+        std::vector<CBoard> lChildren;
+        std::vector<uint64_t> lKeys;
+        lChildren.reserve(lMoves.size());
+        for(std::size_t i=0;i<lMoves.size();i++)
+        {
+            lChildren.push_back(CBoard(pBoard,lMoves[i]));
+            lKeys.push_back(Key(lChildren.back()));
+        }
+        std::vector<CNumbers> lNumbers(lMoves.size());
+
+        //the attacker needs one child proven, the other player one child
+        //disproven. Written for the attacker, with the numbers swapped for
+        //the other player
+        for(;;)
+        {
+            uint32_t lMin=cInfinite,lSecond=cInfinite,lSum=0;
+            int lBest=0;
+            for(std::size_t i=0;i<lChildren.size();i++)
+            {
+                Evaluate(lChildren[i],lKeys[i],pPly+1,lNumbers[i]);
+                uint32_t lSelect=lAttacker?lNumbers[i].mProof:lNumbers[i].mDisproof;
+                uint32_t lOther=lAttacker?lNumbers[i].mDisproof:lNumbers[i].mProof;
+                if(lSelect<lMin)
+                {
+                    lSecond=lMin;
+                    lMin=lSelect;
+                    lBest=i;
+                }
+                else if(lSelect<lSecond)
+                {
+                    lSecond=lSelect;
+                }
+                //sums of unsolved children grow fast in long endings, and
+                //stop short of the value of a solved child
+                if(lOther==cInfinite||lSum==cInfinite)
+                    lSum=cInfinite;
+                else
+                    lSum=lSum+lOther<cInfinite?lSum+lOther:cInfinite-1;
+            }
+            if(lAttacker)
+                SetNumbers(pNumbers,lMin,lSum);
+            else
+                SetNumbers(pNumbers,lSum,lMin);
+            if(pNumbers.mProof>=pProof||pNumbers.mDisproof>=pDisproof||mStop)
+                break;
+
+            uint32_t lSelectLimit=lAttacker?pProof:pDisproof;
+            uint32_t lOtherLimit=lAttacker?pDisproof:pProof;
+            const CNumbers &lChild=lNumbers[lBest];
+            uint32_t lChildOther=lAttacker?lChild.mDisproof:lChild.mProof;
+            uint32_t lChildSelect=lSecond<cInfinite&&lSecond+1<lSelectLimit?lSecond+1:lSelectLimit;
+            uint64_t lChildOtherLimit=uint64_t(lOtherLimit)-lSum+lChildOther;
+            if(lChildOtherLimit>cInfinite)
+                lChildOtherLimit=cInfinite;
+            if(lAttacker)
+                Search(lChildren[lBest],pPly+1,lChildSelect,lChildOtherLimit,lNumbers[lBest]);
+            else
+                Search(lChildren[lBest],pPly+1,lChildOtherLimit,lChildSelect,lNumbers[lBest]);
+        }
+
+        //a proven attacker takes the shortest win, the other player the longest
+        if(pNumbers.mProof==0)
+        {
+            int lDistance=lAttacker?cMaxPly:0;
+            for(std::size_t i=0;i<lNumbers.size();i++)
+            {
+                if(lNumbers[i].mProof!=0)
+                    continue;
+                if(lAttacker?lNumbers[i].mDistance<lDistance:lNumbers[i].mDistance>lDistance)
+                    lDistance=lNumbers[i].mDistance;
+            }
+            pNumbers.mDistance=lDistance+1;
+        }
+        int64_t lWork=mNodes-lNodes+1;
+        Store(lKey,pNumbers,lWork<0xffffffff?uint32_t(lWork):0xffffffff);
+    }
+
+    //follows the proven moves from the table, proving again the positions
+    //it has lost while there is time, up to the end of the game or to the
+    //database, which knows who wins but not how
+    void FindProofLine(const CBoard &pBoard)
+    {
+        CBoard lBoard(pBoard);
+        std::vector<CMove> lMoves;
+        for(int lPly=0;lPly<cMaxPly&&!InEndgame(lBoard);lPly++)
+        {
+            lBoard.FindPossibleMoves(lMoves);
+            bool lAttacker=(lBoard.Player()==mAttacker);
+            int lBest=-1,lBestDistance=0;
+            for(std::size_t i=0;i<lMoves.size();i++)
+            {
+                CBoard lChild(lBoard,lMoves[i]);
+                uint64_t lKey=Key(lChild);
+                CNumbers lNumbers;
+                bool lExact=Evaluate(lChild,lKey,lPly+1,lNumbers);
+                //the attacker only needs one of its moves
+                if(lExact&&lNumbers.mProof!=0&&lNumbers.mDisproof!=0&&!mStop&&(lBest<0||!lAttacker))
+                    Search(lChild,lPly+1,cInfinite,cInfinite,lNumbers);
+                if(lNumbers.mProof!=0)
+                {
+                    //the other player has a way out of what is known
+                    if(!lAttacker)
+                        return;
+                    continue;
+                }
+                if(lBest<0||(lAttacker?lNumbers.mDistance<lBestDistance:lNumbers.mDistance>lBestDistance))
+                {
+                    lBest=i;
+                    lBestDistance=lNumbers.mDistance;
+                }
+            }
+            if(lBest<0)
+                return;
+            mProofLine.push_back(lMoves[lBest]);
+            lBoard.DoMove(lMoves[lBest]);
+            mHashes[mRootIndex+lPly+1]=lBoard.Hash();
+        }
+    }
+
+    CLargeMemory mMemory;
+    CBucket *mEntries;
+    std::size_t mMask;
+
+    CTime mDue;
+    int64_t mMaxNodes;
+    bool mStop;
+    int mDrawPlies;
+    CEndgameCache *mEndgame;
+    ECell mAttacker;
+
+    // game positions since the last irreversible move followed by those on
+    // the path from the root, the root being at mRootIndex
+    std::vector<uint64_t> mHashes;
+    int mRootIndex;
+
+    int64_t mNodes;
+    int64_t mEndgameHits;
+    int mDistance;
+    bool mDatabaseWin;
+    std::vector<CMove> mProofLine;
+};
+
+/*namespace chk*/ }
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _CHECKERS_CRANDOM_H_
+#define _CHECKERS_CRANDOM_H_
+
+#include <stdint.h>
+
+namespace chk {
+
+///xorshift64* pseudo random numbers
+
+///Each search engine has its own, so that searches in several threads don't
+///share the state of rand(), and a fixed seed gives reproducible searches.
+class CRandom
+{
+public:
+    explicit CRandom(uint64_t pSeed=0x9e3779b97f4a7c15ULL)
+    {
+        Seed(pSeed);
+    }
+
+    ///restarts the sequence, a seed of 0 being replaced by another
+    void Seed(uint64_t pSeed)
+    {
+        mState=pSeed?pSeed:0x9e3779b97f4a7c15ULL;
+    }
+
+    uint64_t Next()
+    {
+        mState^=mState>>12;
+        mState^=mState<<25;
+        mState^=mState>>27;
+        return mState*0x2545f4914f6cdd1dULL;
+    }
+
+private:
+    uint64_t mState;
+};
+
+/*namespace chk*/ }
+
+#endif
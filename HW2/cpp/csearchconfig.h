@@ -0,0 +1,243 @@
+#ifndef _CHECKERS_CSEARCHCONFIG_H_
+#define _CHECKERS_CSEARCHCONFIG_H_
+
+#include "constants.h"
+#include <string>
+#include <sstream>
+
+namespace chk {
+
+///depths in the search are measured in fractions of a ply, so that
+///extensions can add less than a whole ply
+const int cOnePly=8;
+
+///runtime parameters of the search
+
+///Every selective search technique can be switched on and off on its own,
+///so that its effect on the depth reached per second can be measured
+///without recompiling. Settings can be given as a string of the form
+///"lmr=0 futility_margin=800" (see Parse()).
+struct CSearchConfig
+{
+    CSearchConfig()
+        :   mLateMoveReductions(true)
+        ,   mLMRMinMoves(3)
+        ,   mLMRMinDepth(3)
+        ,   mLMRReduction(1)
+        ,   mFutilityPruning(true)
+        ,   mFutilityMargin(500)
+        ,   mForcedExtension(cOnePly)
+        ,   mMultiJumpExtension(cOnePly/2)
+        ,   mPromotionExtension(cOnePly/2)
+        ,   mRunawayExtension(cOnePly/2)
+        ,   mExtensionLimit(8*cOnePly)
+        ,   mEasyMove(true)
+        ,   mEasyMoveDepth(6)
+        ,   mEasyMoveMargin(1500)
+        ,   mTransTableBits(20)
+        ,   mEvalCacheBits(16)
+        ,   mHugePages(true)
+        ,   mBatchLeaves(false)
+        ,   mDrawPlies(80)
+        ,   mMaxSearchDepth(0)
+        ,   mMTDF(false)
+        ,   mMCTS(false)
+        ,   mMCTSThreads(1)
+        ,   mMCTSNodes(1<<20)
+        ,   mMCTSExploration(100)
+        ,   mProofSearch(true)
+        ,   mProofPieces(8)
+        ,   mProofScore(1500)
+        ,   mProofTime(50)
+        ,   mProofNodes(1<<20)
+        ,   mProofTableMB(16)
+        ,   mTransStoreFile("transtable.dat")
+        ,   mTransStoreDepth(6)
+        ,   mTransStoreSize(1<<18)
+        ,   mGameRecordFile("games.pdn")
+        ,   mBookFile("book.dat")
+        ,   mBookMoves(10)
+        ,   mEndgameFile("endgame.db")
+        ,   mEndgameCacheMB(32)
+        ,   mEndgameLoadDepth(3)
+    {
+    }
+
+    bool mLateMoveReductions;   ///< reduce quiet moves that are ordered late
+    int mLMRMinMoves;           ///< moves searched to full depth before reducing
+    int mLMRMinDepth;           ///< minimum remaining depth to reduce at
+    int mLMRReduction;          ///< plies a late move is reduced by
+
+    bool mFutilityPruning;      ///< skip quiet moves at frontier nodes
+    eval_t mFutilityMargin;     ///< margin the static value needs to reach the window
+
+    //extensions, in fractions of a ply (see cOnePly)
+    int mForcedExtension;       ///< moves which are the only legal reply
+    int mMultiJumpExtension;    ///< captures of more than one piece
+    int mPromotionExtension;    ///< moves that crown a man
+    int mRunawayExtension;      ///< men moving next to the crowning row with a free square ahead
+    int mExtensionLimit;        ///< maximum total extension along one path
+
+    bool mEasyMove;             ///< stop deepening when one root move dominates
+    int mEasyMoveDepth;         ///< minimum depth completed before stopping early
+    eval_t mEasyMoveMargin;     ///< margin by which all other root moves must be worse
+
+    int mTransTableBits;        ///< the transposition table has 2^bits entries
+    int mEvalCacheBits;         ///< the evaluation cache has 2^bits entries, 0 disables it
+    bool mHugePages;            ///< ask for huge pages for the tables (see CLargeMemory)
+    bool mBatchLeaves;          ///< evaluate the children of leaf parents together, needs the evaluation cache
+
+    int mDrawPlies;             ///< plies without jumps or man moves scored as a draw, 0 disables
+
+    int mMaxSearchDepth;        ///< last iteration searched, in plies, 0 searches until the time is up
+    bool mMTDF;                 ///< search each iteration with MTD(f) rather than a full window
+
+    bool mMCTS;                 ///< play with Monte Carlo tree search instead of alpha-beta (see CMonteCarlo)
+    int mMCTSThreads;           ///< threads searching the tree
+    int mMCTSNodes;             ///< size of the tree, fixed when the player is initialized
+    int mMCTSExploration;       ///< UCT exploration constant, in hundredths
+
+    bool mProofSearch;          ///< look for a forced win with CProofSearch before searching
+    int mProofPieces;           ///< most pieces on the board to look for one
+    eval_t mProofScore;         ///< or least score of the last move, not used with mcts
+    int mProofTime;             ///< percentage of the time of the move it may take
+    int mProofNodes;            ///< and most positions it may search, 0 for no limit
+    int mProofTableMB;          ///< size of its table, fixed when the player is initialized
+
+    std::string mTransStoreFile;    ///< file search results are kept in between games, empty disables
+    int mTransStoreDepth;           ///< minimum depth in plies of the results kept
+    int mTransStoreSize;            ///< maximum number of results kept
+
+    std::string mGameRecordFile;    ///< PDN file the games played are appended to, empty disables
+    std::string mBookFile;          ///< opening book learned from the games (see COpeningBook), empty disables
+    int mBookMoves;                 ///< our first moves of each game played from and learned by the book
+
+    std::string mEndgameFile;   ///< endgame database built by egdbgen, empty disables
+    int mEndgameCacheMB;        ///< memory for the values of the endgame database
+    int mEndgameLoadDepth;      ///< minimum remaining depth in plies to read the database from disk
+
+    ///sets a single parameter from a "name=value" string
+
+    ///\return false if the name is unknown or the value can't be parsed
+    bool Set(const std::string &pSetting)
+    {
+        std::string::size_type lEq=pSetting.find('=');
+        if(lEq==std::string::npos)
+            return false;
+
+        std::string lName=pSetting.substr(0,lEq);
+        std::istringstream lValue(pSetting.substr(lEq+1));
+
+        if(lName=="lmr")
+            lValue >> mLateMoveReductions;
+        else if(lName=="lmr_moves")
+            lValue >> mLMRMinMoves;
+        else if(lName=="lmr_depth")
+            lValue >> mLMRMinDepth;
+        else if(lName=="lmr_reduction")
+            lValue >> mLMRReduction;
+        else if(lName=="futility")
+            lValue >> mFutilityPruning;
+        else if(lName=="futility_margin")
+            lValue >> mFutilityMargin;
+        else if(lName=="ext_forced")
+            lValue >> mForcedExtension;
+        else if(lName=="ext_multijump")
+            lValue >> mMultiJumpExtension;
+        else if(lName=="ext_promotion")
+            lValue >> mPromotionExtension;
+        else if(lName=="ext_runaway")
+            lValue >> mRunawayExtension;
+        else if(lName=="ext_limit")
+            lValue >> mExtensionLimit;
+        else if(lName=="easy")
+            lValue >> mEasyMove;
+        else if(lName=="easy_depth")
+            lValue >> mEasyMoveDepth;
+        else if(lName=="easy_margin")
+            lValue >> mEasyMoveMargin;
+        else if(lName=="tt_bits")
+            lValue >> mTransTableBits;
+        else if(lName=="eval_bits")
+            lValue >> mEvalCacheBits;
+        else if(lName=="huge_pages")
+            lValue >> mHugePages;
+        else if(lName=="batch")
+            lValue >> mBatchLeaves;
+        else if(lName=="draw_plies")
+            lValue >> mDrawPlies;
+        else if(lName=="max_depth")
+            lValue >> mMaxSearchDepth;
+        else if(lName=="mtdf")
+            lValue >> mMTDF;
+        else if(lName=="mcts")
+            lValue >> mMCTS;
+        else if(lName=="mcts_threads")
+            lValue >> mMCTSThreads;
+        else if(lName=="mcts_nodes")
+            lValue >> mMCTSNodes;
+        else if(lName=="mcts_c")
+            lValue >> mMCTSExploration;
+        else if(lName=="pns")
+            lValue >> mProofSearch;
+        else if(lName=="pns_pieces")
+            lValue >> mProofPieces;
+        else if(lName=="pns_score")
+            lValue >> mProofScore;
+        else if(lName=="pns_time")
+            lValue >> mProofTime;
+        else if(lName=="pns_nodes")
+            lValue >> mProofNodes;
+        else if(lName=="pns_mb")
+            lValue >> mProofTableMB;
+        else if(lName=="tt_file")
+            mTransStoreFile=pSetting.substr(lEq+1);
+        else if(lName=="pdn_file")
+            mGameRecordFile=pSetting.substr(lEq+1);
+        else if(lName=="book_file")
+            mBookFile=pSetting.substr(lEq+1);
+        else if(lName=="book_moves")
+            lValue >> mBookMoves;
+        else if(lName=="egdb_file")
+            mEndgameFile=pSetting.substr(lEq+1);
+        else if(lName=="egdb_cache_mb")
+            lValue >> mEndgameCacheMB;
+        else if(lName=="egdb_load_depth")
+            lValue >> mEndgameLoadDepth;
+        else if(lName=="tt_store_depth")
+            lValue >> mTransStoreDepth;
+        else if(lName=="tt_store_size")
+            lValue >> mTransStoreSize;
+        else
+            return false;
+
+        return !lValue.fail();
+    }
+
+    ///sets several parameters, separated by spaces or commas
+
+    ///\return false if any of the settings was rejected by Set()
+    bool Parse(const std::string &pSettings)
+    {
+        std::string lSettings(pSettings);
+        for(std::string::size_type i=0;i<lSettings.size();i++)
+        {
+            if(lSettings[i]==',')
+                lSettings[i]=' ';
+        }
+
+        std::istringstream lStream(lSettings);
+        std::string lSetting;
+        bool lOk=true;
+        while(lStream >> lSetting)
+        {
+            if(!Set(lSetting))
+                lOk=false;
+        }
+        return lOk;
+    }
+};
+
+/*namespace chk*/ }
+
+#endif
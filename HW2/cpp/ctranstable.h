@@ -0,0 +1,202 @@
+#ifndef _CHECKERS_CTRANSTABLE_H_
+#define _CHECKERS_CTRANSTABLE_H_
+
+#include "constants.h"
+#include "cmove.h"
+#include "clargememory.h"
+#include <stdint.h>
+#include <cstring>
+#include <cstddef>
+
+namespace chk {
+
+///kind of score stored in the transposition table
+enum EBound
+{
+    BOUND_NONE=0,       ///< the entry is empty
+    BOUND_UPPER=1,      ///< the node failed low, the score is an upper bound
+    BOUND_LOWER=2,      ///< the node failed high, the score is a lower bound
+    BOUND_EXACT=3       ///< the score is exact
+};
+
+///an entry of the transposition table
+struct CTransEntry
+{
+    uint64_t mKey;      ///< hash of the position (see CBoard::CanonicalHash())
+    int16_t mScore;     ///< score for the player to move, with wins relative to this position
+    int16_t mDepth;     ///< remaining depth of the search, in fractions of a ply
+    uint16_t mMove;     ///< best move, as returned by MoveKey()
+    uint8_t mBound;     ///< one of EBound
+    uint8_t mPad;
+};
+
+///direct mapped table of search results, indexed by position hash
+class CTransTable
+{
+public:
+    CTransTable()
+        :   mEntries(NULL)
+        ,   mMask(0)
+    {
+    }
+
+    ///allocates 2^\p pBits empty entries, dropping the current contents
+
+    ///The memory comes zeroed from the system, its pages are only mapped
+    ///when first written, or by Prefault().
+    ///\param pHuge ask for huge pages (see CLargeMemory)
+    void Resize(int pBits,bool pHuge=true)
+    {
+        mMask=(uint64_t(1)<<pBits)-1;
+        mMemory.Allocate(sizeof(CTransEntry)*(mMask+1),pHuge);
+        mEntries=(CTransEntry*)mMemory.Data();
+    }
+
+    ///maps every page of the table, safe while another thread uses it
+    ///(see CLargeMemory::Prefault())
+    void Prefault()
+    {
+        mMemory.Prefault();
+    }
+
+    ///size of the pages of the table (see CLargeMemory::PageSize())
+    std::size_t PageSize() const
+    {
+        return mMemory.PageSize();
+    }
+
+    ///empties the table
+    void Clear()
+    {
+        if(mEntries)
+            memset(mEntries,0,sizeof(CTransEntry)*(mMask+1));
+    }
+
+    ///returns the number of entries
+    std::size_t Size() const
+    {
+        return mEntries?mMask+1:0;
+    }
+
+    ///returns the entry stored for \p pKey, or NULL if there is none
+    const CTransEntry *Probe(uint64_t pKey) const
+    {
+        if(!mEntries)
+            return NULL;
+
+        const CTransEntry &lEntry=mEntries[pKey&mMask];
+        if(lEntry.mBound==BOUND_NONE||lEntry.mKey!=pKey)
+            return NULL;
+        return &lEntry;
+    }
+
+    ///stores a search result
+
+    ///A result for the same position searched deeper is not overwritten,
+    ///results for other positions always are.
+    ///
+    ///\param pKey hash of the position
+    ///\param pScore score, already converted with ScoreToTT()
+    ///\param pDepth remaining depth of the search
+    ///\param pBound what kind of bound \p pScore is
+    ///\param pMove best move found, as returned by MoveKey()
+    void Store(uint64_t pKey,eval_t pScore,int pDepth,EBound pBound,uint16_t pMove)
+    {
+        if(!mEntries)
+            return;
+
+        CTransEntry &lEntry=mEntries[pKey&mMask];
+        if(lEntry.mBound!=BOUND_NONE&&lEntry.mKey==pKey&&lEntry.mDepth>pDepth)
+            return;
+
+        lEntry.mKey=pKey;
+        lEntry.mScore=pScore;
+        lEntry.mDepth=pDepth;
+        lEntry.mMove=pMove;
+        lEntry.mBound=pBound;
+    }
+
+    ///returns the \p pIndex-th entry, which may be empty
+    const CTransEntry &At(std::size_t pIndex) const
+    {
+        return mEntries[pIndex];
+    }
+
+    ///stores an entry read back from disk (see CTransStore)
+
+    ///It doesn't replace an entry searched deeper, whatever position it holds.
+    void Seed(const CTransEntry &pEntry)
+    {
+        if(!mEntries)
+            return;
+
+        CTransEntry &lEntry=mEntries[pEntry.mKey&mMask];
+        if(lEntry.mBound!=BOUND_NONE&&lEntry.mDepth>=pEntry.mDepth)
+            return;
+        lEntry=pEntry;
+    }
+
+    ///converts a score relative to the root into one relative to the
+    ///position at distance \p pPly from the root
+
+    ///Wins and losses are stored as the distance from the stored position,
+    ///so that the entry stays valid when the position is reached by a
+    ///path of different length.
+    static eval_t ScoreToTT(eval_t pScore,int pPly)
+    {
+        if(pScore>cWinBound)
+            return pScore+pPly;
+        if(pScore<-cWinBound)
+            return pScore-pPly;
+        return pScore;
+    }
+
+    ///inverse of ScoreToTT()
+    static eval_t ScoreFromTT(eval_t pScore,int pPly)
+    {
+        if(pScore>cWinBound)
+            return pScore-pPly;
+        if(pScore<-cWinBound)
+            return pScore+pPly;
+        return pScore;
+    }
+
+    ///returns a compact representation of a move
+
+    ///It only contains the source and destination squares, which is enough
+    ///to find the move again among the moves of the position, except for
+    ///rare multiple jumps which only differ in the path they take.
+    static uint16_t MoveKey(const CMove &pMove)
+    {
+        if(pMove.IsNull())
+            return 0;
+        return 0x8000|(pMove[0]<<5)|pMove[pMove.Length()-1];
+    }
+
+    ///returns the key of the move after CMove::Invert()
+    static uint16_t InvertMoveKey(uint16_t pMove)
+    {
+        if(pMove==0)
+            return 0;
+        return 0x8000|((31-((pMove>>5)&31))<<5)|(31-(pMove&31));
+    }
+
+    ///returns the bound of a score after changing its sign
+    static EBound InvertBound(EBound pBound)
+    {
+        if(pBound==BOUND_UPPER)
+            return BOUND_LOWER;
+        if(pBound==BOUND_LOWER)
+            return BOUND_UPPER;
+        return pBound;
+    }
+
+private:
+    CLargeMemory mMemory;
+    CTransEntry *mEntries;
+    uint64_t mMask;
+};
+
+/*namespace chk*/ }
+
+#endif
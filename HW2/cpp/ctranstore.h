@@ -0,0 +1,190 @@
+#ifndef _CHECKERS_CTRANSTORE_H_
+#define _CHECKERS_CTRANSTORE_H_
+
+#include "constants.h"
+#include "evalweights.h"
+#include "ctranstable.h"
+#include "ctime.h"
+#include "cfilelock.h"
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace chk {
+
+///search results kept on disk between games
+
+///The file starts with a header identifying the format and the evaluation
+///weights the scores were computed with, followed by the entries in native
+///byte order, deepest first. Files written with other weights are ignored,
+///since their scores don't fit the current evaluation.
+///
+///The entries are those of the transposition table, keyed by
+///CBoard::CanonicalHash(), so that a position searched while playing one
+///colour is found again when its mirror comes up playing the other.
+class CTransStore
+{
+public:
+    ///reads the entries of \p pFile, stopping at \p pDue if given
+
+    ///The entries read are added to those already in the store.
+    ///\return false if the file doesn't exist or has the wrong format
+    bool Load(const std::string &pFile,const CTime *pDue=NULL)
+    {
+        FILE *lFile=fopen(pFile.c_str(),"rb");
+        if(!lFile)
+            return false;
+
+        CHeader lHeader;
+        bool lOk=fread(&lHeader,sizeof(lHeader),1,lFile)==1&&lHeader==CHeader();
+        if(lOk)
+        {
+            CTransEntry lEntries[cChunk];
+            size_t lRead;
+            while((!pDue||CTime::GetCurrent()<*pDue)&&(lRead=fread(lEntries,sizeof(CTransEntry),cChunk,lFile))>0)
+                mEntries.insert(mEntries.end(),lEntries,lEntries+lRead);
+        }
+        fclose(lFile);
+        return lOk;
+    }
+
+    ///writes the entries to \p pFile
+
+    ///The file is written under a temporary name first and then renamed,
+    ///so that it is never seen half written. Writers sharing a file have to
+    ///hold its lock, see Update().
+    bool Save(const std::string &pFile) const
+    {
+        std::string lTemp=CFileLock::TempName(pFile);
+        FILE *lFile=fopen(lTemp.c_str(),"wb");
+        if(!lFile)
+            return false;
+
+        CHeader lHeader;
+        bool lOk=fwrite(&lHeader,sizeof(lHeader),1,lFile)==1;
+        if(lOk&&!mEntries.empty())
+            lOk=fwrite(&mEntries[0],sizeof(CTransEntry),mEntries.size(),lFile)==mEntries.size();
+        lOk=(fclose(lFile)==0)&&lOk;
+        if(lOk)
+            lOk=rename(lTemp.c_str(),pFile.c_str())==0;
+        if(!lOk)
+            remove(lTemp.c_str());
+        return lOk;
+    }
+
+    ///adds the entries of \p pChanges to those in \p pFile, keeping at most \p pMaxEntries
+
+    ///The file is locked, read again, compacted and replaced, so that the
+    ///results stored meanwhile by other clients are kept.
+    ///\param pSize set to the entries of the file written, if given
+    static bool Update(const std::string &pFile,const CTransStore &pChanges,std::size_t pMaxEntries,std::size_t *pSize=NULL)
+    {
+        CFileLock lLock(pFile);
+        if(!lLock.Locked())
+            return false;
+
+        CTransStore lStore;
+        lStore.Load(pFile);
+        lStore.Add(pChanges);
+        lStore.Compact(pMaxEntries);
+        if(pSize)
+            *pSize=lStore.Size();
+        return lStore.Save(pFile);
+    }
+
+    ///adds the entries of \p pTable searched to at least \p pMinDepth
+    void Add(const CTransTable &pTable,int pMinDepth)
+    {
+        for(std::size_t i=0;i<pTable.Size();i++)
+        {
+            const CTransEntry &lEntry=pTable.At(i);
+            if(lEntry.mBound!=BOUND_NONE&&lEntry.mDepth>=pMinDepth)
+                mEntries.push_back(lEntry);
+        }
+    }
+
+    ///adds the entries of another store
+    void Add(const CTransStore &pStore)
+    {
+        mEntries.insert(mEntries.end(),pStore.mEntries.begin(),pStore.mEntries.end());
+    }
+
+    ///keeps only the deepest entry of each position, and at most the
+    ///\p pMaxEntries deepest entries overall, sorted deepest first
+    void Compact(std::size_t pMaxEntries)
+    {
+        std::sort(mEntries.begin(),mEntries.end(),CompareKeys);
+        mEntries.erase(std::unique(mEntries.begin(),mEntries.end(),SameKey),mEntries.end());
+        std::stable_sort(mEntries.begin(),mEntries.end(),CompareDepths);
+        if(mEntries.size()>pMaxEntries)
+            mEntries.resize(pMaxEntries);
+    }
+
+    ///copies the entries into \p pTable, as long as there is time before \p pDue
+    void Fill(CTransTable &pTable,const CTime *pDue=NULL) const
+    {
+        for(std::size_t i=0;i<mEntries.size();i++)
+        {
+            if(pDue&&i%cChunk==0&&CTime::GetCurrent()>=*pDue)
+                break;
+            pTable.Seed(mEntries[i]);
+        }
+    }
+
+    std::size_t Size() const
+    {
+        return mEntries.size();
+    }
+
+private:
+    static const std::size_t cChunk=4096;   ///< entries read at once
+
+    struct CHeader
+    {
+        CHeader()
+            :   mVersion(2)
+        {
+            memcpy(mMagic,"CHKT",4);
+            mWeights[0]=EVAL_PAWN_SCORE;
+            mWeights[1]=EVAL_KING_SCORE;
+            mWeights[2]=EVAL_KING_SIDE;
+            mWeights[3]=EVAL_PAWN_POS;
+        }
+
+        bool operator==(const CHeader &pRH) const
+        {
+            return memcmp(this,&pRH,sizeof(CHeader))==0;
+        }
+
+        char mMagic[4];
+        uint32_t mVersion;
+        int32_t mWeights[4];
+    };
+
+    //by key, deepest first
+    static bool CompareKeys(const CTransEntry &pLH,const CTransEntry &pRH)
+    {
+        if(pLH.mKey!=pRH.mKey)
+            return pLH.mKey<pRH.mKey;
+        return pLH.mDepth>pRH.mDepth;
+    }
+
+    static bool SameKey(const CTransEntry &pLH,const CTransEntry &pRH)
+    {
+        return pLH.mKey==pRH.mKey;
+    }
+
+    static bool CompareDepths(const CTransEntry &pLH,const CTransEntry &pRH)
+    {
+        return pLH.mDepth>pRH.mDepth;
+    }
+
+    std::vector<CTransEntry> mEntries;
+};
+
+/*namespace chk*/ }
+
+#endif
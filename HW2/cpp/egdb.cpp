@@ -0,0 +1,221 @@
+#include "egdb.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "cboard.h"
+#include "cendgame.h"
+#include "cendgamecache.h"
+
+using namespace chk;
+
+unsigned short egdb_reverse_nibble_table[0x10000];
+unsigned short egdb_reverse_int_table[0x10000];
+char egdb_bitcount_table[0x10000];
+
+namespace
+{
+
+const char *cFileName = "endgame.db";
+
+// state of an open driver, its internal_data
+struct CDriverData
+{
+	CEndgameCache mCache;
+	EGDB_BITMAP_TYPE mBitmapType;
+	void (*mMessage)(char *);
+	EGDB_STATS mStats;
+};
+
+// fills the tables of egdb.h when the program starts
+struct CTables
+{
+	CTables()
+	{
+		for(int n = 0; n < 0x10000; ++n) {
+			unsigned short nibbles = 0, reversed = 0;
+			for(int i = 0; i < 16; ++i) {
+				if (n & (1 << i)) {
+					nibbles |= 1 << ((i & ~3) + 3 - (i & 3));
+					reversed |= 1 << (15 - i);
+				}
+			}
+			egdb_reverse_nibble_table[n] = nibbles;
+			egdb_reverse_int_table[n] = reversed;
+			egdb_bitcount_table[n] = __builtin_popcount(n);
+		}
+	}
+} sTables;
+
+void Message(CDriverData *data, const std::string &msg)
+{
+	if (data->mMessage) {
+		std::vector<char> buffer(msg.begin(), msg.end());
+		buffer.push_back('\0');
+		data->mMessage(&buffer[0]);
+	}
+}
+
+std::string FilePath(const char *directory)
+{
+	std::string path = directory ? directory : "";
+	if (!path.empty() && path[path.size() - 1] != '/')
+		path += '/';
+	return path + cFileName;
+}
+
+unsigned int ReverseNibbles(unsigned int bits)
+{
+	return egdb_reverse_nibble_table[bits & 0xFFFF] | (egdb_reverse_nibble_table[bits >> 16] << 16);
+}
+
+// the pieces of a position seen by the side to move (see CEndgameDB::Pieces())
+void Pieces(const EGDB_NORMAL_BITMAP &pos, int color, uint32_t pieces[4])
+{
+	uint32_t black[2] = { pos.black & ~pos.king, pos.black & pos.king };
+	uint32_t white[2] = { pos.white & ~pos.king, pos.white & pos.king };
+	for(int i = 0; i < 2; ++i) {
+		if (color == EGDB_BLACK) {
+			pieces[i] = black[i];
+			pieces[i + 2] = white[i];
+		} else {
+			pieces[i] = CEndgameDB::Reverse(white[i]);
+			pieces[i + 2] = CEndgameDB::Reverse(black[i]);
+		}
+	}
+}
+
+int Lookup(EGDB_DRIVER *handle, EGDB_BITMAP *position, int color, int cl)
+{
+	CDriverData *data = (CDriverData *)handle->internal_data;
+	EGDB_NORMAL_BITMAP pos = position->normal;
+	if (data->mBitmapType == EGDB_ROW_REVERSED) {
+		const EGDB_ROW_REVERSED_BITMAP &rr = position->row_reversed;
+		pos.black = ReverseNibbles(rr.black_man | rr.black_king);
+		pos.white = ReverseNibbles(rr.white_man | rr.white_king);
+		pos.king = ReverseNibbles(rr.black_king | rr.white_king);
+	}
+
+	uint32_t pieces[4];
+	Pieces(pos, color, pieces);
+	EEndgameValue value = data->mCache.Lookup(pieces, cl != 0);
+	return value == ENDGAME_NOT_CACHED ? EGDB_NOT_IN_CACHE : int(value);
+}
+
+void ResetStats(EGDB_DRIVER *handle)
+{
+	CDriverData *data = (CDriverData *)handle->internal_data;
+	data->mCache.ResetStats();
+}
+
+EGDB_STATS *GetStats(EGDB_DRIVER *handle)
+{
+	CDriverData *data = (CDriverData *)handle->internal_data;
+	const CEndgameCache::CStats &stats = data->mCache.Stats();
+	data->mStats.lru_cache_hits = stats.mCacheHits;
+	data->mStats.lru_cache_loads = stats.mCacheLoads;
+	data->mStats.autoload_hits = stats.mAutoloadHits;
+	data->mStats.db_requests = stats.mRequests;
+	data->mStats.db_returns = stats.mReturns;
+	data->mStats.db_not_present_requests = stats.mNotPresent;
+	return &data->mStats;
+}
+
+int Verify(EGDB_DRIVER *handle)
+{
+	CDriverData *data = (CDriverData *)handle->internal_data;
+	std::vector<CEndgameMaterial> bad;
+	int errors = data->mCache.Verify(&bad);
+	for(size_t i = 0; i < bad.size(); ++i) {
+		char msg[100];
+		sprintf(msg, "bad checksum of slice %d %d %d %d\n", bad[i].mOwnMen, bad[i].mOwnKings,
+				bad[i].mOtherMen, bad[i].mOtherKings);
+		Message(data, msg);
+	}
+	return errors;
+}
+
+int Close(EGDB_DRIVER *handle)
+{
+	delete (CDriverData *)handle->internal_data;
+	delete handle;
+	return 0;
+}
+
+}
+
+EGDB_DRIVER *egdb_open(EGDB_BITMAP_TYPE bitmap_type, int pieces, int cache_mb, char *directory,
+		void (*msg_fn)(char *))
+{
+	CDriverData *data = new CDriverData;
+	data->mBitmapType = bitmap_type;
+	data->mMessage = msg_fn;
+	memset(&data->mStats, 0, sizeof(data->mStats));
+
+	std::string file = FilePath(directory);
+	char msg[300];
+	if (!data->mCache.Open(file, cache_mb, pieces)) {
+		snprintf(msg, sizeof(msg), "can't open %s for %d pieces\n", file.c_str(), pieces);
+		Message(data, msg);
+		delete data;
+		return NULL;
+	}
+	snprintf(msg, sizeof(msg), "opened %s for %d pieces, %llu KB autoloaded, %llu KB of cache blocks\n",
+			file.c_str(), data->mCache.MaxPieces(),
+			(unsigned long long)data->mCache.AutoloadBytes() / 1024,
+			(unsigned long long)(data->mCache.Bytes() - data->mCache.AutoloadBytes()) / 1024);
+	Message(data, msg);
+
+	EGDB_DRIVER *handle = new EGDB_DRIVER;
+	handle->lookup = Lookup;
+	handle->reset_stats = ResetStats;
+	handle->get_stats = GetStats;
+	handle->verify = Verify;
+	handle->close = Close;
+	handle->internal_data = data;
+	return handle;
+}
+
+int egdb_identify(char *directory, EGDB_TYPE *egdb_type, int *max_pieces)
+{
+	CEndgameDB table;
+	if (!table.OpenTable(FilePath(directory)))
+		return 1;
+	*egdb_type = EGDB_CHK_WLD;
+	*max_pieces = table.MaxPieces();
+	return 0;
+}
+
+void egdb_indextoposition(int64_t index, EGDB_NORMAL_BITMAP *pos, int nbm, int nbk, int nwm, int nwk)
+{
+	CBoard board;
+	pos->black = pos->white = pos->king = 0;
+	if (!CEndgameIndex(CEndgameMaterial(nbm, nbk, nwm, nwk)).Position(index, board))
+		return;
+	pos->black = board.Pieces(CELL_OWN) | board.Pieces(CELL_OWN | CELL_KING);
+	pos->white = board.Pieces(CELL_OTHER) | board.Pieces(CELL_OTHER | CELL_KING);
+	pos->king = board.Pieces(CELL_OWN | CELL_KING) | board.Pieces(CELL_OTHER | CELL_KING);
+}
+
+int64_t egdb_index_range(int nbm, int nbk, int nwm, int nwk)
+{
+	return CEndgameIndex(CEndgameMaterial(nbm, nbk, nwm, nwk)).Size();
+}
+
+int egdb_iscapture(EGDB_NORMAL_BITMAP *board, int color)
+{
+	uint32_t pieces[4];
+	Pieces(*board, color, pieces);
+	CBoard position(false, CELL_OWN);
+	const uint8_t cells[4] = { CELL_OWN, CELL_OWN | CELL_KING, CELL_OTHER, CELL_OTHER | CELL_KING };
+	for(int i = 0; i < 4; ++i) {
+		for(uint32_t bits = pieces[i]; bits; bits &= bits - 1)
+			position.Set(__builtin_ctz(bits), cells[i]);
+	}
+	std::vector<CMove> moves;
+	position.FindPossibleMoves(moves);
+	return !moves.empty() && moves[0].IsJump();
+}
@@ -0,0 +1,161 @@
+/*
+ * egdb.h
+ *
+ * The endgame database driver interface of Ed Gilbert's egdb library (see
+ * material/databases/egdb/egdb.h for its full description), implemented in
+ * egdb.cpp for the win/loss/draw databases built by egdbgen, which are read
+ * through CEndgameCache.
+ *
+ * Differences to the original library:
+ *
+ *  - There is one database type, EGDB_CHK_WLD, stored in the file
+ *    "endgame.db" of the directory given to egdb_open() and egdb_identify().
+ *  - cache_mb is all the memory used for values. The smallest slices are
+ *    loaded whole ("autoload") while they fit in a quarter of it, or all
+ *    of them if the database fits, the rest is a cache of 4 KB blocks
+ *    replaced least recently used first.
+ *  - The values of positions with captures are correct, there is no need
+ *    to avoid looking them up.
+ *  - verify() compares the CRC-32 of every slice with the one stored in
+ *    the file by egdbgen.
+ *  - Indices of egdb_indextoposition() with men of both colours on the same
+ *    square are not positions, and give an empty board.
+ */
+
+#ifndef _CHECKERS_EGDB_H_
+#define _CHECKERS_EGDB_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Color definitions. */
+#define EGDB_BLACK 0
+#define EGDB_WHITE 1
+
+/* Values returned by handle->lookup(). */
+#define EGDB_UNKNOWN 0			/* value not in the database. */
+#define EGDB_WIN 1
+#define EGDB_LOSS 2
+#define EGDB_DRAW 3
+#define EGDB_DRAW_OR_LOSS 4
+#define EGDB_WIN_OR_DRAW 5
+
+#define EGDB_NOT_IN_CACHE -1		/* conditional lookup and position not in cache. */
+
+/* MTC macros. */
+#define MTC_THRESHOLD 10
+#define MTC_LESS_THAN_THRESHOLD 1
+#define MTC_UNKNOWN 0
+
+typedef enum {
+	EGDB_KINGSROW_WLD = 0,			/* this type is now obsolete. */
+	EGDB_KINGSROW_MTC,				/* this type is now obsolete. */
+	EGDB_CAKE_WLD,
+	EGDB_CHINOOK_WLD,
+	EGDB_KINGSROW32_WLD,
+	EGDB_KINGSROW32_MTC,
+	EGDB_CHINOOK_ITALIAN_WLD,
+	EGDB_KINGSROW32_ITALIAN_WLD,
+	EGDB_KINGSROW32_ITALIAN_MTC,
+	EGDB_CHK_WLD					/* built by egdbgen, the only type of this driver. */
+} EGDB_TYPE;
+
+typedef enum {
+	EGDB_NORMAL = 0,
+	EGDB_ROW_REVERSED
+} EGDB_BITMAP_TYPE;
+
+/* for database lookup stats. */
+typedef struct {
+	unsigned int lru_cache_hits;
+	unsigned int lru_cache_loads;
+	unsigned int autoload_hits;
+	unsigned int db_requests;				/* total egdb requests. */
+	unsigned int db_returns;				/* total egdb w/l/d returns. */
+	unsigned int db_not_present_requests;	/* requests for positions not in the db */
+} EGDB_STATS;
+
+/* KingsRow's definition of a checkers position: bit0 for square 1, bit1 for
+ * square 2, ...
+ */
+typedef struct {
+	unsigned int black;
+	unsigned int white;
+	unsigned int king;
+} EGDB_NORMAL_BITMAP;
+
+/* Cake's definition of a board position: bit3 for square 1, bit2 for
+ * square 2, ..., repeated on each row of squares.
+ */
+typedef struct {
+	unsigned int black_man;
+	unsigned int black_king;
+	unsigned int white_man;
+	unsigned int white_king;
+} EGDB_ROW_REVERSED_BITMAP;
+
+typedef union {
+	EGDB_NORMAL_BITMAP normal;
+	EGDB_ROW_REVERSED_BITMAP row_reversed;
+} EGDB_BITMAP;
+
+/* The driver handle type */
+typedef struct egdb_driver {
+	int (*lookup)(struct egdb_driver *handle, EGDB_BITMAP *position, int color, int cl);
+	void (*reset_stats)(struct egdb_driver *handle);
+	EGDB_STATS *(*get_stats)(struct egdb_driver *handle);
+	int (*verify)(struct egdb_driver *handle);
+	int (*close)(struct egdb_driver *handle);
+	void *internal_data;
+} EGDB_DRIVER;
+
+/* Open an endgame database driver. */
+EGDB_DRIVER *egdb_open(EGDB_BITMAP_TYPE bitmap_type,
+						int pieces,
+						int cache_mb,
+						char *directory,
+						void (*msg_fn)(char *));
+
+/*
+ * Identify which type of database is present, and the maximum number of pieces
+ * for which it has data. Returns 0 if a database is found.
+ */
+int egdb_identify(char *directory, EGDB_TYPE *egdb_type, int *max_pieces);
+
+/*
+ * Returns the board position that corresponds to an index number of the
+ * slice with nbm black men, nbk black kings, nwm white men and nwk white
+ * kings, black to move.
+ */
+void egdb_indextoposition(int64_t index, EGDB_NORMAL_BITMAP *pos,
+						  int nbm, int nbk, int nwm, int nwk);
+
+/*
+ * Return the total number of indices of a slice.
+ */
+int64_t egdb_index_range(int nbm, int nbk, int nwm, int nwk);
+
+/*
+ * Return true if the position has a capture move when it is color's
+ * turn to move.
+ */
+int egdb_iscapture(EGDB_NORMAL_BITMAP *board, int color);
+
+/*
+ * egdb_reverse_nibble_table[n] has every ith bit in each nibble of n
+ * exchanged with bit (3-i), to convert between normal and row-reversed
+ * bitmaps. egdb_reverse_int_table[n] has every ith bit of n exchanged with
+ * bit (15-i). egdb_bitcount_table[n] is the number of bits set in n.
+ */
+extern unsigned short egdb_reverse_nibble_table[0x10000];
+extern unsigned short egdb_reverse_int_table[0x10000];
+extern char egdb_bitcount_table[0x10000];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
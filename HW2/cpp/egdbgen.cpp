@@ -0,0 +1,430 @@
+/*
+ * egdbgen.cpp
+ *
+ * Builds the win/loss/draw endgame database read by CEndgameDB, and checks
+ * a database built before.
+ *
+ *   egdbgen [-t threads] [-p pieces] -o file
+ *   egdbgen verify [-t threads] file
+ *
+ * The database is split into slices, one for every material with CELL_OWN
+ * to move. Captures lead to slices with fewer pieces and promotions to
+ * slices with fewer men, so that the slices are solved in levels of the
+ * same number of pieces and men, fewest first. The only moves within a
+ * level are the other moves, and they lead from a slice to its mirror
+ * (see CEndgameMaterial::Mirror()).
+ *
+ * A level is solved by retrograde analysis: a first pass looks at every
+ * position and decides those whose moves all lead to known positions. Then
+ * the predecessors of the positions decided in a round are looked at in the
+ * next one, until nothing changes. Positions left undecided are draws. Both
+ * the first pass and the rounds are shared by the threads in chunks.
+ *
+ * The whole database is kept in memory while it is built. 5 pieces (36 MB)
+ * build in about 10 minutes on one core with a peak of 50 MB and verify
+ * clean. Larger sizes are untested: 6 pieces make a file of 648 MB and 7
+ * of 9.5 GB.
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "cboard.h"
+#include "cendgame.h"
+#include "ctime.h"
+
+using namespace std;
+using namespace chk;
+
+// a piece of a slice, the unit of work of a thread
+struct CChunk
+{
+	int mSlice;
+	uint64_t mBegin;
+	uint64_t mEnd;
+	uint64_t mLevelBegin;       // position of mBegin in the level
+};
+
+// the slices with the same number of pieces and men, solved together
+struct CLevel
+{
+	vector<int> mSlices;
+	vector<CChunk> mChunks;
+	uint64_t mSize;
+};
+
+// the state shared by the threads
+struct CWork
+{
+	CEndgameDB *mDB;
+	const CLevel *mLevel;
+	vector<int64_t> mLevelStart;    // of every slice in the level, -1 for other slices
+	vector<uint64_t> mFrontier;     // positions decided in the last round
+	vector<uint64_t> mNext;         // positions decided in this round
+	int mNextChunk;
+	bool mFirstPass;
+	bool mVerify;
+};
+
+// the work done by one thread
+struct CTask
+{
+	CWork *mWork;
+	uint64_t mDecided;
+	uint64_t mErrors;
+	pthread_t mThread;
+};
+
+static const uint64_t cChunkSize = 1 << 16;
+
+// the value of pBoard (CELL_OWN to move) found from its moves, as far as
+// the values of the positions after them are known
+static EEndgameValue Evaluate(const CEndgameDB &pDB, const CBoard &pBoard, vector<CMove> &pMoves)
+{
+	pBoard.FindPossibleMoves(pMoves);
+	if (pMoves.empty())
+		return ENDGAME_LOSS;
+
+	bool lAllWins = true;
+	for(size_t i = 0; i < pMoves.size(); ++i) {
+		EEndgameValue lValue = pDB.Lookup(CBoard(pBoard, pMoves[i]));
+		if (lValue == ENDGAME_LOSS)
+			return ENDGAME_WIN;
+		if (lValue != ENDGAME_WIN)
+			lAllWins = false;
+	}
+	return lAllWins ? ENDGAME_LOSS : ENDGAME_UNKNOWN;
+}
+
+// decides pBoard if its moves allow it, and marks it for the next round
+static bool Decide(CWork &pWork, const CBoard &pBoard, int pSlice, uint64_t pIndex,
+		EEndgameValue pValue, vector<CMove> &pMoves)
+{
+	uint8_t *lValues = pWork.mDB->SliceValues(pSlice);
+	if (CEndgameDB::Get(lValues, pIndex) != ENDGAME_UNKNOWN)
+		return false;
+	if (pValue == ENDGAME_UNKNOWN)
+		pValue = Evaluate(*pWork.mDB, pBoard, pMoves);
+	if (pValue == ENDGAME_UNKNOWN || !CEndgameDB::Set(lValues, pIndex, pValue))
+		return false;
+
+	uint64_t lBit = pWork.mLevelStart[pSlice] + pIndex;
+	__sync_fetch_and_or(&pWork.mNext[lBit >> 6], uint64_t(1) << (lBit & 63));
+	return true;
+}
+
+// looks at the positions from which a move of the other player leads to
+// pBoard, which has just been decided. The other moves never change the
+// level, so that the predecessors are in the level.
+static uint64_t Predecessors(CWork &pWork, const CBoard &pBoard, EEndgameValue pValue, vector<CMove> &pMoves)
+{
+	CBoard lAfter(pBoard);
+	lAfter.Invert();
+	uint64_t lDecided = 0;
+
+	for(int lCell = 0; lCell < CBoard::cSquares; ++lCell) {
+		uint8_t lPiece = lAfter.At(lCell);
+		if (!(lPiece & CELL_OWN))
+			continue;
+
+		int lR = CBoard::CellToRow(lCell);
+		int lC = CBoard::CellToCol(lCell);
+		for(int lDR = -1; lDR <= 1; lDR += 2) {
+			// men only move forward
+			if (lDR > 0 && !(lPiece & CELL_KING))
+				continue;
+			for(int lDC = -1; lDC <= 1; lDC += 2) {
+				if (lAfter.At(lR + lDR, lC + lDC) != CELL_EMPTY)
+					continue;
+
+				CBoard lBefore(lAfter);
+				lBefore.Set(lCell, CELL_EMPTY);
+				lBefore.Set(CBoard::RowColToCell(lR + lDR, lC + lDC), lPiece);
+				lBefore.SetPlayer(CELL_OWN);
+				// the move wasn't allowed if there was a jump
+				lBefore.FindPossibleMoves(pMoves);
+				if (pMoves[0].IsJump())
+					continue;
+
+				int lSlice;
+				uint64_t lIndex;
+				if (!pWork.mDB->Locate(lBefore, lSlice, lIndex))
+					continue;
+				// a move to a lost position wins, a move to a won one only
+				// loses if all other moves do as well
+				if (Decide(pWork, lBefore, lSlice, lIndex,
+						pValue == ENDGAME_LOSS ? ENDGAME_WIN : ENDGAME_UNKNOWN, pMoves))
+					++lDecided;
+			}
+		}
+	}
+	return lDecided;
+}
+
+// checks that a value agrees with the values after each move
+static bool Check(const CEndgameDB &pDB, const CBoard &pBoard, EEndgameValue pValue, vector<CMove> &pMoves)
+{
+	EEndgameValue lValue = Evaluate(pDB, pBoard, pMoves);
+	return lValue == pValue || (lValue == ENDGAME_UNKNOWN && pValue == ENDGAME_DRAW);
+}
+
+static void *Run(void *pTask)
+{
+	CTask &lTask = *(CTask*)pTask;
+	CWork &lWork = *lTask.mWork;
+	const CLevel &lLevel = *lWork.mLevel;
+	vector<CMove> lMoves;
+	CBoard lBoard;
+
+	int lChunk;
+	while((lChunk = __sync_fetch_and_add(&lWork.mNextChunk, 1)) < (int)lLevel.mChunks.size()) {
+		const CChunk &lC = lLevel.mChunks[lChunk];
+		const CEndgameIndex &lIndex = lWork.mDB->SliceIndex(lC.mSlice);
+		uint8_t *lValues = lWork.mDB->SliceValues(lC.mSlice);
+
+		for(uint64_t i = lC.mBegin; i < lC.mEnd; ++i) {
+			if (!lWork.mFirstPass && !lWork.mVerify) {
+				uint64_t lBit = lC.mLevelBegin + (i - lC.mBegin);
+				uint64_t lWord = lWork.mFrontier[lBit >> 6] >> (lBit & 63);
+				if (lWord == 0) {
+					// skip the rest of the word
+					i += 63 - (lBit & 63);
+					continue;
+				}
+				if (!(lWord & 1))
+					continue;
+			}
+			if (!lIndex.Position(i, lBoard))
+				continue;
+
+			if (lWork.mVerify) {
+				if (!Check(*lWork.mDB, lBoard, CEndgameDB::Get(lValues, i), lMoves))
+					++lTask.mErrors;
+			} else if (lWork.mFirstPass) {
+				if (Decide(lWork, lBoard, lC.mSlice, i, ENDGAME_UNKNOWN, lMoves))
+					++lTask.mDecided;
+			} else {
+				lTask.mDecided += Predecessors(lWork, lBoard, CEndgameDB::Get(lValues, i), lMoves);
+			}
+		}
+	}
+	return NULL;
+}
+
+// runs a pass over the chunks of the level with pThreads threads, and
+// returns the number of positions decided (or the errors found)
+static uint64_t Pass(CWork &pWork, int pThreads)
+{
+	pWork.mNextChunk = 0;
+	vector<CTask> lTasks(pThreads);
+	for(int t = 0; t < pThreads; ++t) {
+		lTasks[t].mWork = &pWork;
+		lTasks[t].mDecided = 0;
+		lTasks[t].mErrors = 0;
+		pthread_create(&lTasks[t].mThread, NULL, Run, &lTasks[t]);
+	}
+	uint64_t lCount = 0;
+	for(int t = 0; t < pThreads; ++t) {
+		pthread_join(lTasks[t].mThread, NULL);
+		lCount += lTasks[t].mDecided + lTasks[t].mErrors;
+	}
+	return lCount;
+}
+
+// groups the slices into levels, in the order they have to be solved
+static void Levels(const CEndgameDB &pDB, vector<CLevel> &pLevels)
+{
+	for(int p = 2; p <= pDB.MaxPieces(); ++p) {
+		for(int m = 0; m <= p; ++m) {
+			CLevel lLevel;
+			lLevel.mSize = 0;
+			for(int s = 0; s < pDB.Slices(); ++s) {
+				const CEndgameMaterial &lMaterial = pDB.SliceIndex(s).Material();
+				if (lMaterial.Pieces() != p || lMaterial.Men() != m)
+					continue;
+				lLevel.mSlices.push_back(s);
+				uint64_t lSize = pDB.SliceIndex(s).Size();
+				for(uint64_t b = 0; b < lSize; b += cChunkSize) {
+					CChunk lChunk = { s, b, min(b + cChunkSize, lSize), lLevel.mSize + b };
+					lLevel.mChunks.push_back(lChunk);
+				}
+				lLevel.mSize += lSize;
+			}
+			if (!lLevel.mSlices.empty())
+				pLevels.push_back(lLevel);
+		}
+	}
+}
+
+// counts the values of a slice
+static void Count(const CEndgameDB &pDB, int pSlice, uint64_t pCounts[4])
+{
+	const CEndgameIndex &lIndex = pDB.SliceIndex(pSlice);
+	CBoard lBoard;
+	for(uint64_t i = 0; i < lIndex.Size(); ++i) {
+		if (lIndex.Position(i, lBoard))
+			++pCounts[CEndgameDB::Get(pDB.SliceValues(pSlice), i)];
+	}
+}
+
+static int Generate(int pPieces, int pThreads, const char *pFile)
+{
+	CTime lStart = CTime::GetCurrent();
+	CEndgameDB lDB;
+	lDB.Create(pPieces);
+	vector<CLevel> lLevels;
+	Levels(lDB, lLevels);
+
+	for(size_t l = 0; l < lLevels.size(); ++l) {
+		const CLevel &lLevel = lLevels[l];
+		CTime lLevelStart = CTime::GetCurrent();
+		CWork lWork;
+		lWork.mDB = &lDB;
+		lWork.mLevel = &lLevel;
+		lWork.mVerify = false;
+		lWork.mLevelStart.assign(lDB.Slices(), -1);
+		uint64_t lStartPos = 0;
+		for(size_t s = 0; s < lLevel.mSlices.size(); ++s) {
+			lWork.mLevelStart[lLevel.mSlices[s]] = lStartPos;
+			lStartPos += lDB.SliceIndex(lLevel.mSlices[s]).Size();
+		}
+		lWork.mNext.assign((lLevel.mSize + 63) / 64, 0);
+
+		lWork.mFirstPass = true;
+		uint64_t lDecided = Pass(lWork, pThreads);
+		lWork.mFirstPass = false;
+		int lRounds = 0;
+		for(uint64_t lNew = lDecided; lNew > 0; ++lRounds) {
+			lWork.mFrontier.swap(lWork.mNext);
+			lWork.mNext.assign(lWork.mFrontier.size(), 0);
+			lNew = Pass(lWork, pThreads);
+			lDecided += lNew;
+		}
+
+		// what can't be decided is a draw
+		uint64_t lCounts[4] = { 0, 0, 0, 0 };
+		for(size_t s = 0; s < lLevel.mSlices.size(); ++s) {
+			int lSlice = lLevel.mSlices[s];
+			uint64_t lSize = lDB.SliceIndex(lSlice).Size();
+			for(uint64_t i = 0; i < lSize; ++i) {
+				if (CEndgameDB::Get(lDB.SliceValues(lSlice), i) == ENDGAME_UNKNOWN)
+					CEndgameDB::Set(lDB.SliceValues(lSlice), i, ENDGAME_DRAW);
+			}
+			Count(lDB, lSlice, lCounts);
+		}
+
+		const CEndgameMaterial &lMaterial = lDB.SliceIndex(lLevel.mSlices[0]).Material();
+		printf("%d pieces %d men: %llu positions, %llu wins %llu losses %llu draws, %d rounds, %.2f s\n",
+				lMaterial.Pieces(), lMaterial.Men(), (unsigned long long)lLevel.mSize,
+				(unsigned long long)lCounts[ENDGAME_WIN], (unsigned long long)lCounts[ENDGAME_LOSS],
+				(unsigned long long)lCounts[ENDGAME_DRAW], lRounds,
+				(CTime::GetCurrent() - lLevelStart) / 1000000.0);
+		fflush(stdout);
+	}
+
+	if (!lDB.Save(pFile)) {
+		cerr << "can't write " << pFile << endl;
+		return -1;
+	}
+	cout << "built " << pFile << " in " << (CTime::GetCurrent() - lStart) / 1000000.0
+		 << " s with " << pThreads << " threads" << endl;
+	return 0;
+}
+
+// checks the checksums of a database, and every value against the values
+// after its moves
+static int Verify(const char *pFile, int pThreads)
+{
+	CTime lStart = CTime::GetCurrent();
+	CEndgameDB lDB;
+	if (!lDB.Open(pFile)) {
+		cerr << "can't open " << pFile << endl;
+		return -1;
+	}
+	uint64_t lErrors = 0, lPositions = 0;
+	for(int i = 0; i < lDB.Slices(); ++i) {
+		if (lDB.SliceChecksum(i) != lDB.SliceEntry(i).mChecksum) {
+			const uint8_t *lM = lDB.SliceEntry(i).mMaterial;
+			cout << "bad checksum of slice " << int(lM[0]) << "," << int(lM[1]) << ","
+				 << int(lM[2]) << "," << int(lM[3]) << endl;
+			++lErrors;
+		}
+	}
+
+	vector<CLevel> lLevels;
+	Levels(lDB, lLevels);
+
+	for(size_t l = 0; l < lLevels.size(); ++l) {
+		CWork lWork;
+		lWork.mDB = &lDB;
+		lWork.mLevel = &lLevels[l];
+		lWork.mFirstPass = false;
+		lWork.mVerify = true;
+		lErrors += Pass(lWork, pThreads);
+		lPositions += lLevels[l].mSize;
+	}
+	cout << lErrors << " errors in " << lPositions << " indices of " << lDB.MaxPieces()
+		 << " piece database, checked in " << (CTime::GetCurrent() - lStart) / 1000000.0 << " s" << endl;
+	return lErrors ? -1 : 0;
+}
+
+static void Usage(const char *pName)
+{
+	cerr << "usage: " << pName << " [-t threads] [-p pieces] -o file" << endl
+		 << "       " << pName << " verify [-t threads] file" << endl;
+}
+
+int main(int pArgC, char **pArgs)
+{
+	bool lVerify = pArgC > 1 && strcmp(pArgs[1], "verify") == 0;
+	int lThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int lPieces = 4;
+	const char *lOutput = NULL;
+	int lOpt;
+	optind = lVerify ? 2 : 1;
+	while((lOpt = getopt(pArgC, pArgs, "t:p:o:")) != -1) {
+		switch(lOpt) {
+		case 't':
+			lThreads = atoi(optarg);
+			break;
+		case 'p':
+			lPieces = atoi(optarg);
+			break;
+		case 'o':
+			lOutput = optarg;
+			break;
+		default:
+			Usage(pArgs[0]);
+			return -1;
+		}
+	}
+	if (lThreads < 1) {
+		Usage(pArgs[0]);
+		return -1;
+	}
+
+	// the tables behind these are filled on first use, before the threads start
+	CEndgameIndex::Binomial(0, 0);
+	CBoard().Hash();
+
+	if (lVerify) {
+		if (pArgC - optind != 1) {
+			Usage(pArgs[0]);
+			return -1;
+		}
+		return Verify(pArgs[optind], lThreads);
+	}
+	if (!lOutput || optind != pArgC || lPieces < 2 || lPieces > 8) {
+		Usage(pArgs[0]);
+		return -1;
+	}
+	return Generate(lPieces, lThreads, lOutput);
+}
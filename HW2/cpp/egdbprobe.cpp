@@ -0,0 +1,179 @@
+/*
+ * egdbprobe.cpp
+ *
+ * Checks the egdb driver of egdb.cpp against the endgame database it reads,
+ * the way a program using the driver would see it:
+ *
+ *   egdbprobe [-d directory] [-c cache_mb] [-n samples] [-v]
+ *
+ * For samples positions of every slice, both colours to move, the value
+ * looked up by the driver must be the one read from the database directly
+ * (CEndgameDB), the same with row reversed bitmaps and for the colour
+ * flipped mirror of the position, and a conditional lookup may only miss
+ * the cache. -v verifies the checksums of all slices as well.
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "egdb.h"
+#include "cboard.h"
+#include "cendgame.h"
+
+using namespace std;
+using namespace chk;
+
+static void Usage(const char *pName)
+{
+	cerr << "usage: " << pName << " [-d directory] [-c cache_mb] [-n samples] [-v]" << endl
+		 << "  -d  directory of endgame.db (default .)" << endl
+		 << "  -c  memory of the driver in MB (default 64)" << endl
+		 << "  -n  positions looked up per slice (default 1000)" << endl
+		 << "  -v  verify the checksums of the slices" << endl;
+}
+
+static void Message(char *pMessage)
+{
+	cout << pMessage;
+}
+
+static EGDB_ROW_REVERSED_BITMAP RowReversed(const EGDB_NORMAL_BITMAP &pPos)
+{
+	EGDB_ROW_REVERSED_BITMAP lPos;
+	uint32_t lBlack = pPos.black, lWhite = pPos.white, lKings = pPos.king;
+	uint32_t lBits[4] = { lBlack & ~lKings, lBlack & lKings, lWhite & ~lKings, lWhite & lKings };
+	for(int i = 0; i < 4; ++i)
+		lBits[i] = egdb_reverse_nibble_table[lBits[i] & 0xFFFF] | (egdb_reverse_nibble_table[lBits[i] >> 16] << 16);
+	lPos.black_man = lBits[0];
+	lPos.black_king = lBits[1];
+	lPos.white_man = lBits[2];
+	lPos.white_king = lBits[3];
+	return lPos;
+}
+
+// the board turned around with the colours exchanged
+static EGDB_NORMAL_BITMAP Mirror(const EGDB_NORMAL_BITMAP &pPos)
+{
+	EGDB_NORMAL_BITMAP lPos;
+	lPos.black = CEndgameDB::Reverse(pPos.white);
+	lPos.white = CEndgameDB::Reverse(pPos.black);
+	lPos.king = CEndgameDB::Reverse(pPos.king);
+	return lPos;
+}
+
+static CBoard Board(const EGDB_NORMAL_BITMAP &pPos, int pColor)
+{
+	CBoard lBoard(false, CELL_OWN);
+	for(int i = 0; i < CBoard::cSquares; ++i) {
+		uint32_t lBit = uint32_t(1) << i;
+		uint8_t lKing = (pPos.king & lBit) ? CELL_KING : 0;
+		if (pPos.black & lBit)
+			lBoard.Set(i, CELL_OWN | lKing);
+		else if (pPos.white & lBit)
+			lBoard.Set(i, CELL_OTHER | lKing);
+	}
+	if (pColor == EGDB_WHITE)
+		lBoard.SetPlayer(CELL_OTHER);
+	return lBoard;
+}
+
+int main(int pArgC, char **pArgs)
+{
+	string lDirectory = ".";
+	int lCacheMB = 64;
+	int lSamples = 1000;
+	bool lVerify = false;
+
+	int lOpt;
+	while((lOpt = getopt(pArgC, pArgs, "d:c:n:v")) != -1) {
+		switch(lOpt) {
+		case 'd': lDirectory = optarg; break;
+		case 'c': lCacheMB = atoi(optarg); break;
+		case 'n': lSamples = atoi(optarg); break;
+		case 'v': lVerify = true; break;
+		default:
+			Usage(pArgs[0]);
+			return -1;
+		}
+	}
+	if (optind != pArgC || lSamples < 1) {
+		Usage(pArgs[0]);
+		return -1;
+	}
+
+	vector<char> lPath(lDirectory.begin(), lDirectory.end());
+	lPath.push_back('\0');
+	EGDB_TYPE lType;
+	int lMaxPieces;
+	if (egdb_identify(&lPath[0], &lType, &lMaxPieces) != 0) {
+		cerr << "no database in " << lDirectory << endl;
+		return -1;
+	}
+	cout << "type " << lType << ", " << lMaxPieces << " pieces" << endl;
+
+	EGDB_DRIVER *lNormal = egdb_open(EGDB_NORMAL, lMaxPieces, lCacheMB, &lPath[0], Message);
+	EGDB_DRIVER *lReversed = egdb_open(EGDB_ROW_REVERSED, lMaxPieces, lCacheMB, &lPath[0], NULL);
+	CEndgameDB lDB;
+	if (!lNormal || !lReversed || !lDB.Open(lDirectory + "/endgame.db")) {
+		cerr << "can't open the database in " << lDirectory << endl;
+		return -1;
+	}
+
+	int lErrors = 0;
+	if (lVerify) {
+		int lBad = lNormal->verify(lNormal);
+		cout << lBad << " slices with bad checksums" << endl;
+		lErrors += lBad;
+	}
+
+	vector<CEndgameMaterial> lMaterials;
+	CEndgameDB::Materials(lMaxPieces, lMaterials);
+	int64_t lLookups = 0, lNotCached = 0;
+	for(size_t m = 0; m < lMaterials.size(); ++m) {
+		const CEndgameMaterial &lMaterial = lMaterials[m];
+		int64_t lRange = egdb_index_range(lMaterial.mOwnMen, lMaterial.mOwnKings, lMaterial.mOtherMen,
+				lMaterial.mOtherKings);
+		int64_t lStep = lRange / lSamples > 0 ? lRange / lSamples : 1;
+		for(int64_t i = 0; i < lRange; i += lStep) {
+			EGDB_BITMAP lPos, lRR, lMirror;
+			egdb_indextoposition(i, &lPos.normal, lMaterial.mOwnMen, lMaterial.mOwnKings, lMaterial.mOtherMen,
+					lMaterial.mOtherKings);
+			if (!lPos.normal.black)
+				continue;
+			lRR.row_reversed = RowReversed(lPos.normal);
+			lMirror.normal = Mirror(lPos.normal);
+
+			for(int c = EGDB_BLACK; c <= EGDB_WHITE; ++c) {
+				int lExpected = lDB.Lookup(Board(lPos.normal, c));
+				int lValue = lNormal->lookup(lNormal, &lPos, c, 0);
+				int lValueRR = lReversed->lookup(lReversed, &lRR, c, 0);
+				int lValueMirror = lNormal->lookup(lNormal, &lMirror, !c, 0);
+				int lConditional = lNormal->lookup(lNormal, &lPos, c, 1);
+				lLookups += 4;
+				if (lConditional == EGDB_NOT_IN_CACHE)
+					++lNotCached;
+				if (lValue != lExpected || lValueRR != lExpected || lValueMirror != lExpected
+						|| (lConditional != lExpected && lConditional != EGDB_NOT_IN_CACHE)) {
+					if (++lErrors <= 10)
+						cout << "slice " << lMaterial.mOwnMen << lMaterial.mOwnKings << lMaterial.mOtherMen
+							 << lMaterial.mOtherKings << " index " << i << " colour " << c << ": " << lValue
+							 << " " << lValueRR << " " << lValueMirror << " " << lConditional
+							 << ", expected " << lExpected << endl;
+				}
+			}
+		}
+	}
+
+	EGDB_STATS *lStats = lNormal->get_stats(lNormal);
+	cout << lLookups << " lookups in " << lMaterials.size() << " slices, " << lNotCached
+		 << " conditional ones not in the cache, " << lErrors << " errors" << endl
+		 << "cache hits " << lStats->lru_cache_hits << ", loads " << lStats->lru_cache_loads
+		 << ", autoload hits " << lStats->autoload_hits << endl;
+	lNormal->close(lNormal);
+	lReversed->close(lReversed);
+	return lErrors ? 1 : 0;
+}
@@ -0,0 +1,14 @@
+// weights of CBoard::Evaluate
+//
+// This file is written by the tuner (make tune), the values below are the
+// hand picked ones it starts from.
+
+#ifndef _CHECKERS_EVALWEIGHTS_H_
+#define _CHECKERS_EVALWEIGHTS_H_
+
+#define EVAL_PAWN_SCORE 1000    // a man
+#define EVAL_KING_SCORE 2000    // a king
+#define EVAL_KING_SIDE -100     // a king on the edge of the board, twice in a corner
+#define EVAL_PAWN_POS 5         // times the square of the rows a man has advanced
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * jefextract.cpp
+ *
+ * Lists or extracts the files of an archive read by CJefArchive, like the
+ * database.jef of GuiCheckers.
+ *
+ *   jefextract [-t threads] [-o dir] archive [files...]
+ *   jefextract -l archive
+ *
+ * Without files, all files of the archive are extracted. The segments of
+ * all files are decoded together, by as many threads as there are cores.
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "cjefarchive.h"
+#include "ctime.h"
+
+using namespace std;
+using namespace chk;
+
+static void Usage(const char *pName)
+{
+	cerr << "usage: " << pName << " [-t threads] [-o dir] archive [files...]" << endl
+		 << "       " << pName << " -l archive" << endl;
+}
+
+int main(int pArgC, char **pArgs)
+{
+	int lThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	string lDir = ".";
+	bool lList = false;
+	int lOpt;
+	while((lOpt = getopt(pArgC, pArgs, "t:o:l")) != -1) {
+		switch(lOpt) {
+		case 't':
+			lThreads = atoi(optarg);
+			break;
+		case 'o':
+			lDir = optarg;
+			break;
+		case 'l':
+			lList = true;
+			break;
+		default:
+			Usage(pArgs[0]);
+			return -1;
+		}
+	}
+	if (optind >= pArgC || lThreads < 1) {
+		Usage(pArgs[0]);
+		return -1;
+	}
+
+	CJefArchive lArchive;
+	if (!lArchive.Open(pArgs[optind])) {
+		cerr << "can't read archive " << pArgs[optind] << endl;
+		return -1;
+	}
+
+	if (lList) {
+		for(size_t i = 0; i < lArchive.Files().size(); ++i) {
+			const CJefArchive::CFile &lFile = lArchive.Files()[i];
+			size_t lSize = 0;
+			for(size_t s = 0; s < lFile.mSegments.size(); ++s)
+				lSize += lFile.mSegments[s].mSize;
+			cout << lFile.mName << ": " << lFile.mSegments.size() << " segments, "
+				 << lSize << " bytes compressed" << endl;
+		}
+		return 0;
+	}
+
+	vector<string> lNames;
+	for(int i = optind + 1; i < pArgC; ++i)
+		lNames.push_back(pArgs[i]);
+	if (lNames.empty()) {
+		for(size_t i = 0; i < lArchive.Files().size(); ++i)
+			lNames.push_back(lArchive.Files()[i].mName);
+	}
+
+	// the sizes are only known after decoding, so the buffers start with
+	// room for a good compression ratio and are grown if that wasn't enough
+	vector<CJefArchive::CRequest> lRequests;
+	vector<vector<uint8_t> > lBuffers(lNames.size());
+	for(size_t i = 0; i < lNames.size(); ++i) {
+		const CJefArchive::CFile *lFile = lArchive.Find(lNames[i]);
+		if (!lFile) {
+			cerr << "no file " << lNames[i] << " in the archive" << endl;
+			return -1;
+		}
+		lBuffers[i].resize(max<size_t>(1, lFile->mSegments.size() * CJefArchive::cSegmentSize * 2));
+		lRequests.push_back(CJefArchive::CRequest(lNames[i], &lBuffers[i][0], lBuffers[i].size()));
+	}
+
+	CTime lStart = CTime::GetCurrent();
+	bool lOk = lArchive.Extract(lRequests, lThreads);
+	if (!lOk) {
+		for(size_t i = 0; i < lRequests.size(); ++i) {
+			if (lRequests[i].mSize > (int64_t)lRequests[i].mCapacity) {
+				lBuffers[i].resize(lRequests[i].mSize);
+				lRequests[i].mOut = &lBuffers[i][0];
+				lRequests[i].mCapacity = lBuffers[i].size();
+			}
+		}
+		lOk = lArchive.Extract(lRequests, lThreads);
+	}
+	int64_t lTime = CTime::GetCurrent() - lStart;
+
+	int64_t lTotal = 0;
+	for(size_t i = 0; i < lRequests.size(); ++i) {
+		if (lRequests[i].mSize < 0) {
+			cerr << "can't decode " << lNames[i] << endl;
+			continue;
+		}
+		string lPath = lDir + "/" + lNames[i];
+		FILE *lOut = fopen(lPath.c_str(), "wb");
+		bool lWritten = lOut && fwrite(&lBuffers[i][0], 1, lRequests[i].mSize, lOut)
+				== (size_t)lRequests[i].mSize;
+		if (lOut)
+			lWritten = (fclose(lOut) == 0) && lWritten;
+		if (!lWritten) {
+			cerr << "can't write " << lPath << endl;
+			lOk = false;
+			continue;
+		}
+		cout << lNames[i] << ": " << lRequests[i].mSize << " bytes" << endl;
+		lTotal += lRequests[i].mSize;
+	}
+	cout << lTotal << " bytes in " << lTime / 1000.0 << " ms with " << lThreads << " threads" << endl;
+	return lOk ? 0 : -1;
+}
@@ -2,6 +2,7 @@
 #include "cclient.h"
 
 #include <iostream>
+#include <cstdlib>
 
 int main(int pArgC,char **pArgs)
 {
@@ -12,6 +13,13 @@ int main(int pArgC,char **pArgs)
     }
 
     chk::CPlayer lPlayer;
+
+    //search parameters can be overridden for benchmarking, e.g. CHK_SEARCH="lmr=0"
+    if(const char *lSettings=getenv("CHK_SEARCH"))
+    {
+        if(!lPlayer.Config().Parse(lSettings))
+            std::cerr << "warning: ignoring invalid settings in CHK_SEARCH" << std::endl;
+    }
     chk::CClient lClient(lPlayer);
     
     lClient.Run(pArgs[1],pArgs[2],pArgC>3?pArgs[3]:"");
@@ -0,0 +1,361 @@
+/*
+ * pdnindex.cpp
+ *
+ * Builds an index from positions to the games of a PDN archive they occur
+ * in (see CPositionIndex), and looks positions up in it.
+ *
+ *   pdnindex build [-t threads] archive.pdn index
+ *   pdnindex find archive.pdn index [moves...]
+ *
+ * The games are replayed by several threads. Each thread then takes a
+ * range of buckets, collects the positions falling into them from all
+ * threads and sorts them, so that the result doesn't depend on the number
+ * of threads.
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "cboard.h"
+#include "cpdn.h"
+#include "cpositionindex.h"
+#include "ctime.h"
+
+using namespace std;
+using namespace chk;
+
+// a position of a game, before being sorted into the index
+struct CEntry
+{
+	uint64_t mKey;
+	uint32_t mGame;
+	uint32_t mPly;
+
+	bool operator<(const CEntry &pRH) const
+	{
+		if (mKey != pRH.mKey)
+			return mKey < pRH.mKey;
+		if (mGame != pRH.mGame)
+			return mGame < pRH.mGame;
+		return mPly < pRH.mPly;
+	}
+};
+
+// the work of one thread
+struct CTask
+{
+	// replaying: the games [mFirstGame,mEndGame)
+	const vector<CPDNGame> *mGames;
+	size_t mFirstGame;
+	size_t mEndGame;
+	vector<CEntry> mEntries;
+	int mBadGames;
+
+	// sorting: the buckets [mFirstBucket,mEndBucket) of the entries of all tasks
+	const vector<CTask> *mTasks;
+	uint64_t mBuckets;
+	uint64_t mFirstBucket;
+	uint64_t mEndBucket;
+	vector<uint32_t> mBucketSizes;
+	vector<CPositionIndex::CKey> mKeys;
+	vector<CPositionPosting> mPostings;
+};
+
+static bool SameKey(const CEntry &pLH, const CEntry &pRH)
+{
+	return pLH.mKey == pRH.mKey;
+}
+
+static void *Replay(void *pTask)
+{
+	CTask &lTask = *(CTask*)pTask;
+	vector<CMove> lMoves;
+	vector<CEntry> lGame;
+	lTask.mBadGames = 0;
+	for(size_t g = lTask.mFirstGame; g < lTask.mEndGame; ++g) {
+		if (!(*lTask.mGames)[g].Moves(lMoves))
+			++lTask.mBadGames;
+
+		// every position once per game, at its first occurrence
+		lGame.clear();
+		CBoard lBoard(true, CELL_OWN);
+		for(size_t m = 0; m <= lMoves.size(); ++m) {
+			CEntry lEntry = { lBoard.Hash(), (uint32_t)g, (uint32_t)m };
+			lGame.push_back(lEntry);
+			if (m < lMoves.size())
+				lBoard.DoMove(lMoves[m]);
+		}
+		sort(lGame.begin(), lGame.end());
+		lGame.erase(unique(lGame.begin(), lGame.end(), SameKey), lGame.end());
+		lTask.mEntries.insert(lTask.mEntries.end(), lGame.begin(), lGame.end());
+	}
+	return NULL;
+}
+
+static void *Sort(void *pTask)
+{
+	CTask &lTask = *(CTask*)pTask;
+	uint64_t lMask = lTask.mBuckets - 1;
+
+	vector<CEntry> lEntries;
+	for(size_t t = 0; t < lTask.mTasks->size(); ++t) {
+		const vector<CEntry> &lFrom = (*lTask.mTasks)[t].mEntries;
+		for(size_t i = 0; i < lFrom.size(); ++i) {
+			uint64_t lBucket = lFrom[i].mKey & lMask;
+			if (lBucket >= lTask.mFirstBucket && lBucket < lTask.mEndBucket)
+				lEntries.push_back(lFrom[i]);
+		}
+	}
+	sort(lEntries.begin(), lEntries.end());
+
+	// keys in the order of their buckets
+	vector<CPositionIndex::CKey> lKeys;
+	for(size_t i = 0; i < lEntries.size(); ) {
+		CPositionIndex::CKey lKey = { lEntries[i].mKey, (uint32_t)i, 0 };
+		for(; i < lEntries.size() && lEntries[i].mKey == lKey.mKey; ++i)
+			++lKey.mCount;
+		lKeys.push_back(lKey);
+	}
+	lTask.mBucketSizes.assign(lTask.mEndBucket - lTask.mFirstBucket, 0);
+	for(size_t k = 0; k < lKeys.size(); ++k)
+		++lTask.mBucketSizes[(lKeys[k].mKey & lMask) - lTask.mFirstBucket];
+
+	vector<uint32_t> lNext(lTask.mBucketSizes.size() + 1, 0);
+	for(size_t b = 0; b < lTask.mBucketSizes.size(); ++b)
+		lNext[b + 1] = lNext[b] + lTask.mBucketSizes[b];
+	lTask.mKeys.resize(lKeys.size());
+	for(size_t k = 0; k < lKeys.size(); ++k)
+		lTask.mKeys[lNext[(lKeys[k].mKey & lMask) - lTask.mFirstBucket]++] = lKeys[k];
+
+	// postings in the order of their keys
+	lTask.mPostings.reserve(lEntries.size());
+	for(size_t k = 0; k < lTask.mKeys.size(); ++k) {
+		CPositionIndex::CKey &lKey = lTask.mKeys[k];
+		for(uint32_t p = 0; p < lKey.mCount; ++p) {
+			CPositionPosting lPosting = { lEntries[lKey.mFirst + p].mGame, lEntries[lKey.mFirst + p].mPly };
+			lTask.mPostings.push_back(lPosting);
+		}
+		lKey.mFirst = lTask.mPostings.size() - lKey.mCount;
+	}
+	return NULL;
+}
+
+static void RunTasks(vector<CTask> &pTasks, void *(*pFunction)(void*))
+{
+	vector<pthread_t> lThreads(pTasks.size());
+	for(size_t t = 1; t < pTasks.size(); ++t)
+		pthread_create(&lThreads[t], NULL, pFunction, &pTasks[t]);
+	pFunction(&pTasks[0]);
+	for(size_t t = 1; t < pTasks.size(); ++t)
+		pthread_join(lThreads[t], NULL);
+}
+
+static int Build(const char *pArchive, const char *pIndex, int pThreads)
+{
+	CTime lStart = CTime::GetCurrent();
+	CPDNReader lReader;
+	if (!lReader.Open(pArchive)) {
+		cerr << "can't open " << pArchive << endl;
+		return -1;
+	}
+
+	vector<CPDNGame> lGames;
+	CPDNGame lGame;
+	while(lReader.NextGame(lGame))
+		lGames.push_back(lGame);
+	cout << lGames.size() << " games" << endl;
+
+	vector<CTask> lTasks(pThreads);
+	for(int t = 0; t < pThreads; ++t) {
+		lTasks[t].mGames = &lGames;
+		lTasks[t].mFirstGame = lGames.size() * t / pThreads;
+		lTasks[t].mEndGame = lGames.size() * (t + 1) / pThreads;
+	}
+	RunTasks(lTasks, Replay);
+
+	size_t lEntries = 0;
+	int lBadGames = 0;
+	for(int t = 0; t < pThreads; ++t) {
+		lEntries += lTasks[t].mEntries.size();
+		lBadGames += lTasks[t].mBadGames;
+	}
+	if (lBadGames)
+		cerr << lBadGames << " games with setup positions or illegal moves, indexed up to there" << endl;
+
+	CPositionIndex::CHeader lHeader;
+	memcpy(lHeader.mMagic, "CHKI", 4);
+	lHeader.mVersion = CPositionIndex::cVersion;
+	lHeader.mGames = lGames.size();
+	lHeader.mBuckets = 1;
+	while(lHeader.mBuckets < lEntries / 2)
+		lHeader.mBuckets *= 2;
+
+	for(int t = 0; t < pThreads; ++t) {
+		lTasks[t].mTasks = &lTasks;
+		lTasks[t].mBuckets = lHeader.mBuckets;
+		lTasks[t].mFirstBucket = lHeader.mBuckets * t / pThreads;
+		lTasks[t].mEndBucket = lHeader.mBuckets * (t + 1) / pThreads;
+	}
+	RunTasks(lTasks, Sort);
+
+	lHeader.mKeys = 0;
+	lHeader.mPostings = 0;
+	for(int t = 0; t < pThreads; ++t) {
+		lHeader.mKeys += lTasks[t].mKeys.size();
+		lHeader.mPostings += lTasks[t].mPostings.size();
+	}
+
+	// the sections, with the keys and postings of each task moved after
+	// those of the tasks before
+	vector<uint64_t> lOffsets(lGames.size());
+	for(size_t g = 0; g < lGames.size(); ++g)
+		lOffsets[g] = lReader.Offset(lGames[g]);
+	vector<uint32_t> lBuckets(1, 0);
+	lBuckets.reserve(lHeader.mBuckets + 1);
+	uint32_t lKeys = 0, lPostings = 0;
+	for(int t = 0; t < pThreads; ++t) {
+		for(size_t b = 0; b < lTasks[t].mBucketSizes.size(); ++b) {
+			lKeys += lTasks[t].mBucketSizes[b];
+			lBuckets.push_back(lKeys);
+		}
+		for(size_t k = 0; k < lTasks[t].mKeys.size(); ++k)
+			lTasks[t].mKeys[k].mFirst += lPostings;
+		lPostings += lTasks[t].mPostings.size();
+	}
+
+	string lTemp = string(pIndex) + ".tmp";
+	FILE *lFile = fopen(lTemp.c_str(), "wb");
+	if (!lFile) {
+		cerr << "can't write " << lTemp << endl;
+		return -1;
+	}
+	size_t lSections[4];
+	CPositionIndex::Layout(lHeader, lSections);
+	static const char cPadding[8] = { 0 };
+	bool lOk = fwrite(&lHeader, sizeof(lHeader), 1, lFile) == 1;
+	lOk = lOk && fwrite(&lOffsets[0], sizeof(uint64_t), lOffsets.size(), lFile) == lOffsets.size();
+	lOk = lOk && fwrite(&lBuckets[0], sizeof(uint32_t), lBuckets.size(), lFile) == lBuckets.size();
+	size_t lPad = lSections[2] - lSections[1] - lBuckets.size() * sizeof(uint32_t);
+	lOk = lOk && fwrite(cPadding, 1, lPad, lFile) == lPad;
+	for(int t = 0; t < pThreads; ++t) {
+		const vector<CPositionIndex::CKey> &lK = lTasks[t].mKeys;
+		lOk = lOk && (lK.empty() || fwrite(&lK[0], sizeof(lK[0]), lK.size(), lFile) == lK.size());
+	}
+	for(int t = 0; t < pThreads; ++t) {
+		const vector<CPositionPosting> &lP = lTasks[t].mPostings;
+		lOk = lOk && (lP.empty() || fwrite(&lP[0], sizeof(lP[0]), lP.size(), lFile) == lP.size());
+	}
+	lOk = (fclose(lFile) == 0) && lOk;
+	if (!lOk || rename(lTemp.c_str(), pIndex) != 0) {
+		cerr << "can't write " << pIndex << endl;
+		remove(lTemp.c_str());
+		return -1;
+	}
+
+	cout << lHeader.mKeys << " positions, " << lHeader.mPostings << " occurrences, "
+		 << lHeader.mBuckets << " buckets, built in "
+		 << (CTime::GetCurrent() - lStart) / 1000000.0 << " s with " << pThreads << " threads" << endl;
+	return 0;
+}
+
+// plays the moves given in PDN from the initial position, and lists the
+// games the position occurs in with the moves played next
+static int Find(const char *pArchive, const char *pIndex, int pArgC, char **pArgs)
+{
+	CPositionIndex lIndex;
+	if (!lIndex.Open(pIndex)) {
+		cerr << "can't open index " << pIndex << endl;
+		return -1;
+	}
+	CPDNReader lReader;
+	if (!lReader.Open(pArchive)) {
+		cerr << "can't open " << pArchive << endl;
+		return -1;
+	}
+
+	CBoard lBoard(true, CELL_OWN);
+	for(int i = 0; i < pArgC; ++i) {
+		CMove lMove;
+		if (!CPDNGame::FindMove(lBoard, CPDNSpan(pArgs[i], pArgs[i] + strlen(pArgs[i])), lMove)) {
+			cerr << "illegal move " << pArgs[i] << endl;
+			return -1;
+		}
+		lBoard.DoMove(lMove);
+	}
+
+	const int cRepeat = 1000;
+	size_t lCount = 0;
+	const CPositionPosting *lPostings = NULL;
+	CTime lStart = CTime::GetCurrent();
+	for(int r = 0; r < cRepeat; ++r)
+		lPostings = lIndex.Find(lBoard, true, lCount);
+	double lMicros = double(CTime::GetCurrent() - lStart) / cRepeat;
+	cout << "found in " << lCount << " of " << lIndex.Games() << " games (" << lMicros << " us per lookup)" << endl;
+
+	// the moves played from the position, by the number of games
+	const size_t cMaxGames = 10000;
+	map<string, int> lNext;
+	vector<CMove> lMoves;
+	CPDNGame lGame;
+	for(size_t i = 0; i < lCount && i < cMaxGames; ++i) {
+		if (!lReader.GameAt(lIndex.GameOffset(lPostings[i].mGame), lGame))
+			continue;
+		lGame.Moves(lMoves);
+		if (i < 5) {
+			CPDNSpan lEvent = lGame.Tag("Event");
+			cout << "game " << lPostings[i].mGame << " ply " << lPostings[i].mPly << ": " << lEvent.Str() << endl;
+		}
+		if (lPostings[i].mPly >= lMoves.size())
+			continue;
+		++lNext[PDNMove(lMoves[lPostings[i].mPly], true)];
+	}
+	for(map<string, int>::iterator it = lNext.begin(); it != lNext.end(); ++it)
+		cout << "next move " << it->first << ": " << it->second << " games" << endl;
+	return 0;
+}
+
+static void Usage(const char *pName)
+{
+	cerr << "usage: " << pName << " build [-t threads] archive.pdn index" << endl
+		 << "       " << pName << " find archive.pdn index [moves...]" << endl;
+}
+
+int main(int pArgC, char **pArgs)
+{
+	if (pArgC < 2) {
+		Usage(pArgs[0]);
+		return -1;
+	}
+
+	if (strcmp(pArgs[1], "build") == 0) {
+		int lThreads = sysconf(_SC_NPROCESSORS_ONLN);
+		int lOpt;
+		optind = 2;
+		while((lOpt = getopt(pArgC, pArgs, "t:")) != -1) {
+			if (lOpt != 't') {
+				Usage(pArgs[0]);
+				return -1;
+			}
+			lThreads = atoi(optarg);
+		}
+		if (pArgC - optind != 2 || lThreads < 1) {
+			Usage(pArgs[0]);
+			return -1;
+		}
+		return Build(pArgs[optind], pArgs[optind + 1], lThreads);
+	} else if (strcmp(pArgs[1], "find") == 0 && pArgC >= 4) {
+		return Find(pArgs[2], pArgs[3], pArgC - 4, pArgs + 4);
+	}
+
+	Usage(pArgs[0]);
+	return -1;
+}
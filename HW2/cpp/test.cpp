@@ -3,29 +3,268 @@
  *
  *  Created on: 13.09.2011
  *      Author: demmeln
+ *
+ * Checks of the scoring, draw detection and hashing the search relies on.
+ * Prints the checks which fail, and returns 1 if there are any.
  */
 
 #include <iostream>
-#include <algorithm>
 #include <vector>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "ctranstable.h"
+#include "cplayer.h"
+#include "cpdn.h"
+#include "crandom.h"
 
 using namespace std;
+using namespace chk;
+
+static int sChecks = 0;
+static int sFailures = 0;
 
-bool compare(int a, int b) {
-	return a > b;
+#define CHECK(pCondition) Check((pCondition), #pCondition, __FILE__, __LINE__)
+
+static void Check(bool pCondition, const char *pText, const char *pFile, int pLine)
+{
+	++sChecks;
+	if (!pCondition) {
+		++sFailures;
+		cout << pFile << ":" << pLine << ": failed: " << pText << endl;
+	}
 }
 
-int main() {
-	int foo[] = {4,2,6,3};
-	vector<int> vec = vector<int>(&foo[0],&foo[4]);
+// wins and losses are stored relative to the stored position, and come back
+// relative to the root at whatever ply the position is reached again
+static void TestScoreToTT()
+{
+	const eval_t cScores[] = { 0, 123, -456, cWinBound, -cWinBound, cDatabaseWin - 4, -cDatabaseWin + 9,
+			cWin - 3, cWin - 50, -cWin + 7, -cWin + 120 };
+	const int cCount = sizeof(cScores) / sizeof(cScores[0]);
+	for(int i = 0; i < cCount; ++i) {
+		for(int ply = 0; ply < 128; ply += 7)
+			CHECK(CTransTable::ScoreFromTT(CTransTable::ScoreToTT(cScores[i], ply), ply) == cScores[i]);
+	}
+
+	// a win 6 plies after a position at ply 4, which is reached again at ply 6
+	CHECK(CTransTable::ScoreFromTT(CTransTable::ScoreToTT(cWin - 10, 4), 6) == cWin - 12);
+	CHECK(CTransTable::ScoreFromTT(CTransTable::ScoreToTT(-cWin + 10, 4), 6) == -cWin + 12);
+	CHECK(CTransTable::ScoreFromTT(CTransTable::ScoreToTT(cWin - 10, 4), 1) == cWin - 7);
+	// the distance is kept from the stored position, not from the root
+	CHECK(CTransTable::ScoreToTT(cWin - 10, 4) == cWin - 6);
+	CHECK(CTransTable::ScoreToTT(-cWin + 10, 4) == -cWin + 6);
+	// evaluations and database wins, which have no distance, are stored as they are
+	CHECK(CTransTable::ScoreToTT(cWinBound, 9) == cWinBound);
+	CHECK(CTransTable::ScoreToTT(cDatabaseWin - 4, 9) == cDatabaseWin - 4);
+	CHECK(CTransTable::ScoreToTT(-cDatabaseWin + 4, 9) == -cDatabaseWin + 4);
+}
 
-	sort(vec.begin(), vec.end(), compare);
+static CBoard Position(const char *pFEN)
+{
+	CBoard lBoard;
+	bool lFirst;
+	PDNSetup(pFEN, lBoard, lFirst);
+	return lBoard;
+}
 
-	for(vector<int>::iterator i = vec.begin(); i != vec.end(); ++i) {
-		cout << *i << endl;
+// the move of pBoard from the cell pFrom to the cell pTo
+static CMove FindMove(const CBoard &pBoard, int pFrom, int pTo)
+{
+	vector<CMove> lMoves;
+	pBoard.FindPossibleMoves(lMoves);
+	for(size_t i = 0; i < lMoves.size(); ++i) {
+		if (lMoves[i][0] == pFrom && lMoves[i][lMoves[i].Length() - 1] == pTo)
+			return lMoves[i];
 	}
+	return NullMove;
+}
 
+// positions of a few random games, with either player to move
+static void RandomPositions(vector<CBoard> &pBoards)
+{
+	CRandom lRandom(12345);
+	vector<CMove> lMoves;
+	for(int g = 0; g < 20; ++g) {
+		CBoard lBoard;
+		for(int lPly = 0; lPly < 60; ++lPly) {
+			lBoard.FindPossibleMoves(lMoves);
+			if (lMoves.empty())
+				break;
+			lBoard = CBoard(lBoard, lMoves[lRandom.Next() % lMoves.size()]);
+			pBoards.push_back(lBoard);
+		}
+	}
+}
 
-	return 0;
+// inverting twice gives the position back, and a position and its mirror
+// share the key and the moves of the transposition table
+static void TestMirror()
+{
+	vector<CBoard> lBoards;
+	RandomPositions(lBoards);
+	CHECK(lBoards.size() > 100);
+	vector<CMove> lMoves;
+	vector<CMove> lMirrorMoves;
+	for(size_t i = 0; i < lBoards.size(); ++i) {
+		const CBoard &lBoard = lBoards[i];
+		CBoard lMirror(lBoard);
+		lMirror.Invert();
+		CHECK(lMirror.Player() != lBoard.Player());
+		CHECK(lMirror.Hash() == lBoard.InvertedHash());
+		CHECK(lMirror.CanonicalHash() == lBoard.CanonicalHash());
+		CBoard lTwice(lMirror);
+		lTwice.Invert();
+		CHECK(lTwice == lBoard);
+		CHECK(lTwice.Hash() == lBoard.Hash());
+
+		// the same pieces with the other player to move are another position,
+		// unless they are their own mirror
+		CBoard lOther(lBoard);
+		lOther.TogglePlayer();
+		CHECK(lOther == lMirror || lOther.CanonicalHash() != lBoard.CanonicalHash());
+
+		// the mirrored moves lead to the mirrored positions
+		lBoard.FindPossibleMoves(lMoves);
+		lMirror.FindPossibleMoves(lMirrorMoves);
+		CHECK(lMoves.size() == lMirrorMoves.size());
+		for(size_t m = 0; m < lMoves.size(); ++m) {
+			CMove lMove(lMoves[m]);
+			lMove.Invert();
+			CHECK(CTransTable::MoveKey(lMove) == CTransTable::InvertMoveKey(CTransTable::MoveKey(lMoves[m])));
+			CHECK(CBoard(lMirror, lMove).CanonicalHash() == CBoard(lBoard, lMoves[m]).CanonicalHash());
+		}
+	}
 }
 
+namespace chk
+{
+
+class CPlayerTest
+{
+public:
+	// kings moving forth and back repeat the first position after 4 plies
+	static void TestIsDraw()
+	{
+		vector<CBoard> lBoards(1, Position("W:WK1:BK32"));
+		vector<CMove> lPlayed;
+		vector<CMove> lMoves;
+		for(int i = 0; i < 2; ++i) {
+			lBoards.back().FindPossibleMoves(lMoves);
+			lPlayed.push_back(lMoves[0]);
+			lBoards.push_back(CBoard(lBoards.back(), lMoves[0]));
+		}
+		for(int i = 0; i < 2; ++i) {
+			CMove lBack = FindMove(lBoards.back(), lPlayed[i][1], lPlayed[i][0]);
+			CHECK(!lBack.IsNull());
+			if (lBack.IsNull())
+				return;
+			lBoards.push_back(CBoard(lBoards.back(), lBack));
+		}
+		CHECK(lBoards[4] == lBoards[0]);
+		CHECK(lBoards[4].ReversiblePlies() == 4);
+
+		CPlayer lPlayer;
+		lPlayer.mConfig.mDrawPlies = 0;
+		lPlayer.mRootIndex = 0;
+		lPlayer.mHashStack.assign(CPlayer::cMaxPly, 0);
+		for(int lPly = 0; lPly < 4; ++lPly)
+			CHECK(!lPlayer.IsDraw(lBoards[lPly], lPly));
+		CHECK(lPlayer.IsDraw(lBoards[4], 4));
+
+		// the first positions played in the game before the root
+		lPlayer.mRootIndex = 4;
+		for(int i = 0; i < 4; ++i)
+			lPlayer.mHashStack[i] = lBoards[i].Hash();
+		CHECK(lPlayer.IsDraw(lBoards[4], 0));
+		CHECK(!lPlayer.IsDraw(lBoards[1], 1));
+
+		// nothing irreversible for draw_plies plies
+		lPlayer.mConfig.mDrawPlies = 3;
+		lPlayer.mRootIndex = 0;
+		CHECK(!lPlayer.IsDraw(lBoards[2], 2));
+		CHECK(lPlayer.IsDraw(lBoards[3], 3));
+		lPlayer.mConfig.mDrawPlies = 4;
+		CHECK(!lPlayer.IsDraw(lBoards[3], 3));
+
+		// a man move can't be repeated
+		CBoard lMen = Position("W:W21,K1:BK32");
+		lMen.FindPossibleMoves(lMoves);
+		for(size_t i = 0; i < lMoves.size(); ++i) {
+			CBoard lChild(lMen, lMoves[i]);
+			if (!(lMen.At(lMoves[i][0]) & CELL_KING))
+				CHECK(lChild.ReversiblePlies() == 0);
+		}
+	}
+
+	// an entry stored for CELL_OTHER to move is found by its mirror with
+	// CELL_OWN to move, with the score, bound and move seen from that side
+	static void TestTransTableInversion()
+	{
+		vector<CBoard> lBoards;
+		RandomPositions(lBoards);
+		CPlayer lPlayer;
+		lPlayer.mTransTable.Resize(10, false);
+		lPlayer.mMaxDepth = 5;
+		const int cDepth = 2 * cOnePly;
+
+		int lTested = 0;
+		vector<CMove> lMoves;
+		for(size_t i = 0; i < lBoards.size() && lTested < 20; ++i) {
+			const CBoard &lBoard = lBoards[i];
+			lBoard.FindPossibleMoves(lMoves);
+			if (lBoard.Player() != CELL_OTHER || lMoves.empty())
+				continue;
+			++lTested;
+			lPlayer.mTransTable.Clear();
+			CBoard lMirror(lBoard);
+			lMirror.Invert();
+			const CMove &lMove = lMoves[lMoves.size() / 2];
+			CMove lMirrorMove(lMove);
+			lMirrorMove.Invert();
+
+			lPlayer.StoreTransTable(lBoard, 37, cDepth, 3, BOUND_LOWER, lMove);
+			eval_t lScore = 0;
+			uint16_t lKey = 0;
+			CHECK(lPlayer.ProbeTransTable(lBoard, 0, 30, cDepth, 3, lScore, lKey));
+			CHECK(lScore == 37);
+			CHECK(lKey == CTransTable::MoveKey(lMove));
+
+			// a lower bound of 37 for one side is an upper bound of -37 for the other
+			lScore = 0;
+			CHECK(lPlayer.ProbeTransTable(lMirror, -30, 0, cDepth, 3, lScore, lKey));
+			CHECK(lScore == -37);
+			CHECK(lKey == CTransTable::MoveKey(lMirrorMove));
+			// it doesn't cut off a window below it
+			CHECK(!lPlayer.ProbeTransTable(lMirror, -40, -38, cDepth, 3, lScore, lKey));
+			// nor does it answer a probe which has more plies left to search
+			CHECK(!lPlayer.ProbeTransTable(lMirror, -30, 0, cDepth - cOnePly, 3, lScore, lKey));
+
+			// a win found at ply 4 is a loss for the mirror reached at ply 6
+			lPlayer.StoreTransTable(lBoard, cWin - 10, cDepth, 4, BOUND_EXACT, lMove);
+			CHECK(lPlayer.ProbeTransTable(lMirror, -Infinity, Infinity, cDepth, 6, lScore, lKey));
+			CHECK(lScore == -cWin + 12);
+			CHECK(lPlayer.ProbeTransTable(lBoard, -Infinity, Infinity, cDepth, 6, lScore, lKey));
+			CHECK(lScore == cWin - 12);
+		}
+		CHECK(lTested == 20);
+	}
+};
+
+/*namespace chk*/ }
+
+int main()
+{
+	TestScoreToTT();
+	TestMirror();
+	CPlayerTest::TestIsDraw();
+	CPlayerTest::TestTransTableInversion();
+
+	if (sFailures) {
+		cout << sFailures << " of " << sChecks << " checks failed" << endl;
+		return 1;
+	}
+	cout << "all " << sChecks << " checks passed" << endl;
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * ttmerge.cpp
+ *
+ * Combines the stored search results of several runs of the client into
+ * one file (see CTransStore). For positions found in more than one file
+ * the deepest result is kept.
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "ctranstore.h"
+
+using namespace std;
+using namespace chk;
+
+static void Usage(const char *pName)
+{
+	cerr << "usage: " << pName << " [-n entries] -o output inputs..." << endl
+		 << "  -n  maximum number of results kept, the deepest ones (default 262144)" << endl
+		 << "  -o  file written, which may also be one of the inputs" << endl;
+}
+
+int main(int pArgC, char **pArgs)
+{
+	size_t lMaxEntries = 1 << 18;
+	const char *lOutput = NULL;
+
+	int lOpt;
+	while((lOpt = getopt(pArgC, pArgs, "n:o:")) != -1) {
+		switch(lOpt) {
+		case 'n': lMaxEntries = strtoul(optarg, NULL, 10); break;
+		case 'o': lOutput = optarg; break;
+		default:
+			Usage(pArgs[0]);
+			return -1;
+		}
+	}
+	if (!lOutput || optind >= pArgC) {
+		Usage(pArgs[0]);
+		return -1;
+	}
+
+	CTransStore lStore;
+	for(int i = optind; i < pArgC; ++i) {
+		size_t lBefore = lStore.Size();
+		if (!lStore.Load(pArgs[i])) {
+			cerr << pArgs[i] << ": missing, or written with other evaluation weights, skipped" << endl;
+			continue;
+		}
+		cout << pArgs[i] << ": " << lStore.Size() - lBefore << " results" << endl;
+	}
+
+	lStore.Compact(lMaxEntries);
+	if (!lStore.Save(lOutput)) {
+		cerr << "can't write " << lOutput << endl;
+		return -1;
+	}
+	cout << "wrote " << lStore.Size() << " results to " << lOutput << endl;
+	return 0;
+}
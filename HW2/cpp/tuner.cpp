@@ -0,0 +1,496 @@
+/*
+ * tuner.cpp
+ *
+ * Fits the weights of CBoard::Evaluate to the results of recorded games
+ * and writes them to evalweights.h.
+ *
+ * The games are read from PDN files (ending in .pdn), like the game record
+ * written by the client, or from the output of the client (the "Player has
+ * chosen move" and "Opponent has chosen move" lines printed with INFO
+ * defined, followed by YOU WIN, YOU LOSE or DRAW). Every quiet position of
+ * a game, i.e. one where the player to move has no jump, is labelled with
+ * the result of the game. The weights are then chosen to minimise the mean
+ * squared error between the result and sigmoid(K*Evaluate()), where K is
+ * fitted first so that the hand picked weights predict the results as well
+ * as possible.
+ *
+ * The evaluation is a ratio of the material values of both sides, so
+ * scaling all the weights doesn't change it. PAWN_SCORE is therefore kept
+ * fixed and the other weights are fitted relative to it.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "cboard.h"
+#include "ctime.h"
+#include "cpdn.h"
+
+using namespace std;
+using namespace chk;
+
+enum EWeight
+{
+	W_PAWN_SCORE,
+	W_KING_SCORE,
+	W_KING_SIDE,
+	W_PAWN_POS,
+	cWeights
+};
+
+static const char *cWeightNames[cWeights] = {
+	"EVAL_PAWN_SCORE", "EVAL_KING_SCORE", "EVAL_KING_SIDE", "EVAL_PAWN_POS"
+};
+
+static const double cEvalScale = 5000.0;
+
+// the positions, as one bitboard per kind of piece (bit i is cell i)
+struct CPositions
+{
+	vector<uint32_t> mOwnMen;
+	vector<uint32_t> mOwnKings;
+	vector<uint32_t> mOtherMen;
+	vector<uint32_t> mOtherKings;
+	vector<float> mResult;		// 1 if we won the game, 0.5 for a draw, 0 if we lost
+
+	size_t Size() const { return mResult.size(); }
+
+	void Add(const CBoard &pBoard, float pResult)
+	{
+		uint32_t lBoards[4] = { 0, 0, 0, 0 };
+		for(int i = 0; i < CBoard::cSquares; ++i) {
+			uint8_t c = pBoard.At(i);
+			if (c & CELL_OWN)
+				lBoards[(c & CELL_KING) ? 1 : 0] |= uint32_t(1) << i;
+			else if (c & CELL_OTHER)
+				lBoards[(c & CELL_KING) ? 3 : 2] |= uint32_t(1) << i;
+		}
+		mOwnMen.push_back(lBoards[0]);
+		mOwnKings.push_back(lBoards[1]);
+		mOtherMen.push_back(lBoards[2]);
+		mOtherKings.push_back(lBoards[3]);
+		mResult.push_back(pResult);
+	}
+};
+
+// the terms of Evaluate() of every position, for each side. The value of a
+// side is the dot product of its features and the weights.
+struct CFeatures
+{
+	vector<float> mOwn[cWeights];
+	vector<float> mOther[cWeights];
+	vector<float> mResult;
+
+	size_t Size() const { return mResult.size(); }
+};
+
+static const uint32_t cKingTopBottom = 0xF000000Fu;	// rows 0 and 7
+static const uint32_t cKingLeftRight = 0x18181818u;	// cells with i % 8 == 3 or 4
+
+static inline int PopCount(uint32_t pBits)
+{
+	return __builtin_popcount(pBits);
+}
+
+// sum over the men of the square of the number of rows they have advanced
+static inline int Advancement(uint32_t pMen, bool pOwn)
+{
+	int lSum = 0;
+	for(int r = 0; r < 8; ++r) {
+		int lRows = pOwn ? r : 7 - r;
+		lSum += lRows * lRows * PopCount(pMen & (0xFu << (4 * r)));
+	}
+	return lSum;
+}
+
+// extracts the features of all positions. The loop has no branches, so
+// that the compiler can vectorise it
+static void ExtractFeatures(const CPositions &pPositions, CFeatures &pFeatures)
+{
+	size_t n = pPositions.Size();
+	for(int w = 0; w < cWeights; ++w) {
+		pFeatures.mOwn[w].resize(n);
+		pFeatures.mOther[w].resize(n);
+	}
+	pFeatures.mResult = pPositions.mResult;
+
+	for(size_t i = 0; i < n; ++i) {
+		uint32_t lOwnKings = pPositions.mOwnKings[i];
+		uint32_t lOtherKings = pPositions.mOtherKings[i];
+		pFeatures.mOwn[W_PAWN_SCORE][i] = PopCount(pPositions.mOwnMen[i]);
+		pFeatures.mOwn[W_KING_SCORE][i] = PopCount(lOwnKings);
+		pFeatures.mOwn[W_KING_SIDE][i] = PopCount(lOwnKings & cKingTopBottom) + PopCount(lOwnKings & cKingLeftRight);
+		pFeatures.mOwn[W_PAWN_POS][i] = Advancement(pPositions.mOwnMen[i], true);
+		pFeatures.mOther[W_PAWN_SCORE][i] = PopCount(pPositions.mOtherMen[i]);
+		pFeatures.mOther[W_KING_SCORE][i] = PopCount(lOtherKings);
+		pFeatures.mOther[W_KING_SIDE][i] = PopCount(lOtherKings & cKingTopBottom) + PopCount(lOtherKings & cKingLeftRight);
+		pFeatures.mOther[W_PAWN_POS][i] = Advancement(pPositions.mOtherMen[i], false);
+	}
+}
+
+// adds the quiet positions of a game to pPositions, labelled with its
+// result. Returns false if the game contains an illegal move
+static bool AddGame(CBoard pBoard, const vector<CMove> &pGame, float pResult, int pSkipPlies,
+					CPositions &pPositions)
+{
+	for(size_t m = 0; m < pGame.size(); ++m) {
+		vector<CMove> lMoves;
+		pBoard.FindPossibleMoves(lMoves);
+		size_t k = 0;
+		while(k < lMoves.size() && !(lMoves[k] == pGame[m]))
+			++k;
+		if (k == lMoves.size())
+			return false;
+		if ((int)m >= pSkipPlies && !lMoves[0].IsJump())
+			pPositions.Add(pBoard, pResult);
+		pBoard.DoMove(pGame[m]);
+	}
+	return true;
+}
+
+// reads the games of a PDN file. Returns the number of games read
+static int ReadPDN(const char *pFile, int pSkipPlies, CPositions &pPositions)
+{
+	CPDNReader lReader;
+	if (!lReader.Open(pFile)) {
+		cerr << "can't open " << pFile << endl;
+		return 0;
+	}
+
+	int lGames = 0;
+	CPDNGame lGame;
+	vector<CMove> lMoves;
+	while(lReader.NextGame(lGame)) {
+		// the positions are seen by the first player
+		float lResult;
+		switch(lGame.Result()) {
+		case PDN_FIRST_WINS: lResult = 1.0f; break;
+		case PDN_SECOND_WINS: lResult = 0.0f; break;
+		case PDN_DRAW: lResult = 0.5f; break;
+		default: continue;
+		}
+		if (!lGame.Moves(lMoves)) {
+			cerr << pFile << ": skipping game " << lGames + 1 << " after move " << lMoves.size() << endl;
+			continue;
+		}
+		AddGame(CBoard(true, CELL_OWN), lMoves, lResult, pSkipPlies, pPositions);
+		++lGames;
+	}
+	return lGames;
+}
+
+// reads the games of one log file of the client. Returns the number of games read
+static int ReadLog(const char *pFile, int pSkipPlies, CPositions &pPositions)
+{
+	ifstream lIn(pFile);
+	if (!lIn) {
+		cerr << "can't open " << pFile << endl;
+		return 0;
+	}
+
+	static const char *cPlayer = "Player has chosen move: ";
+	static const char *cOpponent = "Opponent has chosen move: ";
+
+	int lGames = 0;
+	vector<CMove> lGame;
+	vector<bool> lByPlayer;
+	string lLine;
+	while(getline(lIn, lLine)) {
+		size_t lPos;
+		bool lPlayer;
+		if ((lPos = lLine.find(cOpponent)) != string::npos) {
+			lPlayer = false;
+			lPos += strlen(cOpponent);
+		} else if ((lPos = lLine.find(cPlayer)) != string::npos) {
+			lPlayer = true;
+			lPos += strlen(cPlayer);
+		} else {
+			float lResult;
+			if (lLine.find("YOU WIN") != string::npos)
+				lResult = 1.0f;
+			else if (lLine.find("YOU LOSE") != string::npos)
+				lResult = 0.0f;
+			else if (lLine.find("DRAW") != string::npos)
+				lResult = 0.5f;
+			else if (lLine.find("INVALID GAME") != string::npos) {
+				lGame.clear();
+				lByPlayer.clear();
+				continue;
+			} else
+				continue;
+
+			if (lGame.empty())
+				continue;
+
+			// replay the game. Whoever made the first move is the first player
+			CBoard lBoard(true, lByPlayer[0] ? CELL_OWN : CELL_OTHER);
+			if (!AddGame(lBoard, lGame, lResult, pSkipPlies, pPositions))
+				cerr << pFile << ": illegal move in game " << lGames + 1 << endl;
+			++lGames;
+			lGame.clear();
+			lByPlayer.clear();
+			continue;
+		}
+
+		CMove lMove(lLine.substr(lPos));
+		if (lMove.IsNormal() || lMove.IsJump()) {
+			lGame.push_back(lMove);
+			lByPlayer.push_back(lPlayer);
+		}
+	}
+	return lGames;
+}
+
+// the work of one thread: the positions [mBegin,mEnd)
+struct CTask
+{
+	const CFeatures *mFeatures;
+	const double *mWeights;
+	double mK;
+	size_t mBegin;
+	size_t mEnd;
+
+	// results
+	double mError;
+	double mGradient[cWeights];
+};
+
+static void *RunTask(void *pTask)
+{
+	CTask &lTask = *(CTask*)pTask;
+	const CFeatures &f = *lTask.mFeatures;
+	const double *w = lTask.mWeights;
+
+	double lError = 0.0;
+	double lGradient[cWeights] = { 0.0 };
+	for(size_t i = lTask.mBegin; i < lTask.mEnd; ++i) {
+		double lOwn = 0.0, lOther = 0.0;
+		for(int j = 0; j < cWeights; ++j) {
+			lOwn += w[j] * f.mOwn[j][i];
+			lOther += w[j] * f.mOther[j][i];
+		}
+		double lDiff = lOwn - lOther;
+		double lTotal = lOwn + lOther;
+#ifdef LINEAR_EVAL
+		double lEval = lDiff;
+#else
+		double lEval = cEvalScale * lDiff / lTotal;
+#endif
+		double lP = 1.0 / (1.0 + exp(-lTask.mK * lEval));
+		double lDelta = lP - f.mResult[i];
+		lError += lDelta * lDelta;
+
+		// derivative of the error by the evaluation
+		double lDError = 2.0 * lDelta * lP * (1.0 - lP) * lTask.mK;
+		for(int j = 0; j < cWeights; ++j) {
+			double lFOwn = f.mOwn[j][i], lFOther = f.mOther[j][i];
+#ifdef LINEAR_EVAL
+			double lDEval = lFOwn - lFOther;
+#else
+			double lDEval = cEvalScale * ((lFOwn - lFOther) * lTotal - lDiff * (lFOwn + lFOther)) / (lTotal * lTotal);
+#endif
+			lGradient[j] += lDError * lDEval;
+		}
+	}
+
+	lTask.mError = lError;
+	for(int j = 0; j < cWeights; ++j)
+		lTask.mGradient[j] = lGradient[j];
+	return NULL;
+}
+
+// mean squared error of the prediction, and its gradient if pGradient isn't NULL
+static double Error(const CFeatures &pFeatures, const double *pWeights, double pK,
+					int pThreads, double *pGradient)
+{
+	size_t n = pFeatures.Size();
+	vector<CTask> lTasks(pThreads);
+	vector<pthread_t> lThreads(pThreads);
+	for(int t = 0; t < pThreads; ++t) {
+		lTasks[t].mFeatures = &pFeatures;
+		lTasks[t].mWeights = pWeights;
+		lTasks[t].mK = pK;
+		lTasks[t].mBegin = n * t / pThreads;
+		lTasks[t].mEnd = n * (t + 1) / pThreads;
+		if (t > 0)
+			pthread_create(&lThreads[t], NULL, RunTask, &lTasks[t]);
+	}
+	RunTask(&lTasks[0]);
+
+	double lError = lTasks[0].mError;
+	if (pGradient) {
+		for(int j = 0; j < cWeights; ++j)
+			pGradient[j] = lTasks[0].mGradient[j] / n;
+	}
+	for(int t = 1; t < pThreads; ++t) {
+		pthread_join(lThreads[t], NULL);
+		lError += lTasks[t].mError;
+		if (pGradient) {
+			for(int j = 0; j < cWeights; ++j)
+				pGradient[j] += lTasks[t].mGradient[j] / n;
+		}
+	}
+	return lError / n;
+}
+
+// finds the scaling constant for which the weights predict the results best
+static double FitK(const CFeatures &pFeatures, const double *pWeights, int pThreads)
+{
+	// coarse scan on a logarithmic scale, then refine around the best value
+	double lBest = 1.0, lBestError = 1e30;
+	for(double k = 1e-5; k < 1e-1; k *= 1.25) {
+		double lError = Error(pFeatures, pWeights, k, pThreads, NULL);
+		if (lError < lBestError) {
+			lBestError = lError;
+			lBest = k;
+		}
+	}
+	double lStep = lBest * 0.125;
+	for(int i = 0; i < 20; ++i, lStep *= 0.5) {
+		double lUp = Error(pFeatures, pWeights, lBest + lStep, pThreads, NULL);
+		double lDown = Error(pFeatures, pWeights, lBest - lStep, pThreads, NULL);
+		if (lUp < lBestError) {
+			lBestError = lUp;
+			lBest += lStep;
+		} else if (lDown < lBestError) {
+			lBestError = lDown;
+			lBest -= lStep;
+		}
+	}
+	return lBest;
+}
+
+static bool WriteWeights(const char *pFile, const double *pWeights)
+{
+	static const char *cComments[cWeights] = {
+		"a man",
+		"a king",
+		"a king on the edge of the board, twice in a corner",
+		"times the square of the rows a man has advanced"
+	};
+
+	FILE *lFile = fopen(pFile, "w");
+	if (!lFile)
+		return false;
+	fprintf(lFile, "// weights of CBoard::Evaluate\n"
+				   "//\n"
+				   "// This file is written by the tuner (make tune), the values below were\n"
+				   "// fitted to the results of recorded games.\n"
+				   "\n"
+				   "#ifndef _CHECKERS_EVALWEIGHTS_H_\n"
+				   "#define _CHECKERS_EVALWEIGHTS_H_\n\n");
+	for(int j = 0; j < cWeights; ++j) {
+		char lValue[32];
+		snprintf(lValue, sizeof(lValue), "%s %ld", cWeightNames[j], lround(pWeights[j]));
+		fprintf(lFile, "#define %-23s // %s\n", lValue, cComments[j]);
+	}
+	fprintf(lFile, "\n#endif\n");
+	return fclose(lFile) == 0;
+}
+
+static void Usage(const char *pName)
+{
+	cerr << "usage: " << pName << " [-t threads] [-i iterations] [-r rate] [-s plies] [-o output] logs..." << endl
+		 << "  -t  number of threads (default: number of processors)" << endl
+		 << "  -i  number of gradient descent steps (default 2000)" << endl
+		 << "  -r  learning rate, in units of the weights (default 2)" << endl
+		 << "  -s  plies skipped at the beginning of each game (default 8)" << endl
+		 << "  -o  header the weights are written to (default: only print them)" << endl;
+}
+
+int main(int pArgC, char **pArgs)
+{
+	int lThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int lIterations = 2000;
+	double lRate = 2.0;
+	int lSkipPlies = 8;
+	const char *lOutput = NULL;
+
+	int lOpt;
+	while((lOpt = getopt(pArgC, pArgs, "t:i:r:s:o:")) != -1) {
+		switch(lOpt) {
+		case 't': lThreads = atoi(optarg); break;
+		case 'i': lIterations = atoi(optarg); break;
+		case 'r': lRate = atof(optarg); break;
+		case 's': lSkipPlies = atoi(optarg); break;
+		case 'o': lOutput = optarg; break;
+		default:
+			Usage(pArgs[0]);
+			return -1;
+		}
+	}
+	if (optind >= pArgC || lThreads < 1) {
+		Usage(pArgs[0]);
+		return -1;
+	}
+
+	CPositions lPositions;
+	int lGames = 0;
+	for(int i = optind; i < pArgC; ++i) {
+		size_t lLength = strlen(pArgs[i]);
+		if (lLength > 4 && strcmp(pArgs[i] + lLength - 4, ".pdn") == 0)
+			lGames += ReadPDN(pArgs[i], lSkipPlies, lPositions);
+		else
+			lGames += ReadLog(pArgs[i], lSkipPlies, lPositions);
+	}
+	cout << "read " << lPositions.Size() << " quiet positions from " << lGames << " games" << endl;
+	if (lPositions.Size() == 0)
+		return -1;
+
+	CTime lStart = CTime::GetCurrent();
+	CFeatures lFeatures;
+	ExtractFeatures(lPositions, lFeatures);
+	cout << "extracted features in " << (CTime::GetCurrent() - lStart) / 1000.0 << " ms" << endl;
+
+	double lWeights[cWeights] = { EVAL_PAWN_SCORE, EVAL_KING_SCORE, EVAL_KING_SIDE, EVAL_PAWN_POS };
+	double lK = FitK(lFeatures, lWeights, lThreads);
+	double lError = Error(lFeatures, lWeights, lK, lThreads, NULL);
+	cout << "K = " << lK << ", initial error " << lError << endl;
+
+	// Adam, with PAWN_SCORE fixed
+	const double cBeta1 = 0.9, cBeta2 = 0.999, cEpsilon = 1e-12;
+	double lM[cWeights] = { 0.0 }, lV[cWeights] = { 0.0 };
+	double lBeta1t = 1.0, lBeta2t = 1.0;
+	for(int i = 1; i <= lIterations; ++i) {
+		double lGradient[cWeights];
+		lError = Error(lFeatures, lWeights, lK, lThreads, lGradient);
+		lBeta1t *= cBeta1;
+		lBeta2t *= cBeta2;
+		for(int j = W_PAWN_SCORE + 1; j < cWeights; ++j) {
+			lM[j] = cBeta1 * lM[j] + (1 - cBeta1) * lGradient[j];
+			lV[j] = cBeta2 * lV[j] + (1 - cBeta2) * lGradient[j] * lGradient[j];
+			double lMHat = lM[j] / (1 - lBeta1t);
+			double lVHat = lV[j] / (1 - lBeta2t);
+			lWeights[j] -= lRate * lMHat / (sqrt(lVHat) + cEpsilon);
+		}
+		if (i % 100 == 0 || i == lIterations) {
+			cout << "iteration " << i << ": error " << lError;
+			for(int j = 0; j < cWeights; ++j)
+				cout << " " << lWeights[j];
+			cout << endl;
+		}
+	}
+
+	lError = Error(lFeatures, lWeights, lK, lThreads, NULL);
+	cout << "final error " << lError << " after " << (CTime::GetCurrent() - lStart) / 1000000.0 << " s" << endl;
+	for(int j = 0; j < cWeights; ++j)
+		cout << cWeightNames[j] << " " << lround(lWeights[j]) << endl;
+
+	if (lOutput) {
+		if (!WriteWeights(lOutput, lWeights)) {
+			cerr << "can't write " << lOutput << endl;
+			return -1;
+		}
+		cout << "wrote " << lOutput << endl;
+	}
+	return 0;
+}